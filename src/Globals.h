@@ -17,6 +17,54 @@
 #endif
 
 
+// Optional subsystems. With ESP-IDF, they are selected in menuconfig (see
+// Kconfig). Other ports build all of them, unless disabled by defining
+// MINTGGGAMEENGINE_DISABLE_<NAME> as a build flag.
+#ifdef MINTGGGAMEENGINE_PORT_ESPIDF
+#include <sdkconfig.h>
+#   ifdef CONFIG_MINTGGGAMEENGINE_WITH_AUDIO
+#       define MINTGGGAMEENGINE_WITH_AUDIO
+#   endif
+#   ifdef CONFIG_MINTGGGAMEENGINE_WITH_NETWORK
+#       define MINTGGGAMEENGINE_WITH_NETWORK
+#   endif
+#   ifdef CONFIG_MINTGGGAMEENGINE_WITH_SDCARD
+#       define MINTGGGAMEENGINE_WITH_SDCARD
+#   endif
+#   ifdef CONFIG_MINTGGGAMEENGINE_WITH_SPIFFS
+#       define MINTGGGAMEENGINE_WITH_SPIFFS
+#   endif
+#   ifdef CONFIG_MINTGGGAMEENGINE_WITH_VM
+#       define MINTGGGAMEENGINE_WITH_VM
+#   endif
+#else
+#   ifndef MINTGGGAMEENGINE_DISABLE_AUDIO
+#       define MINTGGGAMEENGINE_WITH_AUDIO
+#   endif
+#   ifndef MINTGGGAMEENGINE_DISABLE_NETWORK
+#       define MINTGGGAMEENGINE_WITH_NETWORK
+#   endif
+#   ifndef MINTGGGAMEENGINE_DISABLE_SDCARD
+#       define MINTGGGAMEENGINE_WITH_SDCARD
+#   endif
+#   ifndef MINTGGGAMEENGINE_DISABLE_SPIFFS
+#       define MINTGGGAMEENGINE_WITH_SPIFFS
+#   endif
+#   ifndef MINTGGGAMEENGINE_DISABLE_VM
+#       define MINTGGGAMEENGINE_WITH_VM
+#   endif
+#endif
+
+// Whether pixels in frame buffers and bitmaps are stored byte-swapped, in the
+// big-endian order that the display expects (see Color::toPixel()). The
+// Arduino port's display driver swaps pixels by itself while sending them.
+#ifdef MINTGGGAMEENGINE_PORT_ESPIDF
+#   ifdef CONFIG_MINTGGGAMEENGINE_SCREEN_PANEL_PIXEL_ORDER
+#       define MINTGGGAMEENGINE_PIXELS_SWAPPED
+#   endif
+#endif
+
+
 namespace MINTGGGameEngine
 {
 
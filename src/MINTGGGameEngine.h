@@ -9,16 +9,26 @@
 #include "core/DefaultEngine.h"
 #include "core/Game.h"
 #include "core/GameObject.h"
+#include "core/Prefab.h"
+#include "core/Script.h"
 
+#include "graphics/BackgroundCache.h"
 #include "graphics/Bitmap.h"
+#include "graphics/BitmapAtlas.h"
 #include "graphics/Color.h"
 #include "graphics/Font.h"
+#include "graphics/GlyphCache.h"
+#include "graphics/IndexedBitmap.h"
+#include "graphics/Palette.h"
 #include "graphics/Screen.h"
+#include "graphics/ScreenFramebuffer.h"
 #include "graphics/ScreenHAGL.h"
 #include "graphics/ScreenNull.h"
+#include "graphics/ScreenRecorder.h"
 #include "graphics/ScreenST7735.h"
 #include "graphics/Sprite.h"
 #include "graphics/Text.h"
+#include "graphics/Tilemap.h"
 
 #include "input/InputEngine.h"
 
@@ -42,9 +52,16 @@
 #include "util/Log.h"
 #include "util/MathUtils.h"
 #include "util/RayCastResult.h"
+#include "util/Rect.h"
 #include "util/Util.h"
 #include "util/Vec2.h"
 
+#ifdef MINTGGGAMEENGINE_WITH_VM
+#include "vm/Bytecode.h"
+#include "vm/VirtualMachine.h"
+#include "vm/VMProgram.h"
+#endif
+
 
 namespace MINTGGGameEngine
 {
@@ -205,6 +222,32 @@ namespace MINTGGGameEngine
  *      Bitmap bmp(16, 16, epd_bitmap_player); // width, height, data
  * \endcode
  *
+ * 32-bit BMP files with partially-transparent pixels keep their alpha channel,
+ * and are blended over the background for soft shadows and antialiased edges.
+ * Any bitmap sprite can also be faded with Sprite::withAlpha():
+ *
+ * \code{.cpp}
+ *      ghost.setSprite(ghost.getSprite().withAlpha(128)); // Half transparent
+ * \endcode
+ *
+ * Many small sprites are best kept in a single sprite sheet. A
+ * \ref MINTGGGameEngine::BitmapAtlas "BitmapAtlas" loads the sheet once and
+ * hands out named views into it (see Bitmap::view()), without copying any
+ * pixels.
+ *
+ * Sprites with only a few colors can be stored as an
+ * \ref MINTGGGameEngine::IndexedBitmap "IndexedBitmap" instead, which takes
+ * 1 to 8 bits per pixel plus a shared \ref MINTGGGameEngine::Palette "Palette".
+ * Swapping the palette gives color variants without copying any pixels:
+ *
+ * \code{.cpp}
+ *      // 16-color BMP, palette index 0 is transparent
+ *      IndexedBitmap enemyBmp = IndexedBitmap::loadBMP("/enemy16.bmp", 0);
+ *      Palette red = enemyBmp.getPalette().copy();
+ *      red.setColor(3, Color::RED);
+ *      GameObject boss = GameObject::createBitmap(0, 0, enemyBmp.withPalette(red));
+ * \endcode
+ *
  *
  * \section sec_collision Collision Detection
  *
@@ -414,6 +457,139 @@ namespace MINTGGGameEngine
  * \endcode
  *
  *
+ * \section sec_tilemaps Tilemaps
+ *
+ * Level backgrounds made of repeating tiles should use a
+ * \ref MINTGGGameEngine::Tilemap "Tilemap" instead of one huge background
+ * bitmap or a GameObject per tile. A tilemap stores one small tile index per
+ * cell, and only draws the tiles that are currently visible:
+ *
+ * \code{.cpp}
+ *		// 16x16 tiles, level of 200x8 tiles
+ *		Tilemap level(Bitmap::loadBMP("/spiffs/tiles.bmp"), 16, 16, 200, 8);
+ *		level.setTiles(levelData); // 1600 bytes, row by row, 0 = empty
+ *		game.addTilemap(level);
+ *
+ *		// Tiles can be changed while the game is running:
+ *		level.setTile(col, row, Tilemap::EmptyTile);
+ * \endcode
+ *
+ * Tilemaps scroll with the camera and are drawn behind all game objects. Use
+ * multiple tilemaps for multiple layers, e.g. with transparent tiles (using a
+ * bitmap mask) for the upper ones. Tilemaps don't take part in collision
+ * detection, but Tilemap::getTileAt() tells which tile is at a position.
+ *
+ * Games that scroll a lot can call Game::setBackgroundCaching() after
+ * Game::begin(). The background color and all tilemaps are then kept in a
+ * screen-sized buffer, and only the strips that scrolled into view are drawn
+ * each frame, at the cost of another screen-sized buffer of RAM.
+ *
+ *
+ * \section sec_prefabs Prefabs & Object Pools
+ *
+ * Games that create and destroy many similar objects (e.g. bullets in a
+ * shooter) can describe these objects once as a
+ * \ref MINTGGGameEngine::Prefab "Prefab", and recycle them through a
+ * \ref MINTGGGameEngine::PrefabPool "PrefabPool". This avoids allocating
+ * memory every time an object is spawned:
+ *
+ * \code{.cpp}
+ *		PrefabPool bulletPool(Prefab::createRect(2, 4, Color::RED, true, true, TagPlayerBullet), 32);
+ *		game.reserveGameObjects(64);
+ *
+ *		// When shooting:
+ *		GameObject bullet = bulletPool.acquire(player.getX(), player.getY());
+ *		if (bullet != nullptr) {
+ *			game.spawnObject(bullet);
+ *		}
+ *
+ *		// When the bullet is gone:
+ *		game.despawnObject(bullet);
+ *		bulletPool.release(bullet);
+ * \endcode
+ *
+ *
+ * \section sec_activity Large Levels & Sleeping Objects
+ *
+ * In levels much larger than the screen, most objects are far away from the
+ * camera most of the time. Such objects can be made dormant automatically,
+ * which means that they are neither drawn nor checked for collisions until the
+ * camera comes close again. Objects that did not move for a while can also go
+ * to sleep, so they are only checked for collisions against moving objects:
+ *
+ * \code{.cpp}
+ *		game.setActivityRange(64);        // Dormant when 64px outside the screen
+ *		game.setSleepAfterIdleFrames(30); // Sleep after 30 frames without movement
+ *
+ *		// In the game loop, only update what matters:
+ *		for (GameObject enemy : game.getActiveGameObjectsWithTag(TagEnemy)) {
+ *			updateEnemy(enemy);
+ *		}
+ * \endcode
+ *
+ * Both rules are disabled by default. See
+ * \ref MINTGGGameEngine::GameObject::ActivityState "GameObject::ActivityState"
+ * for details.
+ *
+ *
+ * \section sec_scripts Scripts
+ *
+ * Sequences that last over many frames, like cutscenes or enemy attack
+ * patterns, can be written as C++20 coroutines returning a
+ * \ref MINTGGGameEngine::Script "Script". Instead of keeping track of their
+ * state in the game loop, they simply wait for what should happen next:
+ *
+ * \code{.cpp}
+ *		Script introScript(Text text)
+ *		{
+ *			text.setText("Get ready...");
+ *			co_await seconds(2.0f);
+ *			text.setText("Press A to start");
+ *			co_await buttonPressed("A");
+ *			text.setText("");
+ *		}
+ *
+ *		game.scripts().start(introScript(titleText));
+ * \endcode
+ *
+ * Scripts are resumed by DefaultEngine after the game loop function. Only
+ * scripts whose wait condition is met are resumed, so sleeping scripts cost
+ * nothing. Their memory is taken from a fixed pool, see
+ * \ref MINTGGGameEngine::ScriptFramePool "ScriptFramePool".
+ *
+ *
+ * \section sec_vm Bytecode Scripts
+ *
+ * Game logic can also be loaded from storage instead of being compiled into
+ * the firmware, e.g. for levels written by students. Such logic is written in
+ * a simple assembly language, translated to bytecode on the PC with
+ * \c tools/mgvmasm.py, and run by a
+ * \ref MINTGGGameEngine::VirtualMachine "VirtualMachine":
+ *
+ * \code{.cpp}
+ *		VirtualMachine vm(game);
+ *		vm.load(VMProgram::load("/sdcard/level1.mgvm"));
+ *		vm.bindObject(0, player);
+ *
+ *		// In the game loop:
+ *		vm.runFrame(dt);
+ * \endcode
+ *
+ * The program can only access the objects bound to it, and executes at most a
+ * fixed number of instructions per frame, see
+ * \ref MINTGGGameEngine::VirtualMachine::setInstructionBudget() "setInstructionBudget()".
+ *
+ *
+ * \section sec_config Selecting Subsystems
+ *
+ * Games that don't need audio, networking, SD card or SPIFFS support, or the
+ * bytecode VM can disable them in the \c "MINTGG Game Engine" menu of
+ * \c "idf.py menuconfig". Disabled subsystems are replaced by stubs that fail
+ * gracefully, and the ESP-IDF components they depend on are not linked, which
+ * saves flash and RAM. \c tools/size_report.py shows how much each option
+ * saves for a given project.
+ *
+ *
  * \section sec_gravity Gravity & Jumping
  *
  * While the engine does not include a physics engine, a simple helper class
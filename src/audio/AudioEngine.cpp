@@ -13,6 +13,8 @@ LOG_USE_TAG("AudioEngine")
 namespace MINTGGGameEngine
 {
 
+#ifdef MINTGGGAMEENGINE_WITH_AUDIO
+
 void _AudioEngineTaskMain(void* params)
 {
     ((AudioEngine*) params)->audioTaskMain();
@@ -228,4 +230,32 @@ void AudioEngine::noTone()
 #endif
 }
 
+#else
+
+// Stubs for builds without audio (see Kconfig). No task is created and nothing
+// is ever played.
+
+bool AudioEngine::begin(gpionum_t speakerPin)
+{
+    this->speakerPin = speakerPin;
+    LogInfo("Audio support disabled at compile time");
+    return false;
+}
+
+void AudioEngine::playClip(const AudioClip& clip, Priority prio, bool loop, bool advanceInBackground)
+{
+}
+
+bool AudioEngine::stopClip(const AudioClip& clip)
+{
+    return false;
+}
+
+void AudioEngine::setMute(bool mute)
+{
+    this->mute = mute;
+}
+
+#endif
+
 }
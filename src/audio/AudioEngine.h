@@ -31,6 +31,9 @@ namespace MINTGGGameEngine
  *
  * For details of how clips are handled, see the AudioClip class.
  *
+ * If audio support is disabled at compile time (see Kconfig), this class is a
+ * stub that never plays anything, and no audio task is created.
+ *
  * \see AudioClip
  */
 class AudioEngine
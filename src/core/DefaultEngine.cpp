@@ -3,6 +3,7 @@
 #include "../graphics/Font.h"
 #include "../util/Log.h"
 #include "../util/Util.h"
+#include "../util/WorkerTask.h"
 #include "graphics/ScreenHAGL.h"
 
 #ifdef MINTGGGAMEENGINE_PORT_ESPIDF
@@ -22,6 +23,26 @@ namespace MINTGGGameEngine
 {
 
 
+static const char* SetupStageNames[DefaultEngine::SetupStageCount] = {
+    "storage",
+    "screen",
+    "audio",
+    "input",
+    "internal storage",
+    "SD card"
+};
+
+// Bit masks of the stages that each stage has to wait for.
+static const uint32_t SetupStageDeps[DefaultEngine::SetupStageCount] = {
+    0,
+    0,
+    0,
+    0,
+    0,
+    (1 << DefaultEngine::SetupStageScreen) // Shares the SPI bus set up by the screen
+};
+
+
 #ifdef MINTGGGAMEENGINE_PORT_ESPIDF
 
 void HeapCapsAllocFailedHook (
@@ -37,8 +58,15 @@ void HeapCapsAllocFailedHook (
 
 
 DefaultEngine::DefaultEngine()
-    : screen(nullptr), printFrameStats(false)
+    : screen(nullptr), printFrameStats(false), setupCfg(), setupEvents(nullptr),
+      setupStartTime(0), firstFrameDone(false)
 {
+    for (uint32_t& t : setupStageTimesUs) {
+        t = 0;
+    }
+#ifdef MINTGGGAMEENGINE_PORT_ESPIDF
+    haglScreen = nullptr;
+#endif
 }
 
 bool DefaultEngine::setup(SetupConfig* cfg)
@@ -70,32 +98,108 @@ bool DefaultEngine::setup(SetupConfig* cfg)
 
     TimerInit();
 
+    setupStartTime = TimerGetTickcountUs();
+
     game->setApplicationID(cfg->appID ? cfg->appID : "mygame");
 
-    LogInfo("Initializing storage...");
-    initStorage(cfg);
+    setupCfg = *cfg;
+    game->network().setLazyInitFunc([this]() { initNetwork(&setupCfg); });
 
-    LogInfo("Initializing screen...");
-    initScreen(cfg);
+    setupEvents = xEventGroupCreate();
 
-    LogInfo("Initializing audio...");
-    initAudio(cfg);
+    const SetupStage workerStages[] = {
+        SetupStageStorage,
+        SetupStageInternalStorage,
+        SetupStageSDCard
+    };
+    const SetupStage mainStages[] = {
+        SetupStageScreen,
+        SetupStageAudio,
+        SetupStageInput
+    };
 
-    LogInfo("Initializing input...");
-    initInput(cfg);
+    // The worker runs its stages in order, waiting for dependencies on the
+    // main task's stages where necessary. If it can't be started, everything
+    // runs on the main task instead.
+    WorkerTask worker(6144, uxTaskPriorityGet(nullptr), "SetupWorker");
+    bool parallel = setupEvents  &&  worker.start();
 
-    LogInfo("Initializing network...");
-    initNetwork(cfg);
+    if (parallel) {
+        for (SetupStage stage : workerStages) {
+            worker.addWorkItem([this, cfg, stage]() { runSetupStage(stage, cfg); });
+        }
+    }
+    for (SetupStage stage : mainStages) {
+        runSetupStage(stage, cfg);
+    }
+    if (!parallel) {
+        for (SetupStage stage : workerStages) {
+            runSetupStage(stage, cfg);
+        }
+    }
 
-    mountInternalStorage(cfg);
+    waitForSetupStages((1 << SetupStageCount) - 1);
+    worker.stop();
 
-	mountSDCard(cfg);
+    if (setupEvents) {
+        vEventGroupDelete(setupEvents);
+        setupEvents = nullptr;
+    }
 
-    LogInfo("*** END ENGINE SETUP ***");
+    for (int i = 0 ; i < SetupStageCount ; i++) {
+        LogInfo("Setup stage %-16s %7uus", SetupStageNames[i], (unsigned int) setupStageTimesUs[i]);
+    }
+    LogInfo("*** END ENGINE SETUP (%uus) ***", (unsigned int) (TimerGetTickcountUs() - setupStartTime));
 
     return true;
 }
 
+void DefaultEngine::runSetupStage(SetupStage stage, SetupConfig* cfg)
+{
+    waitForSetupStages(SetupStageDeps[stage]);
+
+    LogInfo("Initializing %s...", SetupStageNames[stage]);
+
+    timer_ustick_t t1 = TimerGetTickcountUs();
+
+    switch (stage) {
+    case SetupStageStorage:
+        initStorage(cfg);
+        break;
+    case SetupStageScreen:
+        initScreen(cfg);
+        break;
+    case SetupStageAudio:
+        initAudio(cfg);
+        break;
+    case SetupStageInput:
+        initInput(cfg);
+        break;
+    case SetupStageInternalStorage:
+        mountInternalStorage(cfg);
+        break;
+    case SetupStageSDCard:
+        mountSDCard(cfg);
+        break;
+    default:
+        break;
+    }
+
+    setupStageTimesUs[stage] = (uint32_t) (TimerGetTickcountUs() - t1);
+
+    if (setupEvents) {
+        xEventGroupSetBits(setupEvents, 1 << stage);
+    }
+}
+
+void DefaultEngine::waitForSetupStages(uint32_t stageMask)
+{
+    if (stageMask == 0  ||  !setupEvents) {
+        return;
+    }
+    xEventGroupWaitBits(setupEvents, stageMask, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
 void DefaultEngine::doFrame(void (*gameLoopFunc)(float))
 {
     game->beginFrame();
@@ -106,8 +210,12 @@ void DefaultEngine::doFrame(void (*gameLoopFunc)(float))
     if (gameLoopFunc) {
         gameLoopFunc(dt);
     }
+#ifdef MINTGGGAMEENGINE_HAS_SCRIPTS
+    game->scripts().update(dt);
+#endif
 
     timer_ustick_t checkCollTime = TimerGetTickcountUs();
+    game->updateActivity();
     game->checkCollisions(); // Kollisionsprüfung
 
     timer_ustick_t drawTime = TimerGetTickcountUs();
@@ -119,7 +227,7 @@ void DefaultEngine::doFrame(void (*gameLoopFunc)(float))
     if (printFrameStats) {
         LogInfo(
             "Frame Stats   -   total: %uus   -   gameLoop: %uus, checkCollisions: %uus, draw: %uus   -   "
-            "fill: %uus, objs: %uus, colls: %uus, rays: %uus, texts: %uus, comm: %uus",
+            "fill: %uus, objs: %uus, colls: %uus, rays: %uus, texts: %uus, comm: %uus, dirty: %upx",
 
             (uint32_t) (endTime-gameLoopTime),
 
@@ -132,12 +240,24 @@ void DefaultEngine::doFrame(void (*gameLoopFunc)(float))
             drawStats.timeCollidersUs,
             drawStats.timeRaysUs,
             drawStats.timeTextsUs,
-            drawStats.timeCommitUs
+            drawStats.timeCommitUs,
+            drawStats.dirtyPixels
             );
+#ifdef MINTGGGAMEENGINE_PORT_ESPIDF
+        if (haglScreen  &&  haglScreen->isAsyncFlush()) {
+            LogInfo("Flush wait: %uus", haglScreen->getLastFlushWaitUs());
+        }
+#endif
     }
 
     game->endFrame();
 
+    if (!firstFrameDone) {
+        firstFrameDone = true;
+        LogInfo("First frame done %uus after setup began",
+                (unsigned int) (TimerGetTickcountUs() - setupStartTime));
+    }
+
     game->sleepNextFrame(); // Warten bis zum nächsten Frame
 }
 
@@ -175,7 +295,7 @@ void DefaultEngine::initScreen(SetupConfig* cfg)
     stScreen->begin();
     screen = stScreen;
 #elif defined(MINTGGGAMEENGINE_PORT_ESPIDF)
-    ScreenHAGL* haglScreen = new ScreenHAGL;
+    haglScreen = new ScreenHAGL;
 
     hagl_hal_custom_config_t haglCfg = {
         .width = 160,
@@ -202,6 +322,12 @@ void DefaultEngine::initScreen(SetupConfig* cfg)
 
     haglScreen->begin();
 
+#if CONFIG_MINTGGGAMEENGINE_SCREEN_BAND_HEIGHT > 0
+    haglScreen->enableBanding(CONFIG_MINTGGGAMEENGINE_SCREEN_BAND_HEIGHT);
+#elif defined(CONFIG_MINTGGGAMEENGINE_SCREEN_ASYNC_FLUSH)
+    haglScreen->enableAsyncFlush();
+#endif
+
     screen = haglScreen;
 #else
     screen = new ScreenNull;
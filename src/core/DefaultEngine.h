@@ -4,8 +4,13 @@
 
 #include "Game.h"
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
 #ifdef MINTGGGAMEENGINE_PORT_ARDUINO
 #include "../graphics/ScreenST7735.h"
+#elif defined(MINTGGGAMEENGINE_PORT_ESPIDF)
+#include "../graphics/ScreenHAGL.h"
 #endif
 
 
@@ -44,6 +49,27 @@ public:
         } pins;
     };
 
+    /**
+     * \brief The stages of setup().
+     *
+     * Stages that don't depend on each other run concurrently: Flash and SD card
+     * stages, which mostly wait for the hardware, run on a worker task while the
+     * main task initializes the screen, audio and input. The network is not
+     * part of setup, it is initialized on first use by NetworkEngine::start()
+     * (see initNetwork()).
+     */
+    enum SetupStage
+    {
+        SetupStageStorage,          ///< NVS, see initStorage()
+        SetupStageScreen,           ///< Display and fonts, see initScreen()
+        SetupStageAudio,            ///< See initAudio()
+        SetupStageInput,            ///< See initInput()
+        SetupStageInternalStorage,  ///< SPIFFS, see mountInternalStorage()
+        SetupStageSDCard,           ///< Depends on the screen's SPI bus, see mountSDCard()
+
+        SetupStageCount
+    };
+
 public:
     DefaultEngine();
 
@@ -56,10 +82,24 @@ public:
 
     void setPrintFrameStatistics(bool print) { printFrameStats = print; }
 
+    /**
+     * \brief Return the time that a stage of setup() took, in microseconds.
+     */
+    uint32_t getSetupStageTimeUs(SetupStage stage) const { return setupStageTimesUs[stage]; }
+
 protected:
     virtual void initAudio(SetupConfig* cfg);
     virtual void initInput(SetupConfig* cfg);
+
+    /**
+     * \brief Initialize the network engine.
+     *
+     * This is not called by setup(), but on the first call to
+     * NetworkEngine::start(), so that games that don't use the network don't
+     * pay for it. cfg points to a copy of the configuration passed to setup().
+     */
     virtual void initNetwork(SetupConfig* cfg);
+
     virtual void initStorage(SetupConfig* cfg);
     virtual void initScreen(SetupConfig* cfg);
 
@@ -71,15 +111,28 @@ protected:
 #elif defined(MINTGGGAMEENGINE_PORT_ESPIDF)
 #endif
 
+private:
+    void runSetupStage(SetupStage stage, SetupConfig* cfg);
+    void waitForSetupStages(uint32_t stageMask);
+
 protected:
     Game* game;
     Screen* screen;
 
     bool printFrameStats;
 
+private:
+    SetupConfig setupCfg; // For initNetwork()
+    EventGroupHandle_t setupEvents;
+    uint32_t setupStageTimesUs[SetupStageCount];
+    timer_ustick_t setupStartTime;
+    bool firstFrameDone;
+
 #ifdef MINTGGGAMEENGINE_PORT_ARDUINO
     SPIClass* spi;
     Adafruit_ST7735* tft;
+#elif defined(MINTGGGAMEENGINE_PORT_ESPIDF)
+    ScreenHAGL* haglScreen; // The screen created by initScreen(), or null if overridden
 #endif
 };
 
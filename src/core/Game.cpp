@@ -13,6 +13,11 @@
 LOG_USE_TAG("Game")
 
 
+// More regions than this are merged, because every region costs a full pass
+// over all objects and a separate address window on the display.
+static constexpr size_t MaxDirtyRegions = 8;
+
+
 
 
 namespace MINTGGGameEngine
@@ -24,7 +29,13 @@ Game::Game()
       collisionCb(nullptr),
       drawColliders(false), drawRayCasts(false),
       frameTime(1000/40), lastFrameTime(0),
-      backgroundColor(Color::WHITE)
+      activityRange(-1.0f), sleepAfterIdleFrames(0),
+      backgroundColor(Color::WHITE),
+      dirtyTracking(false), fullRedraw(true), debugDrawn(false),
+      lastCameraX(0), lastCameraY(0)
+#ifdef MINTGGGAMEENGINE_HAS_SCRIPTS
+      , scriptSched(inputEng)
+#endif
 {
 }
 
@@ -69,6 +80,14 @@ NetworkEngine& Game::network()
 }
 
 
+#ifdef MINTGGGAMEENGINE_HAS_SCRIPTS
+ScriptScheduler& Game::scripts()
+{
+    return scriptSched;
+}
+#endif
+
+
 void Game::setApplicationID(const std::string& id)
 {
     appID = id;
@@ -95,25 +114,64 @@ void Game::endFrame()
 
 void Game::checkCollisions(float shrink)
 {
-    auto gameObjsLocal = gameObjs;
-    for (auto firstIt = gameObjsLocal.begin() ; firstIt != gameObjsLocal.end() ; ++firstIt) {
+    // Work on a copy, because the collision callback might spawn or despawn
+    // objects. The copy is a member so that its memory can be reused.
+    // Active objects come first, followed by sleeping ones. Dormant objects
+    // are left out entirely.
+    collisionObjs.clear();
+    for (const GameObject& obj : gameObjs) {
+        if (obj.getActivityState() == GameObject::ActivityState::Active) {
+            collisionObjs.push_back(obj);
+        }
+    }
+    const size_t numActive = collisionObjs.size();
+    for (const GameObject& obj : gameObjs) {
+        if (obj.getActivityState() == GameObject::ActivityState::Sleeping) {
+            collisionObjs.push_back(obj);
+        }
+    }
+
+    // The first object of each pair is always active, so pairs of two sleeping
+    // objects are never checked.
+    auto activeEnd = collisionObjs.begin() + numActive;
+    for (auto firstIt = collisionObjs.begin() ; firstIt != activeEnd ; ++firstIt) {
         auto secondIt = firstIt;
-        for (++secondIt ; secondIt != gameObjsLocal.end() ; ++secondIt) {
+        for (++secondIt ; secondIt != collisionObjs.end() ; ++secondIt) {
             if (firstIt->collides(*secondIt, shrink)) {
+                if (secondIt->getActivityState() == GameObject::ActivityState::Sleeping) {
+                    secondIt->wake();
+                }
                 onCollision(*firstIt, *secondIt, shrink);
             }
         }
     }
+    collisionObjs.clear();
 }
 
 
 void Game::draw(DrawStats* stats)
 {
+    if (screen  &&  screen->getBandHeight() != 0) {
+        drawBands(stats);
+        return;
+    }
+    if (dirtyTracking  &&  screen  &&  screen->supportsPartialRedraw()) {
+        drawDirtyRegions(stats);
+        return;
+    }
     drawBegin(stats);
     drawFinish(stats);
 }
 
 
+void Game::invalidate(const Rect& rect)
+{
+    if (dirtyTracking) {
+        addDirtyRegion(rect);
+    }
+}
+
+
 void Game::drawBegin(DrawStats* stats)
 {
     if (!screen) {
@@ -123,11 +181,8 @@ void Game::drawBegin(DrawStats* stats)
     Vec2 drawOffset = -cameraOffset;
 
     timer_ustick_t timeFill = TimerGetTickcountUs();
-    if (backgroundBmp) {
-        screen->drawBitmap(0, 0, backgroundBmp);
-    } else {
-        screen->fillScreen(backgroundColor);
-    }
+    updateBackground(drawOffset, false);
+    drawBackground(drawOffset);
 
     timer_ustick_t timeObjects = TimerGetTickcountUs();
     for (const GameObject& obj : gameObjs) {
@@ -137,7 +192,9 @@ void Game::drawBegin(DrawStats* stats)
     timer_ustick_t timeColliders = TimerGetTickcountUs();
     if (drawColliders) {
         for (const GameObject& obj : gameObjs) {
-            obj.getWorldCollider().debugDraw(*screen, 0xF81D, drawOffset);
+            if (obj.getActivityState() != GameObject::ActivityState::Dormant) {
+                obj.getWorldCollider().debugDraw(*screen, 0xF81D, drawOffset);
+            }
         }
     }
     
@@ -187,25 +244,398 @@ void Game::drawFinish(DrawStats* stats)
     if (stats) {
         stats->timeTextsUs = (uint32_t) (timeCommit-timeTexts);
         stats->timeCommitUs = (uint32_t) (timeEnd-timeCommit);
+        stats->dirtyPixels = (uint32_t) screen->getWidth() * screen->getHeight();
+    }
+}
+
+
+void Game::updateBackground(const Vec2& drawOffset, bool trackDirty)
+{
+    // Changed tiles are tracked by the tilemaps themselves, in map pixels.
+    // They are passed on in world pixels to the cache, and in screen pixels
+    // to the dirty regions.
+    for (const Tilemap& map : tilemaps) {
+        if (map.d->drawDirty) {
+            fullRedraw = true;
+            bgCache.invalidate();
+        } else if (!map.d->dirtyRect.isEmpty()) {
+            Rect rect = map.d->dirtyRect;
+            rect.x += (int32_t) roundf(map.d->x);
+            rect.y += (int32_t) roundf(map.d->y);
+            bgCache.invalidate(rect);
+            if (trackDirty  &&  !fullRedraw) {
+                rect.x += (int32_t) roundf(drawOffset.x());
+                rect.y += (int32_t) roundf(drawOffset.y());
+                addDirtyRegion(rect);
+            }
+        }
+        map.d->dirtyRect = Rect();
+        map.d->drawDirty = false;
+    }
+
+    if (bgCache.isEnabled()  &&  !backgroundBmp) {
+        bgCache.update (
+            -(int32_t) roundf(drawOffset.x()), -(int32_t) roundf(drawOffset.y()),
+            backgroundColor, tilemaps
+            );
     }
 }
 
+void Game::drawBackground(const Vec2& drawOffset)
+{
+    if (bgCache.isEnabled()  &&  !backgroundBmp) {
+        bgCache.draw(*screen);
+        return;
+    }
+    if (backgroundBmp) {
+        screen->drawBitmap(0, 0, backgroundBmp);
+    } else {
+        screen->fillScreen(backgroundColor);
+    }
+    for (const Tilemap& map : tilemaps) {
+        map.draw(*screen, drawOffset);
+    }
+}
+
+void Game::drawDirtyRegions(DrawStats* stats)
+{
+    Vec2 drawOffset = -cameraOffset;
+
+    timer_ustick_t timeFill = TimerGetTickcountUs();
+    collectDirtyRegions(drawOffset);
+
+    // Every region is redrawn completely (background, objects and texts), but
+    // only objects and texts that overlap it need to be considered.
+    uint32_t timeObjects = 0;
+    uint32_t timeTexts = 0;
+    uint32_t dirtyPixels = 0;
+    for (const Rect& region : dirtyRegions) {
+        screen->setClipRect(region);
+        dirtyPixels += region.getArea();
+
+        drawBackground(drawOffset);
+
+        timer_ustick_t t1 = TimerGetTickcountUs();
+        for (const GameObject& obj : gameObjs) {
+            if (obj.d->drawRect.intersects(region)) {
+                obj.draw(*screen, drawOffset);
+            }
+        }
+
+        timer_ustick_t t2 = TimerGetTickcountUs();
+        for (const Text& text : texts) {
+            if (text.d->drawRect.intersects(region)) {
+                if (text.isWorldSpace()) {
+                    screen->drawText(text, (int16_t) (drawOffset.x()+0.5f), (int16_t) (drawOffset.y()+0.5f));
+                } else {
+                    screen->drawText(text);
+                }
+            }
+        }
+
+        timeObjects += (uint32_t) (t2-t1);
+        timeTexts += (uint32_t) (TimerGetTickcountUs()-t2);
+    }
+
+    // Debug drawing always causes a full redraw, so there's only one region.
+    timer_ustick_t timeColliders = TimerGetTickcountUs();
+    if (drawColliders) {
+        for (const GameObject& obj : gameObjs) {
+            if (obj.getActivityState() != GameObject::ActivityState::Dormant) {
+                obj.getWorldCollider().debugDraw(*screen, 0xF81D, drawOffset);
+            }
+        }
+    }
+
+    timer_ustick_t timeRays = TimerGetTickcountUs();
+    for (const auto& info : rayCastDrawInfos) {
+        RayCastResult::drawDebugRay(*screen, info.rayStart, info.rayEnd, drawOffset);
+        info.result.drawDebug(*screen, drawOffset);
+    }
+    rayCastDrawInfos.clear();
+
+    screen->resetClipRect();
+
+    timer_ustick_t timeCommit = TimerGetTickcountUs();
+    screen->commitRegions(dirtyRegions.data(), dirtyRegions.size());
+    dirtyRegions.clear();
+
+    timer_ustick_t timeEnd = TimerGetTickcountUs();
+
+    if (stats) {
+        stats->timeFillUs = (uint32_t) (timeColliders-timeFill) - timeObjects - timeTexts;
+        stats->timeObjectsUs = timeObjects;
+        stats->timeCollidersUs = (uint32_t) (timeRays-timeColliders);
+        stats->timeRaysUs = (uint32_t) (timeCommit-timeRays);
+        stats->timeTextsUs = timeTexts;
+        stats->timeCommitUs = (uint32_t) (timeEnd-timeCommit);
+        stats->dirtyPixels = dirtyPixels;
+    }
+}
+
+void Game::drawBands(DrawStats* stats)
+{
+    Vec2 drawOffset = -cameraOffset;
+
+    const int32_t screenW = screen->getWidth();
+    const int32_t screenH = screen->getHeight();
+    const int32_t bandH = screen->getBandHeight();
+
+    // Everything is drawn once per band, so find out once which bands each
+    // object and text touches.
+    timer_ustick_t timeStart = TimerGetTickcountUs();
+    updateBackground(drawOffset, false);
+    for (const GameObject& obj : gameObjs) {
+        obj.d->drawRect = getDrawRect(obj, drawOffset);
+    }
+    for (const Text& text : texts) {
+        text.d->drawRect = getDrawRect(text, drawOffset);
+    }
+
+    uint32_t timeFill = (uint32_t) (TimerGetTickcountUs()-timeStart);
+    uint32_t timeObjects = 0;
+    uint32_t timeColliders = 0;
+    uint32_t timeRays = 0;
+    uint32_t timeTexts = 0;
+    uint32_t timeCommit = 0;
+    for (int32_t bandY = 0 ; bandY < screenH ; bandY += bandH) {
+        const Rect band(0, bandY, screenW, bandH);
+
+        timer_ustick_t t1 = TimerGetTickcountUs();
+        screen->beginBand(bandY);
+        drawBackground(drawOffset);
+
+        timer_ustick_t t2 = TimerGetTickcountUs();
+        for (const GameObject& obj : gameObjs) {
+            if (obj.d->drawRect.intersects(band)) {
+                obj.draw(*screen, drawOffset);
+            }
+        }
+
+        timer_ustick_t t3 = TimerGetTickcountUs();
+        if (drawColliders) {
+            for (const GameObject& obj : gameObjs) {
+                if (obj.getActivityState() != GameObject::ActivityState::Dormant) {
+                    obj.getWorldCollider().debugDraw(*screen, 0xF81D, drawOffset);
+                }
+            }
+        }
+
+        timer_ustick_t t4 = TimerGetTickcountUs();
+        for (const auto& info : rayCastDrawInfos) {
+            RayCastResult::drawDebugRay(*screen, info.rayStart, info.rayEnd, drawOffset);
+            info.result.drawDebug(*screen, drawOffset);
+        }
+
+        timer_ustick_t t5 = TimerGetTickcountUs();
+        for (const Text& text : texts) {
+            if (text.d->drawRect.intersects(band)) {
+                if (text.isWorldSpace()) {
+                    screen->drawText(text, (int16_t) (drawOffset.x()+0.5f), (int16_t) (drawOffset.y()+0.5f));
+                } else {
+                    screen->drawText(text);
+                }
+            }
+        }
+
+        timer_ustick_t t6 = TimerGetTickcountUs();
+        screen->commitBand();
+
+        timeFill += (uint32_t) (t2-t1);
+        timeObjects += (uint32_t) (t3-t2);
+        timeColliders += (uint32_t) (t4-t3);
+        timeRays += (uint32_t) (t5-t4);
+        timeTexts += (uint32_t) (t6-t5);
+        timeCommit += (uint32_t) (TimerGetTickcountUs()-t6);
+    }
+    rayCastDrawInfos.clear();
+
+    if (stats) {
+        stats->timeFillUs = timeFill;
+        stats->timeObjectsUs = timeObjects;
+        stats->timeCollidersUs = timeColliders;
+        stats->timeRaysUs = timeRays;
+        stats->timeTextsUs = timeTexts;
+        stats->timeCommitUs = timeCommit;
+        stats->dirtyPixels = (uint32_t) screenW * screenH;
+    }
+}
+
+void Game::collectDirtyRegions(const Vec2& drawOffset)
+{
+    const int32_t camX = (int32_t) roundf(cameraOffset.x());
+    const int32_t camY = (int32_t) roundf(cameraOffset.y());
+    if (camX != lastCameraX  ||  camY != lastCameraY) {
+        // Everything in world space moved
+        fullRedraw = true;
+        lastCameraX = camX;
+        lastCameraY = camY;
+    }
+
+    // Debug drawings aren't tracked, so redraw everything while they are
+    // visible, and once more to remove them.
+    const bool debugDraw = drawColliders  ||  !rayCastDrawInfos.empty();
+    if (debugDraw  ||  debugDrawn) {
+        fullRedraw = true;
+    }
+    debugDrawn = debugDraw;
+
+    // The old and new areas of everything that changed are dirty. The draw
+    // rects must be updated even for a full redraw, so they are correct for
+    // the next frame.
+    for (const GameObject& obj : gameObjs) {
+        Rect rect = getDrawRect(obj, drawOffset);
+        if (obj.d->drawDirty  ||  rect != obj.d->drawRect) {
+            if (!fullRedraw) {
+                addDirtyRegion(obj.d->drawRect);
+                addDirtyRegion(rect);
+            }
+            obj.d->drawRect = rect;
+            obj.d->drawDirty = false;
+        }
+    }
+    for (const Text& text : texts) {
+        Rect rect = getDrawRect(text, drawOffset);
+        if (text.d->drawDirty  ||  rect != text.d->drawRect) {
+            if (!fullRedraw) {
+                addDirtyRegion(text.d->drawRect);
+                addDirtyRegion(rect);
+            }
+            text.d->drawRect = rect;
+            text.d->drawDirty = false;
+        }
+    }
+
+    updateBackground(drawOffset, true);
+
+    // Many small windows are slower to send than one big one, so give up
+    // early if most of the screen changed anyway.
+    const Rect screenRect(0, 0, screen->getWidth(), screen->getHeight());
+    if (!fullRedraw) {
+        int32_t dirtyArea = 0;
+        for (const Rect& region : dirtyRegions) {
+            dirtyArea += region.getArea();
+        }
+        fullRedraw = dirtyArea > screenRect.getArea()*3/4;
+    }
+
+    if (fullRedraw) {
+        dirtyRegions.clear();
+        dirtyRegions.push_back(screenRect);
+        fullRedraw = false;
+    }
+}
+
+void Game::addDirtyRegion(const Rect& rect)
+{
+    if (!screen) {
+        return;
+    }
+
+    Rect r = rect.intersected(Rect(0, 0, screen->getWidth(), screen->getHeight()));
+    if (r.isEmpty()) {
+        return;
+    }
+
+    // Keep the regions disjoint, so no pixel is drawn or sent twice.
+    for (size_t i = 0 ; i < dirtyRegions.size() ; ) {
+        if (dirtyRegions[i].intersects(r)) {
+            r = r.united(dirtyRegions[i]);
+            dirtyRegions[i] = dirtyRegions.back();
+            dirtyRegions.pop_back();
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    if (dirtyRegions.size() < MaxDirtyRegions) {
+        dirtyRegions.push_back(r);
+        return;
+    }
+
+    // Too many regions: Merge with the one that grows the least. The result
+    // might overlap others, so add it again.
+    size_t bestIdx = 0;
+    int32_t bestGrowth = INT32_MAX;
+    for (size_t i = 0 ; i < dirtyRegions.size() ; i++) {
+        int32_t growth = r.united(dirtyRegions[i]).getArea() - dirtyRegions[i].getArea();
+        if (growth < bestGrowth) {
+            bestGrowth = growth;
+            bestIdx = i;
+        }
+    }
+    r = r.united(dirtyRegions[bestIdx]);
+    dirtyRegions[bestIdx] = dirtyRegions.back();
+    dirtyRegions.pop_back();
+    addDirtyRegion(r);
+}
+
+Rect Game::getDrawRect(const GameObject& obj, const Vec2& drawOffset) const
+{
+    if (!obj.isVisible()  ||  obj.getActivityState() == GameObject::ActivityState::Dormant) {
+        return Rect();
+    }
+    return obj.d->sprite.getDrawRect(obj.getX() + drawOffset.x(), obj.getY() + drawOffset.y())
+            .intersected(Rect(0, 0, screen->getWidth(), screen->getHeight()));
+}
+
+Rect Game::getDrawRect(const Text& text, const Vec2& drawOffset) const
+{
+    if (!text.isVisible()  ||  text.getText().empty()) {
+        return Rect();
+    }
+
+    Text::TextMetrics metrics;
+    text.getTextMetrics(&metrics);
+
+    int32_t x, y;
+    text.transformAnchorPosition(Text::Anchor::TopLeft, &x, &y, &metrics);
+    if (text.isWorldSpace()) {
+        x += (int16_t) (drawOffset.x()+0.5f);
+        y += (int16_t) (drawOffset.y()+0.5f);
+    }
+
+    // Centered lines may be off by one pixel due to rounding
+    const Font& font = text.getFont();
+    const int32_t w = (int32_t) (metrics.maxGlyphsPerLine * font.getGlyphWidth() * text.getScaleFactor()) + 2;
+    const int32_t h = (int32_t) (metrics.numLines * font.getGlyphHeight() * text.getScaleFactor());
+    return Rect(x-1, y, w, h).intersected(Rect(0, 0, screen->getWidth(), screen->getHeight()));
+}
+
 
 void Game::spawnObject(const GameObject& obj)
 {
-    gameObjs.insert(obj);
+    auto it = std::lower_bound(gameObjs.begin(), gameObjs.end(), obj, GOZOrderComparator());
+    if (it != gameObjs.end()  &&  *it == obj) {
+        return;
+    }
+    gameObjs.insert(it, obj);
+}
+
+
+void Game::reserveGameObjects(size_t count)
+{
+    gameObjs.reserve(count);
+    collisionObjs.reserve(count);
 }
 
 
 bool Game::despawnObject(const GameObject& obj)
 {
-    return gameObjs.erase(obj) != 0;
-    /*auto it = std::find(gameObjs.begin(), gameObjs.end(), obj);
-    if (it == gameObjs.end()) {
+    auto it = std::lower_bound(gameObjs.begin(), gameObjs.end(), obj, GOZOrderComparator());
+    if (it == gameObjs.end()  ||  *it != obj) {
         return false;
     }
     gameObjs.erase(it);
-    return true;*/
+
+    if (dirtyTracking) {
+        addDirtyRegion(obj.d->drawRect);
+    }
+    obj.d->drawRect = Rect();
+    obj.d->drawDirty = true;
+
+    return true;
 }
 
 
@@ -222,22 +652,85 @@ bool Game::despawnObjects(const std::vector<GameObject>& objs)
 
 
 std::vector<GameObject> Game::getGameObjects() const
+{
+    return gameObjs;
+}
+
+
+std::vector<GameObject> Game::getGameObjectsWithTag(uint64_t tag) const
+{
+    std::vector<GameObject> res;
+    res.reserve(gameObjs.size() > 10 ? 10 : gameObjs.size());
+    for (const GameObject& go : gameObjs) {
+        if (go.hasTag(tag)) {
+            res.push_back(go);
+        }
+    }
+    return res;
+}
+
+
+void Game::updateActivity()
+{
+    const bool checkRange = screen  &&  activityRange >= 0.0f;
+
+    const float viewX1 = cameraOffset.x() - activityRange;
+    const float viewY1 = cameraOffset.y() - activityRange;
+    const float viewX2 = checkRange ? cameraOffset.x() + screen->getWidth() + activityRange : 0.0f;
+    const float viewY2 = checkRange ? cameraOffset.y() + screen->getHeight() + activityRange : 0.0f;
+
+    for (const GameObject& obj : gameObjs) {
+        GameObject::Data* d = obj.d.get();
+
+        const bool moved = (d->x != d->lastX  ||  d->y != d->lastY);
+        d->lastX = d->x;
+        d->lastY = d->y;
+
+        if (!d->autoActivity) {
+            continue;
+        }
+
+        if (checkRange) {
+            const float w = std::max(d->sprite.getWidth(), d->collider.getWidth());
+            const float h = std::max(d->sprite.getHeight(), d->collider.getHeight());
+            if (d->x > viewX2  ||  d->x+w < viewX1  ||  d->y > viewY2  ||  d->y+h < viewY1) {
+                d->activity = GameObject::ActivityState::Dormant;
+                d->idleFrames = 0;
+                continue;
+            }
+        }
+
+        if (moved  ||  d->activity == GameObject::ActivityState::Dormant) {
+            d->activity = GameObject::ActivityState::Active;
+            d->idleFrames = 0;
+        } else if (sleepAfterIdleFrames != 0  &&  d->activity == GameObject::ActivityState::Active) {
+            if (++d->idleFrames >= sleepAfterIdleFrames) {
+                d->activity = GameObject::ActivityState::Sleeping;
+            }
+        }
+    }
+}
+
+
+std::vector<GameObject> Game::getActiveGameObjects() const
 {
     std::vector<GameObject> res;
     res.reserve(gameObjs.size());
     for (const GameObject& go : gameObjs) {
-        res.push_back(go);
+        if (go.isActive()) {
+            res.push_back(go);
+        }
     }
     return res;
 }
 
 
-std::vector<GameObject> Game::getGameObjectsWithTag(uint64_t tag) const
+std::vector<GameObject> Game::getActiveGameObjectsWithTag(uint64_t tag) const
 {
     std::vector<GameObject> res;
     res.reserve(gameObjs.size() > 10 ? 10 : gameObjs.size());
     for (const GameObject& go : gameObjs) {
-        if (go.hasTag(tag)) {
+        if (go.isActive()  &&  go.hasTag(tag)) {
             res.push_back(go);
         }
     }
@@ -257,11 +750,59 @@ bool Game::removeText(const Text& text)
     if (it == texts.end()) {
         return false;
     }
+    if (dirtyTracking) {
+        addDirtyRegion(it->d->drawRect);
+    }
+    it->d->drawRect = Rect();
+    it->d->drawDirty = true;
+
     texts.erase(it);
     return true;
 }
 
 
+void Game::addTilemap(const Tilemap& map)
+{
+    if (!map  ||  std::find(tilemaps.begin(), tilemaps.end(), map) != tilemaps.end()) {
+        return;
+    }
+    tilemaps.push_back(map);
+    fullRedraw = true;
+    bgCache.invalidate();
+}
+
+
+bool Game::removeTilemap(const Tilemap& map)
+{
+    auto it = std::find(tilemaps.begin(), tilemaps.end(), map);
+    if (it == tilemaps.end()) {
+        return false;
+    }
+    tilemaps.erase(it);
+    fullRedraw = true;
+    bgCache.invalidate();
+    return true;
+}
+
+
+bool Game::setBackgroundCaching(bool enabled)
+{
+    if (!enabled) {
+        bgCache.end();
+        return true;
+    }
+    if (!screen) {
+        return false;
+    }
+    if (!bgCache.begin(screen->getWidth(), screen->getHeight())) {
+        LogError("Not enough memory for the background cache.");
+        return false;
+    }
+    bgCache.invalidate();
+    return true;
+}
+
+
 RayCastResult Game::castRay (
         const Vec2& start, const Vec2& end,
         const std::vector<GameObject>& gameObjects,
@@ -2,18 +2,21 @@
 
 #include "../Globals.h"
 #include "../audio/AudioEngine.h"
+#include "../graphics/BackgroundCache.h"
 #include "../graphics/Screen.h"
 #include "../graphics/Text.h"
+#include "../graphics/Tilemap.h"
 #include "../input/InputEngine.h"
 #include "../network/NetworkEngine.h"
 #include "../physics/GameObjectCollision.h"
 #include "../storage/StorageEngine.h"
 #include "../util/RayCastResult.h"
+#include "../util/Rect.h"
 #include "GameObject.h"
+#include "Script.h"
 
 #include <list>
 #include <random>
-#include <set>
 #include <vector>
 
 #include "../util/Util.h"
@@ -64,6 +67,7 @@ public:
         uint32_t timeRaysUs;
         uint32_t timeTextsUs;
         uint32_t timeCommitUs;
+        uint32_t dirtyPixels; ///< Pixels redrawn and sent to the display
     };
 
 public:
@@ -112,6 +116,15 @@ public:
      * \return Network engine reference.
      */
     NetworkEngine& network();
+
+#ifdef MINTGGGAMEENGINE_HAS_SCRIPTS
+    /**
+     * \brief Return a reference to the script scheduler.
+     *
+     * \return Script scheduler reference.
+     */
+    ScriptScheduler& scripts();
+#endif
     
     ///@}
 
@@ -182,6 +195,10 @@ public:
      * For each collision, the callbck set by setCollisionCallback() will be
      * called.
      *
+     * Dormant objects are skipped, and pairs of two sleeping objects are not
+     * checked (see GameObject::ActivityState). A sleeping object that collides
+     * with an active one is woken up.
+     *
      * \param shrink The amount to shrink each collider when checking for
      *      collision. Can be useful to avoid corner cases when two colliders
      *      are touching exactly on an edge. See Collider class for more info.
@@ -201,16 +218,80 @@ public:
      * instances that are visible. It can also optionally draw collider outlines
      * and ray casts for debugging purposes (see setDrawColliders() and
      * setDrawRayCasts()).
+     *
+     * On screens that draw in bands (see Screen::getBandHeight()), the scene
+     * is drawn once per band, skipping objects and texts outside of it.
      */
     void draw(DrawStats* stats = nullptr);
 
-    void setBackgroundColor(const Color& color) { backgroundColor = color; backgroundBmp = Bitmap(); }
+    /**
+     * \brief Enable or disable dirty region tracking.
+     *
+     * If enabled, draw() only redraws and sends to the display the regions of
+     * the screen that have changed since the last frame: Those of objects that
+     * moved or whose sprite, visibility, flip direction or Z order changed,
+     * of texts that changed, and of objects and texts that were removed.
+     * Scrolling the camera, changing the background and debug drawing (see
+     * setDrawColliders()) cause a full redraw. This saves a lot of time on
+     * mostly static screens like menus or puzzles.
+     *
+     * Changes that the engine can't see, like modifying a Bitmap's pixels in
+     * place, must be announced with invalidate().
+     *
+     * This only has an effect if the screen keeps its contents between frames
+     * (see Screen::supportsPartialRedraw()). The default is disabled.
+     *
+     * \param enabled true to enable, false to always redraw the entire screen.
+     */
+    void setDirtyRegionTracking(bool enabled) { dirtyTracking = enabled; fullRedraw = true; }
+
+    bool isDirtyRegionTracking() const { return dirtyTracking; }
+
+    /**
+     * \brief Redraw the entire screen in the next frame.
+     *
+     * \see setDirtyRegionTracking()
+     */
+    void invalidate() { fullRedraw = true; }
+
+    /**
+     * \brief Redraw the given region of the screen in the next frame.
+     *
+     * \param rect The region in screen coordinates.
+     * \see setDirtyRegionTracking()
+     */
+    void invalidate(const Rect& rect);
+
+    void setBackgroundColor(const Color& color)
+            { backgroundColor = color; backgroundBmp = Bitmap(); fullRedraw = true; bgCache.invalidate(); }
 
     Color getBackgroundColor() const { return backgroundColor; }
 
-    void setBackgroundBitmap(const Bitmap& bmp) { backgroundBmp = bmp; }
+    void setBackgroundBitmap(const Bitmap& bmp) { backgroundBmp = bmp; fullRedraw = true; }
 
     Bitmap getBackgroundBitmap() const { return backgroundBmp; }
+
+    /**
+     * \brief Enable or disable caching of the background layer.
+     *
+     * If enabled, the background color and all tilemaps are rendered into a
+     * screen-sized ring buffer. When the camera moves, only the rows and
+     * columns that scrolled into view are rendered, and the rest is copied
+     * from the ring. Drawing the background then costs about as much as
+     * filling the screen, no matter how many tilemap layers there are.
+     *
+     * This takes another screen-sized buffer of RAM (40 KB at 160x128), so it
+     * is disabled by default. It has no effect while a background bitmap is
+     * set (see setBackgroundBitmap()).
+     *
+     * Must be called after begin().
+     *
+     * \param enabled true to enable, false to disable.
+     * \return true if successful, false if out of memory.
+     */
+    bool setBackgroundCaching(bool enabled);
+
+    bool isBackgroundCaching() const { return bgCache.isEnabled(); }
     
     ///@}
     
@@ -229,6 +310,17 @@ public:
      * \param obj The GameObject to spawn.
      */
     void spawnObject(const GameObject& obj);
+
+    /**
+     * \brief Reserve memory for the given number of spawned GameObjects.
+     *
+     * As long as no more objects than this are spawned at the same time,
+     * spawning and despawning objects does not allocate memory. This is most
+     * useful together with PrefabPool.
+     *
+     * \param count The number of objects to reserve memory for.
+     */
+    void reserveGameObjects(size_t count);
     
     /**
      * \brief Despawn the given GameObject.
@@ -275,6 +367,93 @@ public:
     ///@}
     
     
+    /// \name Activity
+    ///@{
+    
+    /**
+     * \brief Set the distance from the visible screen area beyond which
+     *      objects become dormant.
+     *
+     * Objects that are further away from the area currently visible through
+     * the camera are made dormant by updateActivity(), so they are neither
+     * drawn nor checked for collisions. They become active again as soon as
+     * they come closer. This is useful for large, scrolling levels.
+     *
+     * Only objects with automatic activity handling are affected (see
+     * GameObject::setAutoActivity()).
+     *
+     * \param range The distance in pixels, or a negative value to disable
+     *      (the default).
+     */
+    void setActivityRange(float range) { activityRange = range; }
+    
+    /**
+     * \brief Return the distance beyond which objects become dormant.
+     *
+     * \see setActivityRange()
+     */
+    float getActivityRange() const { return activityRange; }
+    
+    /**
+     * \brief Set the number of frames without movement after which objects go
+     *      to sleep.
+     *
+     * Sleeping objects are not checked for collision against each other, only
+     * against active objects. They are woken up when they move, or when an
+     * active object collides with them.
+     *
+     * Only objects with automatic activity handling are affected (see
+     * GameObject::setAutoActivity()).
+     *
+     * \param frames The number of frames, or 0 to disable (the default).
+     */
+    void setSleepAfterIdleFrames(uint16_t frames) { sleepAfterIdleFrames = frames; }
+    
+    /**
+     * \brief Return the number of frames without movement after which objects
+     *      go to sleep.
+     *
+     * \see setSleepAfterIdleFrames()
+     */
+    uint16_t getSleepAfterIdleFrames() const { return sleepAfterIdleFrames; }
+    
+    /**
+     * \brief Update the activity state of all spawned objects.
+     *
+     * This applies the rules set by setActivityRange() and
+     * setSleepAfterIdleFrames(). It should be called once per frame, after the
+     * objects were moved and before checkCollisions(). DefaultEngine does this
+     * automatically.
+     *
+     * The cost of this method is a few comparisons per object, which is much
+     * less than what is saved in checkCollisions() and draw() for large
+     * levels.
+     */
+    void updateActivity();
+    
+    /**
+     * \brief Get a list of all active GameObjects.
+     *
+     * Use this instead of getGameObjects() to update only the objects that are
+     * currently relevant.
+     *
+     * \return List of spawned, active GameObjects.
+     * \see GameObject::ActivityState
+     */
+    std::vector<GameObject> getActiveGameObjects() const;
+    
+    /**
+     * \brief Get a list of all active GameObjects that have the given tag.
+     *
+     * \param tag The tag to search for. Only a single tag is allowed here.
+     * \return List of spawned, active GameObjects with the tag.
+     * \see getActiveGameObjects()
+     */
+    std::vector<GameObject> getActiveGameObjectsWithTag(uint64_t tag) const;
+    
+    ///@}
+    
+    
     /// \name Text
     ///@{
     
@@ -294,6 +473,30 @@ public:
     bool removeText(const Text& text);
     
     ///@}
+
+
+    /// \name Tilemaps
+    ///@{
+
+    /**
+     * \brief Add a tilemap layer to the scene.
+     *
+     * Tilemaps are drawn on top of the background, but behind all game
+     * objects. Multiple layers are drawn in the order they were added.
+     *
+     * \param map The tilemap to add.
+     */
+    void addTilemap(const Tilemap& map);
+
+    /**
+     * \brief Remove a tilemap layer from the scene.
+     *
+     * \param map The tilemap to remove.
+     * \return true if removed, false otherwise (e.g. if it wasn't added before).
+     */
+    bool removeTilemap(const Tilemap& map);
+
+    ///@}
     
     
     /// \name Ray Casting
@@ -441,14 +644,26 @@ private:
     void drawBegin(DrawStats* stats);
     void drawFinish(DrawStats* stats);
 
+    void updateBackground(const Vec2& drawOffset, bool trackDirty);
+    void drawBackground(const Vec2& drawOffset);
+    void drawDirtyRegions(DrawStats* stats);
+    void drawBands(DrawStats* stats);
+    void collectDirtyRegions(const Vec2& drawOffset);
+    void addDirtyRegion(const Rect& rect);
+    Rect getDrawRect(const GameObject& obj, const Vec2& drawOffset) const;
+    Rect getDrawRect(const Text& text, const Vec2& drawOffset) const;
+
     void onCollision(const GameObject& a, const GameObject& b, float shrink);
 
 private:
     std::string appID;
 
     Screen* screen;
-    std::set<GameObject, GOZOrderComparator> gameObjs;
+    std::vector<GameObject> gameObjs; // Sorted by GOZOrderComparator
+    std::vector<GameObject> collisionObjs; // Reused by checkCollisions() to avoid allocations
     std::list<Text> texts;
+    std::vector<Tilemap> tilemaps; // In drawing order
+    BackgroundCache bgCache;
 
     std::random_device randDev;
     std::mt19937 randGen;
@@ -470,8 +685,22 @@ private:
     
     Vec2 cameraOffset;
 
+    float activityRange;
+    uint16_t sleepAfterIdleFrames;
+
     Color backgroundColor;
     Bitmap backgroundBmp;
+
+    bool dirtyTracking;
+    bool fullRedraw;
+    bool debugDrawn; // Colliders or rays were drawn in the last frame
+    int32_t lastCameraX;
+    int32_t lastCameraY;
+    std::vector<Rect> dirtyRegions; // Non-overlapping, in screen coordinates
+
+#ifdef MINTGGGAMEENGINE_HAS_SCRIPTS
+    ScriptScheduler scriptSched;
+#endif
 };
 
 }
@@ -27,6 +27,11 @@ GameObject GameObject::createBitmap(float x, float y, const Bitmap& bitmap, bool
     return GameObject(x, y, Sprite::createBitmap(bitmap), collider ? Collider::createRect(0, 0, bitmap.getWidth(), bitmap.getHeight()) : Collider());
 }
 
+GameObject GameObject::createBitmap(float x, float y, const IndexedBitmap& bitmap, bool collider)
+{
+    return GameObject(x, y, Sprite::createBitmap(bitmap), collider ? Collider::createRect(0, 0, bitmap.getWidth(), bitmap.getHeight()) : Collider());
+}
+
 GameObject GameObject::createColliderCircle(float x, float y, float r)
 {
     return GameObject(x, y, Sprite(), Collider::createCircle(r, r, r));
@@ -40,15 +45,9 @@ GameObject GameObject::createColliderRect(float x, float y, float w, float h)
 GameObject::GameObject(float x, float y, const Sprite& sprite, const Collider& collider)
     : d(std::make_shared<Data>())
 {
-    d->x = x;
-    d->y = y;
-    d->moveDir = Vec2();
-    d->flipDir = FlipDir::None;
-    d->sprite = sprite;
-    d->collider = collider;
-    d->tags = 0;
-    d->zOrder = ZOrderNormal;
-    d->visible = true;
+    d->pool = nullptr;
+    d->pooledFree = false;
+    reset(x, y, sprite, collider, 0, ZOrderNormal);
 }
 
 Vec2 GameObject::getCenterPosition(bool useSprite) const
@@ -98,7 +97,7 @@ Collider GameObject::getWorldCollider() const
 
 void GameObject::draw(Screen& screen, const Vec2& offset) const
 {
-    if (isVisible()) {
+    if (isVisible()  &&  getActivityState() != ActivityState::Dormant) {
         getSprite().draw(screen, getX()+offset.x(), getY()+offset.y(), getFlipDir());
     }
 }
@@ -108,4 +107,27 @@ bool GameObject::collides(const GameObject& other, float shrink) const
     return getWorldCollider().collides(other.getWorldCollider(), shrink);
 }
 
+void GameObject::reset (
+        float x, float y,
+        const Sprite& sprite, const Collider& collider,
+        uint64_t tags, uint16_t zOrder
+) {
+    d->x = x;
+    d->y = y;
+    d->moveDir = Vec2();
+    d->flipDir = FlipDir::None;
+    d->sprite = sprite;
+    d->collider = collider;
+    d->tags = tags;
+    d->zOrder = zOrder;
+    d->visible = true;
+    d->activity = ActivityState::Active;
+    d->autoActivity = true;
+    d->idleFrames = 0;
+    d->lastX = x;
+    d->lastY = y;
+    d->drawRect = Rect();
+    d->drawDirty = true;
+}
+
 }
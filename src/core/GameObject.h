@@ -6,6 +6,7 @@
 #include "../graphics/Screen.h"
 #include "../graphics/Sprite.h"
 #include "../physics/Collider.h"
+#include "../util/Rect.h"
 #include "../util/Vec2.h"
 
 #include <memory>
@@ -14,6 +15,8 @@
 namespace MINTGGGameEngine
 {
 
+class PrefabPool;
+
 /**
  * \brief Represents a single object in the game (e.g. player, enemy, bullet).
  *
@@ -47,6 +50,34 @@ namespace MINTGGGameEngine
  */
 class GameObject
 {
+    friend class Game;
+    friend class PrefabPool;
+
+public:
+    /**
+     * \brief How much work the engine spends on an object every frame.
+     *
+     * \see setActivityState()
+     * \see Game::updateActivity()
+     */
+    enum class ActivityState : uint8_t
+    {
+        /// Fully simulated: Drawn, and checked for collision against all other
+        /// non-dormant objects.
+        Active,
+
+        /// Resting (e.g. because it didn't move for a while): Still drawn, and
+        /// checked for collision against active objects, but not against
+        /// other sleeping objects. Woken up by movement or by contact with an
+        /// active object.
+        Sleeping,
+
+        /// Ignored by the engine (e.g. because it is far away from the
+        /// camera): Neither drawn nor checked for collision. Woken up when it
+        /// gets close to the camera again.
+        Dormant
+    };
+
 private:
     struct Data
     {
@@ -59,6 +90,15 @@ private:
         uint64_t tags;
         uint16_t zOrder; // Higher is in front
         bool visible;
+        PrefabPool* pool; // Owning pool for pooled instances, otherwise null
+        bool pooledFree; // true while a pooled instance is available for acquire()
+        ActivityState activity;
+        bool autoActivity;
+        uint16_t idleFrames;
+        float lastX; // Position at the last Game::updateActivity()
+        float lastY;
+        Rect drawRect; // Screen area covered in the last frame, for Game's dirty regions
+        bool drawDirty; // Appearance changed since the last frame
     };
 
 public:
@@ -119,6 +159,14 @@ public:
      * \see Sprite
      */
     static GameObject createBitmap(float x, float y, const Bitmap& bitmap = Bitmap(), bool collider = true);
+
+    /**
+     * \brief Create a GameObject with a palette-indexed bitmap as sprite.
+     *
+     * \see createBitmap(float, float, const Bitmap&, bool)
+     * \see IndexedBitmap
+     */
+    static GameObject createBitmap(float x, float y, const IndexedBitmap& bitmap, bool collider = true);
     
     
     /**
@@ -452,7 +500,7 @@ public:
      *
      * \param flipDir The direction to flip the object.
      */
-    void setFlipDir(FlipDir flipDir) { if (d) d->flipDir = flipDir; }
+    void setFlipDir(FlipDir flipDir) { if (d) { d->flipDir = flipDir; d->drawDirty = true; } }
     
     /**
      * \brief Return the order in which to draw this object on the screen.
@@ -471,7 +519,7 @@ public:
      * \param zorder The Z order.
      * \see ZOrder
      */
-    void setZOrder(uint16_t zorder = ZOrderNormal) { if (d) d->zOrder = zorder; }
+    void setZOrder(uint16_t zorder = ZOrderNormal) { if (d) { d->zOrder = zorder; d->drawDirty = true; } }
     
     /**
      * \brief Return whether the object is currently visible.
@@ -488,7 +536,7 @@ public:
      *
      * \param visible true if visible, false if hidden.
      */
-    void setVisible(bool visible) { if (d) d->visible = visible; }
+    void setVisible(bool visible) { if (d) { d->visible = visible; d->drawDirty = true; } }
     
     /**
      * \brief Return the object's visual sprite.
@@ -503,7 +551,7 @@ public:
      *
      * \param sprite The new sprite.
      */
-    void setSprite(const Sprite& sprite) { if (d) d->sprite = sprite; }
+    void setSprite(const Sprite& sprite) { if (d) { d->sprite = sprite; d->drawDirty = true; } }
     
     /**
      * \brief Return the object's collider, used for collision checking.
@@ -561,6 +609,64 @@ public:
     ///@}
     
     
+    /// \name Activity
+    ///@{
+    
+    /**
+     * \brief Return how much work the engine currently spends on the object.
+     *
+     * \return The activity state. Null objects are always dormant.
+     * \see ActivityState
+     */
+    ActivityState getActivityState() const { return d ? d->activity : ActivityState::Dormant; }
+    
+    /**
+     * \brief Explicitly set the activity state of the object.
+     *
+     * If automatic activity handling is enabled (see setAutoActivity()), the
+     * state may be changed again by the next Game::updateActivity().
+     *
+     * \param state The new activity state.
+     */
+    void setActivityState(ActivityState state) { if (d) { d->activity = state; d->idleFrames = 0; d->drawDirty = true; } }
+    
+    /**
+     * \brief Check whether the object is fully active.
+     *
+     * \return true if active, false if sleeping or dormant.
+     */
+    bool isActive() const { return getActivityState() == ActivityState::Active; }
+    
+    /**
+     * \brief Make the object active again.
+     *
+     * This is a shortcut for setActivityState(ActivityState::Active).
+     */
+    void wake() { setActivityState(ActivityState::Active); }
+    
+    /**
+     * \brief Return whether the engine may change the activity state
+     *      automatically.
+     *
+     * \see setAutoActivity()
+     */
+    bool isAutoActivity() const { return d ? d->autoActivity : false; }
+    
+    /**
+     * \brief Enable or disable automatic activity handling for this object.
+     *
+     * If enabled (the default), Game::updateActivity() puts the object to
+     * sleep or makes it dormant depending on its movement and distance to the
+     * camera. If disabled, the state is only changed by setActivityState()
+     * (e.g. for a player object that must always stay active).
+     *
+     * \param autoActivity true to enable, false to disable.
+     */
+    void setAutoActivity(bool autoActivity) { if (d) d->autoActivity = autoActivity; }
+    
+    ///@}
+    
+    
     
     /// \name Tags
     ///@{
@@ -676,6 +782,13 @@ public:
     
     ///@}
 
+private:
+    void reset (
+            float x, float y,
+            const Sprite& sprite, const Collider& collider,
+            uint64_t tags, uint16_t zOrder
+            );
+
 private:
     std::shared_ptr<Data> d;
 };
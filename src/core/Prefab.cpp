@@ -0,0 +1,114 @@
+#include "Prefab.h"
+
+#include <cassert>
+
+
+namespace MINTGGGameEngine
+{
+
+
+Prefab Prefab::createCircle(float r, const Color& color, bool filled, bool collider, uint64_t tags)
+{
+    return Prefab(Sprite::createCircle(r, color, filled), collider ? Collider::createCircle(r, r, r) : Collider(), tags);
+}
+
+Prefab Prefab::createRect(float w, float h, const Color& color, bool filled, bool collider, uint64_t tags)
+{
+    assert(w >= 0  &&  h >= 0);
+    return Prefab(Sprite::createRect(w, h, color, filled), collider ? Collider::createRect(0, 0, w, h) : Collider(), tags);
+}
+
+Prefab Prefab::createBitmap(const Bitmap& bitmap, bool collider, uint64_t tags)
+{
+    return Prefab(Sprite::createBitmap(bitmap), collider ? Collider::createRect(0, 0, bitmap.getWidth(), bitmap.getHeight()) : Collider(), tags);
+}
+
+Prefab Prefab::createBitmap(const IndexedBitmap& bitmap, bool collider, uint64_t tags)
+{
+    return Prefab(Sprite::createBitmap(bitmap), collider ? Collider::createRect(0, 0, bitmap.getWidth(), bitmap.getHeight()) : Collider(), tags);
+}
+
+Prefab::Prefab(const Sprite& sprite, const Collider& collider, uint64_t tags, uint16_t zOrder)
+{
+    auto data = std::make_shared<Data>();
+    data->sprite = sprite;
+    data->collider = collider;
+    data->tags = tags;
+    data->zOrder = zOrder;
+    d = data;
+}
+
+GameObject Prefab::instantiate(float x, float y) const
+{
+    GameObject obj(x, y, d->sprite, d->collider);
+    obj.setTag(d->tags);
+    obj.setZOrder(d->zOrder);
+    return obj;
+}
+
+
+
+PrefabPool::PrefabPool(const Prefab& prefab, size_t capacity, bool growable)
+    : prefab(prefab), growable(growable)
+{
+    objs.reserve(capacity);
+    freeObjs.reserve(capacity);
+    for (size_t i = 0 ; i < capacity ; i++) {
+        freeObjs.push_back(createObject());
+    }
+}
+
+PrefabPool::~PrefabPool()
+{
+    // Objects might outlive the pool through other references, so they must
+    // not point to it anymore.
+    for (GameObject& obj : objs) {
+        obj.d->pool = nullptr;
+    }
+}
+
+GameObject PrefabPool::acquire(float x, float y)
+{
+    if (freeObjs.empty()) {
+        if (!growable) {
+            return GameObject();
+        }
+        GameObject obj = createObject();
+        freeObjs.reserve(objs.capacity());
+        freeObjs.push_back(obj);
+    }
+
+    GameObject obj = freeObjs.back();
+    freeObjs.pop_back();
+
+    obj.d->pooledFree = false;
+    obj.reset(x, y, prefab.getSprite(), prefab.getCollider(), prefab.getTags(), prefab.getZOrder());
+
+    return obj;
+}
+
+bool PrefabPool::release(const GameObject& obj)
+{
+    if (!obj.d  ||  obj.d->pool != this  ||  obj.d->pooledFree) {
+        return false;
+    }
+
+    obj.d->pooledFree = true;
+
+    // Capacity for all objects was reserved in advance, so this never allocates.
+    freeObjs.push_back(obj);
+
+    return true;
+}
+
+GameObject PrefabPool::createObject()
+{
+    GameObject obj = prefab.instantiate(0.0f, 0.0f);
+    obj.d->pool = this;
+    obj.d->pooledFree = true;
+    objs.push_back(obj);
+    return obj;
+}
+
+
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include "../Globals.h"
+#include "../graphics/Bitmap.h"
+#include "../graphics/Color.h"
+#include "../graphics/Sprite.h"
+#include "../physics/Collider.h"
+#include "../util/Vec2.h"
+#include "GameObject.h"
+
+#include <memory>
+#include <vector>
+
+
+namespace MINTGGGameEngine
+{
+
+/**
+ * \brief A template from which many similar GameObjects can be created.
+ *
+ * A Prefab stores the parts of a GameObject that are usually identical for all
+ * objects of one kind (e.g. all bullets or all enemies of one type): The
+ * Sprite, the Collider, the tags and the Z order. This data is stored only
+ * once and can not be changed after the Prefab was created.
+ *
+ * GameObjects can be created from a Prefab either directly using
+ * instantiate(), or through a PrefabPool, which recycles GameObjects instead
+ * of allocating new ones every time.
+ *
+ * This class uses a shared pointer to store its data. Copying is therefore
+ * cheap, and all copies still refer to the same single Prefab.
+ *
+ * \see PrefabPool
+ */
+class Prefab
+{
+private:
+    struct Data
+    {
+        Sprite sprite;
+        Collider collider;
+        uint64_t tags;
+        uint16_t zOrder;
+    };
+
+public:
+    /// \name Creating common Prefabs
+    ///@{
+
+    /**
+     * \brief Create a Prefab with a circle as sprite and collider.
+     *
+     * \param r Radius of the circle.
+     * \param color Color of the circle.
+     * \param filled true to fill the circle, false to draw only its outline.
+     * \param collider true to give the objects a circular collider, false to
+     *      give them no collider.
+     * \param tags The tags that each object starts with.
+     * \return The new Prefab.
+     * \see GameObject::createCircle()
+     */
+    static Prefab createCircle (
+            float r, const Color& color,
+            bool filled = true, bool collider = true,
+            uint64_t tags = 0
+            );
+
+    /**
+     * \brief Create a Prefab with a rectangle as sprite and collider.
+     *
+     * Unlike GameObject::createRect(), the size must not be negative, because
+     * the rectangle always starts at the object's position.
+     *
+     * \param w Width of the rectangle. Must not be negative.
+     * \param h Height of the rectangle. Must not be negative.
+     * \param color Color of the rectangle.
+     * \param filled true to fill the rectangle, false to draw only its
+     *      outline.
+     * \param collider true to give the objects a rectangular collider, false
+     *      to give them no collider.
+     * \param tags The tags that each object starts with.
+     * \return The new Prefab.
+     * \see GameObject::createRect()
+     */
+    static Prefab createRect (
+            float w, float h, const Color& color,
+            bool filled = true, bool collider = true,
+            uint64_t tags = 0
+            );
+
+    /**
+     * \brief Create a Prefab with a Bitmap as sprite and a rectangular
+     *      collider.
+     *
+     * The bitmap's pixel data is shared by all objects created from the
+     * Prefab.
+     *
+     * \param bitmap The bitmap to use as a sprite.
+     * \param collider true to give the objects a rectangular collider, false
+     *      to give them no collider.
+     * \param tags The tags that each object starts with.
+     * \return The new Prefab.
+     * \see GameObject::createBitmap()
+     */
+    static Prefab createBitmap(const Bitmap& bitmap, bool collider = true, uint64_t tags = 0);
+
+    /**
+     * \brief Create a Prefab for objects with a palette-indexed bitmap as
+     *      sprite.
+     *
+     * \see createBitmap(const Bitmap&, bool, uint64_t)
+     */
+    static Prefab createBitmap(const IndexedBitmap& bitmap, bool collider = true, uint64_t tags = 0);
+
+    ///@}
+
+public:
+    /**
+     * \brief Create a null Prefab.
+     */
+    Prefab() {}
+
+    /**
+     * \brief Create a new Prefab.
+     *
+     * \param sprite The sprite of each object.
+     * \param collider The collider of each object, in local coordinates.
+     * \param tags The tags that each object starts with.
+     * \param zOrder The Z order that each object starts with.
+     */
+    Prefab (
+            const Sprite& sprite,
+            const Collider& collider = Collider(),
+            uint64_t tags = 0,
+            uint16_t zOrder = ZOrderNormal
+            );
+
+    /**
+     * \brief Copy constructor.
+     *
+     * This is cheap, because the data is shared.
+     */
+    Prefab(const Prefab& other) : d(other.d) {}
+
+    const Sprite& getSprite() const { return d->sprite; }
+    const Collider& getCollider() const { return d->collider; }
+    uint64_t getTags() const { return d->tags; }
+    uint16_t getZOrder() const { return d->zOrder; }
+
+    /**
+     * \brief Create a new GameObject from this Prefab.
+     *
+     * This allocates a new GameObject. For objects that are spawned and
+     * despawned often, use a PrefabPool instead.
+     *
+     * \param x x coordinate of the new object.
+     * \param y y coordinate of the new object.
+     * \return The new GameObject.
+     */
+    GameObject instantiate(float x, float y) const;
+
+    /**
+     * \brief Check if this Prefab is valid (i.e. not a null Prefab).
+     */
+    operator bool() const { return (bool) d; }
+
+    Prefab& operator=(const Prefab& other) { d = other.d; return *this; }
+
+    bool operator==(const Prefab& other) const { return d == other.d; }
+    bool operator!=(const Prefab& other) const { return d != other.d; }
+
+private:
+    std::shared_ptr<const Data> d;
+};
+
+
+/**
+ * \brief A pool of recycled GameObjects created from a single Prefab.
+ *
+ * All objects of the pool are created in advance. acquire() hands out an unused
+ * object and resets its mutable state (position, movement direction, flip
+ * direction, visibility, sprite, collider, tags and Z order) to the values of
+ * the Prefab. release() returns the object to the pool. Neither operation
+ * allocates memory, so objects like bullets can be spawned and despawned many
+ * times per second without putting pressure on the heap.
+ *
+ * Acquiring an object does not spawn it, and releasing it does not despawn it.
+ * A typical usage looks like this:
+ *
+ * \code{.cpp}
+ *      PrefabPool bulletPool(Prefab::createCircle(2, Color::RED, true, true, TagBullet), 32);
+ *
+ *      GameObject bullet = bulletPool.acquire(x, y);
+ *      if (bullet != nullptr) {
+ *          game.spawnObject(bullet);
+ *      }
+ *
+ *      // Later, e.g. when the bullet leaves the screen:
+ *      game.despawnObject(bullet);
+ *      bulletPool.release(bullet);
+ * \endcode
+ *
+ * A released object must not be used anymore, because it will be handed out
+ * again by a later call to acquire().
+ *
+ * \see Prefab
+ */
+class PrefabPool
+{
+public:
+    /**
+     * \brief Create a pool and all of its objects.
+     *
+     * \param prefab The Prefab from which objects are created.
+     * \param capacity The number of objects to create in advance.
+     * \param growable true to create additional objects when the pool runs
+     *      empty (which allocates memory), false to fail in that case.
+     */
+    PrefabPool(const Prefab& prefab, size_t capacity, bool growable = false);
+
+    PrefabPool(const PrefabPool& other) = delete;
+    ~PrefabPool();
+
+    const Prefab& getPrefab() const { return prefab; }
+
+    /**
+     * \brief Return the total number of objects owned by the pool.
+     */
+    size_t getCapacity() const { return objs.size(); }
+
+    /**
+     * \brief Return the number of objects that can currently be acquired
+     *      without growing the pool.
+     */
+    size_t getFreeCount() const { return freeObjs.size(); }
+
+    /**
+     * \brief Return the number of objects that are currently acquired.
+     */
+    size_t getUsedCount() const { return objs.size() - freeObjs.size(); }
+
+    /**
+     * \brief Take an unused object from the pool.
+     *
+     * The object is reset to the state defined by the Prefab, positioned at
+     * the given coordinates.
+     *
+     * \param x x coordinate of the object.
+     * \param y y coordinate of the object.
+     * \return The object, or a null GameObject if the pool is empty and not
+     *      growable.
+     */
+    GameObject acquire(float x, float y);
+
+    /**
+     * \brief Take an unused object from the pool.
+     *
+     * \see acquire(float, float)
+     */
+    GameObject acquire(const Vec2& pos) { return acquire(pos.x(), pos.y()); }
+
+    /**
+     * \brief Return an object to the pool.
+     *
+     * \param obj The object, previously returned by acquire().
+     * \return true if released, false if the object does not belong to this
+     *      pool or was already released.
+     */
+    bool release(const GameObject& obj);
+
+private:
+    GameObject createObject();
+
+private:
+    Prefab prefab;
+    std::vector<GameObject> objs;
+    std::vector<GameObject> freeObjs;
+    bool growable;
+};
+
+}
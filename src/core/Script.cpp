@@ -0,0 +1,224 @@
+#include "Script.h"
+
+#ifdef MINTGGGAMEENGINE_HAS_SCRIPTS
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "../input/InputEngine.h"
+#include "../util/Log.h"
+
+
+LOG_USE_TAG("Script")
+
+
+namespace MINTGGGameEngine
+{
+
+
+ScriptFramePool& ScriptFramePool::getInstance()
+{
+    static ScriptFramePool inst;
+    return inst;
+}
+
+ScriptFramePool::ScriptFramePool()
+    : mem(nullptr), freeList(nullptr), blockSize(0), blockCount(0), freeCount(0)
+{
+}
+
+bool ScriptFramePool::init(size_t blockSize, size_t blockCount)
+{
+    if (freeCount != this->blockCount) {
+        LogError("Can't re-initialize frame pool while scripts exist");
+        return false;
+    }
+
+    const size_t align = alignof(std::max_align_t);
+    blockSize = std::max(blockSize, sizeof(FreeBlock));
+    blockSize = (blockSize + align-1) / align * align;
+
+    delete[] mem;
+    mem = new (std::nothrow) uint8_t[blockSize*blockCount];
+    if (!mem) {
+        LogError("Failed to allocate script frame pool of %u bytes", (unsigned int) (blockSize*blockCount));
+        freeList = nullptr;
+        this->blockSize = 0;
+        this->blockCount = 0;
+        freeCount = 0;
+        return false;
+    }
+
+    freeList = nullptr;
+    for (size_t i = blockCount ; i > 0 ; i--) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(mem + (i-1)*blockSize);
+        block->next = freeList;
+        freeList = block;
+    }
+
+    this->blockSize = blockSize;
+    this->blockCount = blockCount;
+    freeCount = blockCount;
+
+    return true;
+}
+
+void* ScriptFramePool::allocate(size_t size)
+{
+    if (!mem) {
+        init(DefaultBlockSize, DefaultBlockCount);
+    }
+    if (size > blockSize) {
+        LogError("Script frame of %u bytes exceeds block size of %u bytes",
+                (unsigned int) size, (unsigned int) blockSize);
+        return nullptr;
+    }
+    if (!freeList) {
+        LogError("Script frame pool exhausted");
+        return nullptr;
+    }
+
+    FreeBlock* block = freeList;
+    freeList = block->next;
+    freeCount--;
+    return block;
+}
+
+void ScriptFramePool::free(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->next = freeList;
+    freeList = block;
+    freeCount++;
+}
+
+
+
+void Script::promise_type::unhandled_exception()
+{
+    LogError("Unhandled exception in script");
+    abort();
+}
+
+Script& Script::operator=(Script&& other)
+{
+    if (this != &other) {
+        if (handle) {
+            handle.destroy();
+        }
+        handle = other.release();
+    }
+    return *this;
+}
+
+
+
+ScriptScheduler::ScriptScheduler(InputEngine& input)
+    : input(input), time(0.0f), numScripts(0)
+{
+}
+
+ScriptScheduler::~ScriptScheduler()
+{
+    stopAll();
+}
+
+bool ScriptScheduler::start(Script script)
+{
+    if (!script) {
+        return false;
+    }
+    Script::Handle handle = script.release();
+    handle.promise().scheduler = this;
+    ready.push_back(handle);
+    numScripts++;
+    return true;
+}
+
+void ScriptScheduler::update(float dt)
+{
+    time += dt;
+
+    // Scripts that wait for the next frame while being resumed below end up in
+    // the (now empty) ready list, so they run in the next update.
+    running.swap(ready);
+
+    while (!timers.empty()  &&  timers.front().wakeTime <= time) {
+        std::pop_heap(timers.begin(), timers.end());
+        running.push_back(timers.back().handle);
+        timers.pop_back();
+    }
+
+    for (auto& entry : buttonWaiters) {
+        std::vector<Script::Handle>& waiters = entry.second;
+        if (!waiters.empty()  &&  input.isButtonPressedThisFrame(entry.first)) {
+            running.insert(running.end(), waiters.begin(), waiters.end());
+            waiters.clear();
+        }
+    }
+
+    for (Script::Handle handle : running) {
+        resume(handle);
+    }
+    running.clear();
+}
+
+void ScriptScheduler::stopAll()
+{
+    for (Script::Handle handle : ready) {
+        handle.destroy();
+    }
+    for (Script::Handle handle : running) {
+        handle.destroy();
+    }
+    for (const TimerEntry& entry : timers) {
+        entry.handle.destroy();
+    }
+    for (auto& entry : buttonWaiters) {
+        for (Script::Handle handle : entry.second) {
+            handle.destroy();
+        }
+    }
+
+    ready.clear();
+    running.clear();
+    timers.clear();
+    buttonWaiters.clear();
+    numScripts = 0;
+}
+
+void ScriptScheduler::waitNextFrame(Script::Handle handle)
+{
+    ready.push_back(handle);
+}
+
+void ScriptScheduler::waitSeconds(Script::Handle handle, float seconds)
+{
+    timers.push_back({ time + seconds, handle });
+    std::push_heap(timers.begin(), timers.end());
+}
+
+void ScriptScheduler::waitButtonPressed(Script::Handle handle, const std::string& id)
+{
+    // Entries are kept when they run empty, so waiting on the same button
+    // again does not allocate.
+    buttonWaiters[id].push_back(handle);
+}
+
+void ScriptScheduler::resume(Script::Handle handle)
+{
+    handle.resume();
+    if (handle.done()) {
+        handle.destroy();
+        numScripts--;
+    }
+}
+
+
+}
+
+#endif
@@ -0,0 +1,332 @@
+#pragma once
+
+#include "../Globals.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine)
+#define MINTGGGAMEENGINE_HAS_SCRIPTS
+#endif
+
+#ifdef MINTGGGAMEENGINE_HAS_SCRIPTS
+
+#include <coroutine>
+
+
+namespace MINTGGGameEngine
+{
+
+class InputEngine;
+class ScriptScheduler;
+
+
+/**
+ * \brief Fixed-size memory pool for the frames of Script coroutines.
+ *
+ * Each running Script needs a coroutine frame, which holds its local variables
+ * across suspension points. Instead of allocating these frames on the heap,
+ * they are taken from this pool, which consists of a fixed number of blocks of
+ * equal size that are allocated once.
+ *
+ * If a Script's frame is larger than the block size, or if all blocks are in
+ * use, the Script can not be created (see ScriptScheduler::start()).
+ *
+ * Use getInstance() to get the single global object of this class. If init()
+ * is not called explicitly, the pool is initialized with DefaultBlockSize and
+ * DefaultBlockCount when the first Script is created.
+ *
+ * The pool's memory is never released, because Scripts owned by global objects
+ * (e.g. the Game) might be destroyed after the pool itself.
+ */
+class ScriptFramePool
+{
+public:
+    enum
+    {
+        DefaultBlockSize = 512,
+        DefaultBlockCount = 16
+    };
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+public:
+    static ScriptFramePool& getInstance();
+
+public:
+    ScriptFramePool(const ScriptFramePool& other) = delete;
+
+    /**
+     * \brief Allocate the pool's memory.
+     *
+     * This can only be done while no Script frames are in use.
+     *
+     * \param blockSize The maximum size of a single coroutine frame, in bytes.
+     * \param blockCount The maximum number of Scripts that can exist at the
+     *      same time.
+     * \return true if successful, false otherwise.
+     */
+    bool init(size_t blockSize, size_t blockCount);
+
+    size_t getBlockSize() const { return blockSize; }
+    size_t getBlockCount() const { return blockCount; }
+    size_t getFreeCount() const { return freeCount; }
+
+    /**
+     * \brief Take a block from the pool.
+     *
+     * \param size The requested size in bytes.
+     * \return The block, or nullptr if size is too large or the pool is empty.
+     */
+    void* allocate(size_t size);
+
+    /**
+     * \brief Return a block to the pool.
+     */
+    void free(void* ptr);
+
+private:
+    ScriptFramePool();
+
+private:
+    uint8_t* mem;
+    FreeBlock* freeList;
+    size_t blockSize;
+    size_t blockCount;
+    size_t freeCount;
+};
+
+
+/**
+ * \brief A game script written as a C++20 coroutine.
+ *
+ * Sequences that span many frames (cutscenes, enemy attack patterns, menu
+ * animations, ...) can be written as straight-line code instead of a state
+ * machine inside the game loop. A script is a function returning Script, which
+ * suspends itself by awaiting one of nextFrame(), seconds() or
+ * buttonPressed():
+ *
+ * \code{.cpp}
+ *      Script blinkUntilStart(GameObject obj)
+ *      {
+ *          while (true) {
+ *              obj.setVisible(!obj.isVisible());
+ *              co_await seconds(0.5f);
+ *          }
+ *      }
+ *
+ *      game.scripts().start(blinkUntilStart(logo));
+ * \endcode
+ *
+ * A Script does nothing until it is passed to ScriptScheduler::start(), which
+ * takes ownership of it. Its frame is taken from the ScriptFramePool, so if the
+ * pool is exhausted, the Script is null.
+ *
+ * Scripts are only ever resumed by the ScriptScheduler, on the thread running
+ * the game loop. Objects of this class can be moved, but not copied.
+ */
+class Script
+{
+    friend class ScriptScheduler;
+
+public:
+    struct promise_type
+    {
+        ScriptScheduler* scheduler = nullptr;
+
+        Script get_return_object() { return Script(Handle::from_promise(*this)); }
+        static Script get_return_object_on_allocation_failure() { return Script(); }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception();
+
+        static void* operator new(size_t size) noexcept { return ScriptFramePool::getInstance().allocate(size); }
+        static void operator delete(void* ptr) { ScriptFramePool::getInstance().free(ptr); }
+    };
+
+    typedef std::coroutine_handle<promise_type> Handle;
+
+public:
+    /**
+     * \brief Create a null Script.
+     */
+    Script() {}
+
+    Script(const Script& other) = delete;
+    Script(Script&& other) : handle(other.handle) { other.handle = nullptr; }
+    ~Script() { if (handle) handle.destroy(); }
+
+    Script& operator=(const Script& other) = delete;
+    Script& operator=(Script&& other);
+
+    /**
+     * \brief Check if this Script is valid (i.e. not a null Script).
+     */
+    operator bool() const { return (bool) handle; }
+
+private:
+    explicit Script(Handle handle) : handle(handle) {}
+
+    Handle release() { Handle h = handle; handle = nullptr; return h; }
+
+private:
+    Handle handle;
+};
+
+
+/**
+ * \brief Runs Scripts, resuming each one only when its wait condition is met.
+ *
+ * Use Game.scripts() to receive the game's scheduler. DefaultEngine calls
+ * update() once per frame, after the game loop function.
+ *
+ * Waiting Scripts are kept in separate lists for each kind of wait condition:
+ * Scripts waiting for the next frame, a min-heap of Scripts waiting for a
+ * point in time, and Scripts waiting for a button, grouped by button ID. The
+ * cost of update() is therefore proportional to the number of Scripts that
+ * are actually resumed (plus one check per distinct button that is waited
+ * on), not to the number of Scripts that exist.
+ */
+class ScriptScheduler
+{
+    friend struct NextFrameAwaiter;
+    friend struct SecondsAwaiter;
+    friend struct ButtonPressedAwaiter;
+
+private:
+    struct TimerEntry
+    {
+        float wakeTime;
+        Script::Handle handle;
+
+        bool operator<(const TimerEntry& other) const { return wakeTime > other.wakeTime; }
+    };
+
+public:
+    /**
+     * \brief Create a new scheduler.
+     *
+     * Users should **not** call this method directly.
+     */
+    ScriptScheduler(InputEngine& input);
+
+    ScriptScheduler(const ScriptScheduler& other) = delete;
+    ~ScriptScheduler();
+
+    /**
+     * \brief Start running a Script.
+     *
+     * The Script will first be resumed by the next call to update().
+     *
+     * \param script The Script. The scheduler takes ownership of it.
+     * \return true if successful, false if the Script is null (e.g. because
+     *      the ScriptFramePool was exhausted).
+     */
+    bool start(Script script);
+
+    /**
+     * \brief Resume all Scripts whose wait condition is met.
+     *
+     * \param dt The time since the last call, in seconds.
+     */
+    void update(float dt);
+
+    /**
+     * \brief Destroy all Scripts.
+     *
+     * This must not be called from within a Script.
+     */
+    void stopAll();
+
+    /**
+     * \brief Return the number of Scripts that have been started and did not
+     *      finish yet.
+     */
+    size_t getScriptCount() const { return numScripts; }
+
+    /**
+     * \brief Return the time in seconds accumulated by update().
+     */
+    float getTime() const { return time; }
+
+private:
+    void waitNextFrame(Script::Handle handle);
+    void waitSeconds(Script::Handle handle, float seconds);
+    void waitButtonPressed(Script::Handle handle, const std::string& id);
+
+    void resume(Script::Handle handle);
+
+private:
+    InputEngine& input;
+
+    float time;
+    size_t numScripts;
+
+    std::vector<Script::Handle> ready;
+    std::vector<Script::Handle> running;
+    std::vector<TimerEntry> timers;
+    std::unordered_map<std::string, std::vector<Script::Handle>> buttonWaiters;
+};
+
+
+struct NextFrameAwaiter
+{
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(Script::Handle handle) { handle.promise().scheduler->waitNextFrame(handle); }
+    void await_resume() const noexcept {}
+};
+
+struct SecondsAwaiter
+{
+    float seconds;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(Script::Handle handle) { handle.promise().scheduler->waitSeconds(handle, seconds); }
+    void await_resume() const noexcept {}
+};
+
+struct ButtonPressedAwaiter
+{
+    std::string id;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(Script::Handle handle) { handle.promise().scheduler->waitButtonPressed(handle, id); }
+    void await_resume() const noexcept {}
+};
+
+
+/**
+ * \brief Suspend the current Script until the next frame.
+ */
+inline NextFrameAwaiter nextFrame() { return NextFrameAwaiter(); }
+
+/**
+ * \brief Suspend the current Script for the given time.
+ *
+ * The Script is resumed in the first frame after the time has passed.
+ *
+ * \param s The time in seconds.
+ */
+inline SecondsAwaiter seconds(float s) { return SecondsAwaiter{s}; }
+
+/**
+ * \brief Suspend the current Script until the given button is pressed.
+ *
+ * \param id The button ID.
+ * \see InputEngine::isButtonPressedThisFrame()
+ */
+inline ButtonPressedAwaiter buttonPressed(const std::string& id) { return ButtonPressedAwaiter{id}; }
+
+}
+
+#endif
@@ -0,0 +1,205 @@
+#include "BackgroundCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "../util/MathUtils.h"
+
+
+namespace MINTGGGameEngine
+{
+
+
+BackgroundCache::BackgroundCache()
+    : pixels(nullptr), camX(0), camY(0), valid(false)
+{
+}
+
+bool BackgroundCache::begin(uint16_t w, uint16_t h)
+{
+    if (ring  &&  ring.getWidth() == w  &&  ring.getHeight() == h) {
+        return true;
+    }
+    end();
+
+    pixels = static_cast<uint16_t*>(malloc(w*h*sizeof(uint16_t)));
+    if (!pixels) {
+        return false;
+    }
+    ring = Bitmap::takeOwnership(w, h, pixels);
+    return true;
+}
+
+void BackgroundCache::end()
+{
+    ring = Bitmap();
+    pixels = nullptr;
+    valid = false;
+    pending = Rect();
+}
+
+void BackgroundCache::update(int32_t camX, int32_t camY, const Color& color, const std::vector<Tilemap>& maps)
+{
+    if (!ring) {
+        return;
+    }
+
+    const int32_t w = ring.getWidth();
+    const int32_t h = ring.getHeight();
+    const int32_t dx = camX - this->camX;
+    const int32_t dy = camY - this->camY;
+    this->camX = camX;
+    this->camY = camY;
+
+    if (!valid  ||  abs(dx) >= w  ||  abs(dy) >= h) {
+        render(Rect(camX, camY, w, h), color, maps);
+        valid = true;
+        pending = Rect();
+        return;
+    }
+
+    // Only what scrolled into view. The ring wraps around, so these rows and
+    // columns overwrite exactly those that scrolled out of view.
+    if (dx > 0) {
+        render(Rect(camX+w-dx, camY, dx, h), color, maps);
+    } else if (dx < 0) {
+        render(Rect(camX, camY, -dx, h), color, maps);
+    }
+    if (dy > 0) {
+        render(Rect(camX, camY+h-dy, w, dy), color, maps);
+    } else if (dy < 0) {
+        render(Rect(camX, camY, w, -dy), color, maps);
+    }
+
+    // Changes outside the view are picked up anyway once they scroll in.
+    Rect changed = pending.intersected(Rect(camX, camY, w, h));
+    if (!changed.isEmpty()) {
+        render(changed, color, maps);
+    }
+    pending = Rect();
+}
+
+void BackgroundCache::draw(Screen& screen) const
+{
+    if (!ring) {
+        return;
+    }
+
+    // The ring's origin is somewhere on the screen, so the ring is drawn four
+    // times around it. Everything outside the screen is clipped away.
+    const int32_t w = ring.getWidth();
+    const int32_t h = ring.getHeight();
+    const int32_t ox = FloorMod(camX, w);
+    const int32_t oy = FloorMod(camY, h);
+    screen.drawBitmap(-ox, -oy, ring);
+    if (ox != 0) {
+        screen.drawBitmap(w-ox, -oy, ring);
+    }
+    if (oy != 0) {
+        screen.drawBitmap(-ox, h-oy, ring);
+        if (ox != 0) {
+            screen.drawBitmap(w-ox, h-oy, ring);
+        }
+    }
+}
+
+void BackgroundCache::render(const Rect& worldRect, const Color& color, const std::vector<Tilemap>& maps)
+{
+    const int32_t w = ring.getWidth();
+    const int32_t h = ring.getHeight();
+
+    const uint16_t bg = color.toPixel();
+    const int32_t rx = FloorMod(worldRect.x, w);
+    const int32_t n1 = std::min(worldRect.w, w-rx);
+    for (int32_t wy = worldRect.y ; wy < worldRect.getBottom() ; wy++) {
+        uint16_t* row = pixels + FloorMod(wy, h)*w;
+        std::fill(row + rx, row + rx + n1, bg);
+        std::fill(row, row + (worldRect.w-n1), bg);
+    }
+
+    for (const Tilemap& map : maps) {
+        const Tilemap::Data& md = *map.d;
+        if (!md.visible  ||  md.tiles.empty()) {
+            continue;
+        }
+
+        // Same rounding as Tilemap::draw()
+        const int32_t mx = static_cast<int32_t>(roundf(md.x));
+        const int32_t my = static_cast<int32_t>(roundf(md.y));
+        const int32_t tw = md.tileW;
+        const int32_t th = md.tileH;
+
+        const int32_t colStart = std::max<int32_t>(0, FloorDiv(worldRect.x - mx, tw));
+        const int32_t colEnd = std::min<int32_t>(md.cols, FloorDiv(worldRect.getRight()-1 - mx, tw) + 1);
+        const int32_t rowStart = std::max<int32_t>(0, FloorDiv(worldRect.y - my, th));
+        const int32_t rowEnd = std::min<int32_t>(md.rows, FloorDiv(worldRect.getBottom()-1 - my, th) + 1);
+
+        const size_t numTiles = md.tiles.size();
+        for (int32_t row = rowStart ; row < rowEnd ; row++) {
+            const size_t rowCell = static_cast<size_t>(row)*md.cols;
+            for (int32_t col = colStart ; col < colEnd ; col++) {
+                const uint16_t tile = map.getTileUnchecked(rowCell + col);
+                if (tile != Tilemap::EmptyTile  &&  tile <= numTiles) {
+                    renderTile(md.tiles[tile-1], mx + col*tw, my + row*th, worldRect);
+                }
+            }
+        }
+    }
+}
+
+void BackgroundCache::renderTile(const Bitmap& tile, int32_t tx, int32_t ty, const Rect& worldRect)
+{
+    const int32_t w = ring.getWidth();
+    const int32_t h = ring.getHeight();
+    const int32_t tileW = tile.getWidth();
+
+    const uint16_t* d = tile.getData();
+    const uint8_t* m = tile.getMask();
+    if (!d) {
+        return;
+    }
+
+    const Rect r = worldRect.intersected(Rect(tx, ty, tileW, tile.getHeight()));
+    if (r.isEmpty()) {
+        return;
+    }
+
+    const int32_t rx = FloorMod(r.x, w);
+    const int32_t n1 = std::min(r.w, w-rx);
+    const int32_t stride = tile.getStride();
+    const uint16_t maskStride = tile.getMaskStride();
+    const int32_t mo = tile.getMaskBitOffset();
+    for (int32_t wy = r.y ; wy < r.getBottom() ; wy++) {
+        uint16_t* row = pixels + FloorMod(wy, h)*w;
+        const int32_t by = wy - ty;
+        const int32_t bx = r.x - tx;
+        const uint16_t* src = d + by*stride + bx;
+        if (!m) {
+            memcpy(row + rx, src, n1*sizeof(uint16_t));
+            memcpy(row, src + n1, (r.w-n1)*sizeof(uint16_t));
+        } else if (tile.hasSpans()) {
+            size_t numSpans;
+            const uint16_t* span = tile.getSpans(by, numSpans);
+            for (; numSpans != 0 ; numSpans--, span += 2) {
+                const int32_t s = std::max<int32_t>(span[0], bx);
+                const int32_t e = std::min<int32_t>(span[0]+span[1], bx+r.w);
+                for (int32_t i = s-bx ; i < e-bx ; i++) {
+                    row[i < n1 ? rx+i : i-n1] = src[i];
+                }
+            }
+        } else {
+            const uint8_t* mrow = m + by*maskStride;
+            for (int32_t i = 0 ; i < r.w ; i++) {
+                const int32_t bit = bx+i+mo;
+                if (mrow[bit>>3] & (0x80 >> (bit&7))) {
+                    row[i < n1 ? rx+i : i-n1] = src[i];
+                }
+            }
+        }
+    }
+}
+
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "../Globals.h"
+#include "../util/Rect.h"
+#include "Bitmap.h"
+#include "Color.h"
+#include "Screen.h"
+#include "Tilemap.h"
+
+#include <vector>
+
+
+namespace MINTGGGameEngine
+{
+
+/**
+ * \brief A screen-sized cache of the background layer (background color and
+ *      tilemaps), used by Game to make scrolling cheap.
+ *
+ * The cache is a ring buffer in world coordinates: World pixel (x, y) is
+ * stored at (x mod w, y mod h). When the camera moves, only the rows and
+ * columns that scrolled into view are rendered again. Drawing the cache then
+ * takes at most four bitmap blits, i.e. up to two row copies per screen row.
+ */
+class BackgroundCache
+{
+public:
+    BackgroundCache();
+
+    /**
+     * \brief Allocate the ring buffer.
+     *
+     * \param w The width, which must be the screen width.
+     * \param h The height, which must be the screen height.
+     * \return true if successful, false if out of memory.
+     */
+    bool begin(uint16_t w, uint16_t h);
+
+    /**
+     * \brief Free the ring buffer.
+     */
+    void end();
+
+    bool isEnabled() const { return (bool) ring; }
+
+    /**
+     * \brief Render everything again on the next update().
+     */
+    void invalidate() { valid = false; }
+
+    /**
+     * \brief Render the given part of the world again on the next update().
+     *
+     * \param worldRect The area in (rounded) world coordinates.
+     */
+    void invalidate(const Rect& worldRect) { pending = pending.united(worldRect); }
+
+    /**
+     * \brief Bring the cache up to date for the given camera position.
+     *
+     * \param camX The camera x position, in whole pixels.
+     * \param camY The camera y position, in whole pixels.
+     * \param color The background color.
+     * \param maps The tilemaps to draw on top of the color.
+     */
+    void update(int32_t camX, int32_t camY, const Color& color, const std::vector<Tilemap>& maps);
+
+    /**
+     * \brief Draw the cached background on the screen.
+     *
+     * Respects the screen's clip rectangle.
+     */
+    void draw(Screen& screen) const;
+
+    size_t getMemoryUsage() const { return ring.getMemoryUsage(); }
+
+private:
+    void render(const Rect& worldRect, const Color& color, const std::vector<Tilemap>& maps);
+    void renderTile(const Bitmap& tile, int32_t tx, int32_t ty, const Rect& worldRect);
+
+private:
+    Bitmap ring;
+    uint16_t* pixels; // Writable data of ring
+
+    int32_t camX;
+    int32_t camY;
+    bool valid;
+    Rect pending;
+};
+
+}
@@ -6,6 +6,7 @@
 #include "../util/Log.h"
 #include "../util/Util.h"
 #include "ImageLoader.h"
+#include "ImageWriter.h"
 
 
 namespace MINTGGGameEngine
@@ -28,12 +29,22 @@ Bitmap Bitmap::loadBMP (
     return bmp;
 }
 
+bool Bitmap::saveBMP(const char* path, const char** outErrmsg) const
+{
+    ImageWriter iw;
+    if (!iw.saveBitmapBMP(*this, path)) {
+        if (outErrmsg) *outErrmsg = iw.getErrorMessage();
+        return false;
+    }
+    return true;
+}
+
 Bitmap Bitmap::createPlaceholder(uint16_t w, uint16_t h)
 {
     uint16_t* data = static_cast<uint16_t*>(malloc(w*h*sizeof(uint16_t)));
 
-    const uint16_t evenColor = 0xF81F;
-    const uint16_t oddColor = 0x07FF;
+    const uint16_t evenColor = Color::MAGENTA.toPixel();
+    const uint16_t oddColor = Color::CYAN.toPixel();
 
     for (uint16_t y = 0 ; y < h ; y++) {
         for (uint16_t x = 0 ; x < w ; x++) {
@@ -48,7 +59,11 @@ size_t Bitmap::getMemoryUsage() const
 {
     size_t memUsage = 0;
     if (d) {
-        memUsage += sizeof(Data);
+        memUsage += sizeof(Data) + d->spanRows.capacity()*sizeof(uint32_t) + d->spans.capacity()*sizeof(uint16_t);
+        if (d->parent) {
+            // The pixels belong to the parent
+            return memUsage;
+        }
         if (d->d) {
             memUsage += d->w*d->h*sizeof(uint16_t);
         }
@@ -56,62 +71,240 @@ size_t Bitmap::getMemoryUsage() const
             uint16_t maskByteW = (d->w+7)/8;
             memUsage += maskByteW*d->h*sizeof(uint8_t);
         }
+        if (d->a) {
+            memUsage += d->w*d->h;
+        }
     }
     return memUsage;
 }
 
-Bitmap Bitmap::scaled(int16_t factor) const
+bool Bitmap::createAlpha()
 {
-    if (!d) {
-        return Bitmap();
+    if (!d  ||  d->parent) {
+        return false;
+    }
+    if (d->a) {
+        return true;
+    }
+
+    auto a = static_cast<uint8_t*>(malloc(d->w*d->h));
+    if (!a) {
+        return false;
+    }
+    for (uint16_t y = 0 ; y < d->h ; y++) {
+        for (uint16_t x = 0 ; x < d->w ; x++) {
+            a[y*d->w + x] = (!d->m  ||  getMaskPixel(x, y)) ? 255 : 0;
+        }
+    }
+    d->a = a;
+    d->ownAlpha = true;
+    return true;
+}
+
+bool Bitmap::buildSpans()
+{
+    if (!d  ||  !d->m) {
+        return false;
+    }
+
+    const uint16_t w = d->w;
+    const uint16_t h = d->h;
+    const uint32_t off = d->maskBitOffset;
+
+    // Count first, so that both tables are allocated exactly once
+    size_t numSpans = 0;
+    for (uint16_t y = 0 ; y < h ; y++) {
+        const uint8_t* mrow = d->m + y*d->maskStride;
+        bool opaque = false;
+        for (uint32_t bit = off ; bit < off+w ; bit++) {
+            const bool set = (mrow[bit>>3] & (0x80 >> (bit&7))) != 0;
+            if (set  &&  !opaque) {
+                numSpans++;
+            }
+            opaque = set;
+        }
     }
-    
-    if (factor == 0) {
+
+    std::vector<uint32_t> spanRows;
+    std::vector<uint16_t> spans;
+    spanRows.reserve(h+1);
+    spans.reserve(numSpans*2);
+
+    for (uint16_t y = 0 ; y < h ; y++) {
+        spanRows.push_back(static_cast<uint32_t>(spans.size()));
+        const uint8_t* mrow = d->m + y*d->maskStride;
+        uint32_t bit = off;
+        while (bit < off+w) {
+            // Skip whole transparent bytes at once
+            if ((bit&7) == 0  &&  mrow[bit>>3] == 0) {
+                bit += 8;
+                continue;
+            }
+            if (!(mrow[bit>>3] & (0x80 >> (bit&7)))) {
+                bit++;
+                continue;
+            }
+            const uint32_t start = bit;
+            while (bit < off+w  &&  (mrow[bit>>3] & (0x80 >> (bit&7)))) {
+                bit++;
+            }
+            spans.push_back(static_cast<uint16_t>(start - off));
+            spans.push_back(static_cast<uint16_t>(bit - start));
+        }
+    }
+    spanRows.push_back(static_cast<uint32_t>(spans.size()));
+
+    d->spanRows = std::move(spanRows);
+    d->spans = std::move(spans);
+    return true;
+}
+
+Bitmap Bitmap::scaled(int16_t factor) const
+{
+    if (!d  ||  factor == 0) {
         return Bitmap();
     } else if (factor == 1  ||  factor == -1) {
         return *this;
     }
-    
+
     if (factor > 0) {
-        // Scale up
-        uint16_t ufactor = factor;
-        uint16_t nw = d->w * ufactor;
-        uint16_t nh = d->h * ufactor;
-        uint16_t maskByteW = (d->w+7) / 8;
-        uint16_t newMaskByteW = (nw+7) / 8;
-        auto nd = static_cast<uint16_t*>(malloc(nw*nh*sizeof(uint16_t)));
-        if (!nd) {
-            return Bitmap();
+        return scaled(d->w*factor, d->h*factor);
+    } else {
+        const uint16_t ufactor = -factor;
+        return scaled(std::max(d->w/ufactor, 1), std::max(d->h/ufactor, 1));
+    }
+}
+
+Bitmap Bitmap::scaled(uint16_t nw, uint16_t nh) const
+{
+    if (!d  ||  !d->d  ||  nw == 0  ||  nh == 0) {
+        return Bitmap();
+    }
+
+    const uint16_t newMaskByteW = (nw+7) / 8;
+    auto nd = static_cast<uint16_t*>(malloc(nw*nh*sizeof(uint16_t)));
+    if (!nd) {
+        return Bitmap();
+    }
+    auto nm = static_cast<uint8_t*>(d->m ? malloc(newMaskByteW*nh*sizeof(uint8_t)) : nullptr);
+    if (nm) {
+        memset(nm, 0, newMaskByteW*nh);
+    } else if (d->m) {
+        free(nd);
+        return Bitmap();
+    }
+    auto na = static_cast<uint8_t*>(d->a ? malloc(nw*nh) : nullptr);
+    if (d->a  &&  !na) {
+        free(nd);
+        free(nm);
+        return Bitmap();
+    }
+
+    // Nearest neighbour, stepping through the source in 16.16 fixed point.
+    // Sampling at pixel centers keeps the result symmetric.
+    const uint32_t stepX = (static_cast<uint32_t>(d->w) << 16) / nw;
+    const uint32_t stepY = (static_cast<uint32_t>(d->h) << 16) / nh;
+    uint32_t sy = stepY / 2;
+    for (uint16_t y = 0 ; y < nh ; y++, sy += stepY) {
+        const uint16_t by = sy >> 16;
+        const uint16_t* srow = d->d + by*d->stride;
+        uint16_t* drow = nd + y*nw;
+        uint32_t sx = stepX / 2;
+        for (uint16_t x = 0 ; x < nw ; x++, sx += stepX) {
+            const uint16_t bx = sx >> 16;
+            drow[x] = srow[bx];
+            if (nm  &&  getMaskPixel(bx, by)) {
+                nm[y*newMaskByteW + (x>>3)] |= (0x80 >> (x&7));
+            }
+            if (na) {
+                na[y*nw + x] = d->a[by*d->stride + bx];
+            }
         }
-        auto nm = static_cast<uint8_t*>(d->m ? malloc(newMaskByteW*nh*sizeof(uint8_t)) : nullptr);
-        if (nm) {
-            memset(nm, 0, newMaskByteW*nh);
-        } else if (d->m) {
-            free(nd);
-            return Bitmap();
+    }
+
+    Bitmap bmp = Bitmap::takeOwnership(nw, nh, nd, nm, na);
+    if (hasSpans()) {
+        bmp.buildSpans();
+    }
+    return bmp;
+}
+
+Bitmap Bitmap::cropped(uint16_t x, uint16_t y, uint16_t w, uint16_t h) const
+{
+    if (!d  ||  !d->d  ||  x >= d->w  ||  y >= d->h) {
+        return Bitmap();
+    }
+    w = std::min<uint16_t>(w, d->w-x);
+    h = std::min<uint16_t>(h, d->h-y);
+    if (w == 0  ||  h == 0) {
+        return Bitmap();
+    }
+
+    uint16_t newMaskByteW = (w+7) / 8;
+    auto nd = static_cast<uint16_t*>(malloc(w*h*sizeof(uint16_t)));
+    if (!nd) {
+        return Bitmap();
+    }
+    auto nm = static_cast<uint8_t*>(d->m ? malloc(newMaskByteW*h*sizeof(uint8_t)) : nullptr);
+    if (nm) {
+        memset(nm, 0, newMaskByteW*h);
+    } else if (d->m) {
+        free(nd);
+        return Bitmap();
+    }
+    auto na = static_cast<uint8_t*>(d->a ? malloc(w*h) : nullptr);
+    if (d->a  &&  !na) {
+        free(nd);
+        free(nm);
+        return Bitmap();
+    }
+
+    for (uint16_t ny = 0 ; ny < h ; ny++) {
+        memcpy(nd + ny*w, d->d + (y+ny)*d->stride + x, w*sizeof(uint16_t));
+        if (na) {
+            memcpy(na + ny*w, d->a + (y+ny)*d->stride + x, w);
         }
-        for (uint16_t y = 0 ; y < d->h ; y++) {
-            for (uint16_t x = 0 ; x < d->w ; x++) {
-                uint16_t pix = d->d[y*d->w + x];
-                bool msk = nm ? ((d->m[y*maskByteW + (x>>3)] << (x&7)) & 0x80) : false;
-                
-                for (uint16_t ny = y*ufactor ; ny < (y+1)*ufactor ; ny++) {
-                    for (uint16_t nx = x*ufactor ; nx < (x+1)*ufactor ; nx++) {
-                        nd[ny*nw + nx] = pix;
-                        if (msk) {
-                            nm[ny*newMaskByteW + (nx>>3)] |= (0x80 >> (nx&7));
-                        }
-                    }
+        if (nm) {
+            for (uint16_t nx = 0 ; nx < w ; nx++) {
+                if (getMaskPixel(x+nx, y+ny)) {
+                    nm[ny*newMaskByteW + (nx>>3)] |= (0x80 >> (nx&7));
                 }
             }
         }
-        return Bitmap::takeOwnership(nw, nh, nd, nm);
-    } else {
-        // Scale down
-        uint16_t ufactor = -factor;
-        // TODO: Implement
+    }
+    Bitmap bmp = Bitmap::takeOwnership(w, h, nd, nm, na);
+    if (hasSpans()) {
+        bmp.buildSpans();
+    }
+    return bmp;
+}
+
+Bitmap Bitmap::view(uint16_t x, uint16_t y, uint16_t w, uint16_t h) const
+{
+    if (!d  ||  x >= d->w  ||  y >= d->h) {
         return Bitmap();
     }
+    w = std::min<uint16_t>(w, d->w-x);
+    h = std::min<uint16_t>(h, d->h-y);
+    if (w == 0  ||  h == 0) {
+        return Bitmap();
+    }
+
+    Bitmap v;
+    v.d = std::make_shared<Data>(w, h, d->d ? d->d + y*d->stride + x : nullptr, nullptr, false,
+                                 d->a ? d->a + y*d->stride + x : nullptr);
+    v.d->stride = d->stride;
+    if (d->m) {
+        const uint32_t bit = d->maskBitOffset + x;
+        v.d->m = d->m + y*d->maskStride + (bit>>3);
+        v.d->maskStride = d->maskStride;
+        v.d->maskBitOffset = bit & 7;
+    }
+    v.d->parent = d->parent ? d->parent : d;
+    if (hasSpans()) {
+        v.buildSpans();
+    }
+    return v;
 }
 
 }
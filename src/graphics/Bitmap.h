@@ -7,6 +7,7 @@
 #include "Color.h"
 
 #include <memory>
+#include <vector>
 
 
 namespace MINTGGGameEngine
@@ -15,9 +16,20 @@ namespace MINTGGGameEngine
 /**
  * \brief Represents a two-dimensional rectangular array of color pixel values.
  *
- * This class currently stores colors in RGB565 format, from top to bottom. It
- * can also store a separate bit mask to define fully-transparent pixels (but
- * not partially-transparent ones).
+ * This class currently stores colors in RGB565 format, from top to bottom. The
+ * pixels are stored in the display's byte order (see Color::toPixel()), so
+ * raw data passed to or returned from a bitmap must be in that order, too. It
+ * can also store a separate bit mask to define fully-transparent pixels, and
+ * an optional alpha plane with an 8-bit opacity per pixel for
+ * partially-transparent ones (see getAlpha()).
+ *
+ * For masked bitmaps, the mask can additionally be stored as a list of opaque
+ * runs per row (see buildSpans()). Screens then copy these runs as a whole,
+ * instead of testing the mask for every single pixel.
+ *
+ * A bitmap can also be a view into a rectangular part of another bitmap (see
+ * view()), sharing its pixels and mask without copying. Rows of a view are
+ * therefore getStride() pixels apart, which may be more than the width.
  *
  * This class uses shared pointers, so copying is cheap. Note however that
  * bitmaps can take up a lot of RAM, which is a scarce resource on most
@@ -28,14 +40,28 @@ class Bitmap
 private:
     struct Data
     {
-        Data(uint16_t w, uint16_t h, uint16_t* d, uint8_t* m, bool own) : w(w), h(h), d(d), m(m), own(own) {}
-        ~Data() { if (own) { free(d); free(m); } }
+        Data(uint16_t w, uint16_t h, uint16_t* d, uint8_t* m, bool own, uint8_t* a = nullptr)
+                : w(w), h(h), d(d), m(m), a(a), own(own), ownAlpha(own),
+                  stride(w), maskStride((w+7)/8), maskBitOffset(0) {}
+        ~Data() { if (own) { free(d); free(m); } if (ownAlpha) { free(a); } }
         
         uint16_t w;
         uint16_t h;
         uint16_t* d;
         uint8_t* m;
+        uint8_t* a; // Alpha plane, stride bytes per row
         bool own;
+        bool ownAlpha;
+
+        uint16_t stride; // Pixels from one row of d to the next
+        uint16_t maskStride; // Bytes from one row of m to the next
+        uint8_t maskBitOffset; // Mask bit of column 0, counted from the MSB of m[0]
+        std::shared_ptr<Data> parent; // Keeps the buffers of a view alive
+
+        // Opaque runs of the mask, as (start, length) pairs. Row y's runs are
+        // spans[spanRows[y]] up to spans[spanRows[y+1]]. Empty if not built.
+        std::vector<uint32_t> spanRows;
+        std::vector<uint16_t> spans;
     };
 
 public:
@@ -52,10 +78,11 @@ public:
      * \param h The height in pixels.
      * \param d The raw RGB565 data.
      * \param m The bit mask, or null if none is used.
+     * \param a The alpha plane, or null if none is used.
      * \return The new bitmap.
      */
-    static Bitmap takeOwnership(uint16_t w, uint16_t h, uint16_t* d, uint8_t* m = nullptr)
-            { return Bitmap(w, h, d, m, true); }
+    static Bitmap takeOwnership(uint16_t w, uint16_t h, uint16_t* d, uint8_t* m = nullptr, uint8_t* a = nullptr)
+            { return Bitmap(w, h, d, m, true, a); }
 
     /**
      * \brief Create a bitmap by copying the given raw RGB565 and bitmask data.
@@ -67,9 +94,10 @@ public:
      * \param h The height in pixels.
      * \param d The raw RGB565 data.
      * \param m The bit mask, or null if none is used.
+     * \param a The alpha plane, or null if none is used.
      * \return The new bitmap.
      */
-    static Bitmap copyFrom(uint16_t w, uint16_t h, const uint16_t* d, const uint8_t* m = nullptr)
+    static Bitmap copyFrom(uint16_t w, uint16_t h, const uint16_t* d, const uint8_t* m = nullptr, const uint8_t* a = nullptr)
     {
         auto cd = static_cast<uint16_t*>(malloc(w*h*sizeof(uint16_t)));
         if (!cd) {
@@ -86,7 +114,17 @@ public:
             }
             memcpy(cm, m, maskByteW*h);
         }
-        return Bitmap(w, h, cd, cm, true);
+        uint8_t* ca = nullptr;
+        if (a) {
+            ca = static_cast<uint8_t*>(malloc(w*h));
+            if (!ca) {
+                free(cd);
+                free(cm);
+                return Bitmap();
+            }
+            memcpy(ca, a, w*h);
+        }
+        return Bitmap(w, h, cd, cm, true, ca);
     }
     
     /**
@@ -107,6 +145,18 @@ public:
 
     static Bitmap createPlaceholder(uint16_t w, uint16_t h);
 
+    /**
+     * \brief Save the bitmap to a 24-bit BMP file.
+     *
+     * The mask and alpha plane are not saved.
+     *
+     * \param path The file path.
+     * \param outErrmsg Pointer to an error message, in case saving fails. Can
+     *      be NULL if no error message is required.
+     * \return true if successful, false otherwise.
+     */
+    bool saveBMP(const char* path, const char** outErrmsg = nullptr) const;
+
     static size_t calcMaskBytesPerLine(uint16_t w) { return (w+7)/8; }
     
 public:
@@ -123,12 +173,13 @@ public:
      * \param h The height in pixels.
      * \param d The raw RGB565 data.
      * \param m The bit mask, or null if none is used.
+     * \param a The alpha plane, or null if none is used.
      * \see takeOwnership()
      * \see copyFrom()
      * \see loadBMP()
      */
-    Bitmap(uint16_t w, uint16_t h, const uint16_t* d, const uint8_t* m = nullptr)
-            : d(std::make_shared<Data>(w, h, const_cast<uint16_t*>(d), const_cast<uint8_t*>(m), false)) {}
+    Bitmap(uint16_t w, uint16_t h, const uint16_t* d, const uint8_t* m = nullptr, const uint8_t* a = nullptr)
+            : d(std::make_shared<Data>(w, h, const_cast<uint16_t*>(d), const_cast<uint8_t*>(m), false, const_cast<uint8_t*>(a))) {}
 
     /**
      * \brief Create a bitmap with uninitialized data, to be filled later.
@@ -143,8 +194,8 @@ public:
      */
     Bitmap(uint16_t w, uint16_t h, bool haveData = true, bool haveMask = false)
             : d(std::make_shared<Data>(w, h,
-                static_cast<uint16_t*>(malloc(w*h*sizeof(uint16_t))),
-                static_cast<uint8_t*>(malloc(calcMaskBytesPerLine(w)*h*sizeof(uint8_t))),
+                haveData ? static_cast<uint16_t*>(malloc(w*h*sizeof(uint16_t))) : nullptr,
+                haveMask ? static_cast<uint8_t*>(malloc(calcMaskBytesPerLine(w)*h*sizeof(uint8_t))) : nullptr,
                 true
                 )) {}
     
@@ -173,51 +224,161 @@ public:
     uint16_t getHeight() const { return d ? d->h : 0; }
     
     /**
-     * \brief Return the raw RGB565 data.
+     * \brief Return the raw RGB565 data, in pixel order (see Color::toPixel()).
+     *
+     * Rows are getStride() pixels apart.
      */
     const uint16_t* getData() const { return d ? d->d : nullptr; }
     
     /**
      * \brief Return the raw bit mask.
+     *
+     * Rows are getMaskStride() bytes apart. The bit of column x is bit
+     * (x + getMaskBitOffset()) of the row, counted from the MSB of its first
+     * byte.
      */
     const uint8_t* getMask() const { return d ? d->m : nullptr; }
 
+    /**
+     * \brief Return the alpha plane, or null if the bitmap has none.
+     *
+     * The alpha plane holds one byte per pixel, from 0 (fully transparent) to
+     * 255 (opaque). Rows are getStride() bytes apart. It is only used by
+     * Screen::drawBitmapBlended(). Pixels that are masked out are never drawn,
+     * regardless of their alpha.
+     *
+     * 32-bit BMP files with partially-transparent pixels get an alpha plane
+     * automatically. Use createAlpha() to add one in code.
+     */
+    const uint8_t* getAlpha() const { return d ? d->a : nullptr; }
+
+    /**
+     * \brief Return the distance between two rows of getData(), in pixels.
+     *
+     * This is the width, unless the bitmap is a view. The same applies to the
+     * rows of getAlpha(), in bytes.
+     */
+    uint16_t getStride() const { return d ? d->stride : 0; }
+
+    /**
+     * \brief Return the distance between two rows of getMask(), in bytes.
+     */
+    uint16_t getMaskStride() const { return d ? d->maskStride : 0; }
+
+    /**
+     * \brief Return the bit of getMask() that holds column 0 of each row.
+     */
+    uint8_t getMaskBitOffset() const { return d ? d->maskBitOffset : 0; }
+
+    /**
+     * \brief Check if this bitmap is a view into another bitmap.
+     */
+    bool isView() const { return d  &&  d->parent; }
+
     size_t getMemoryUsage() const;
     
     ///@}
 
 
+    /// \name Opaque Spans
+    ///@{
+
+    /**
+     * \brief Build the list of opaque runs from the mask.
+     *
+     * Masked bitmaps with spans are drawn a whole run at a time, which is a lot
+     * faster than testing every pixel's mask bit. Bitmaps loaded from BMP
+     * files get their spans automatically. Bitmaps built in code should call
+     * this once their mask is complete, and again after changing the mask
+     * through getMask(). setMaskPixel() drops the spans.
+     *
+     * The spans take 4 bytes per run, i.e. usually a few bytes per row.
+     *
+     * \return true if successful, false if there is no mask or not enough
+     *      memory.
+     */
+    bool buildSpans();
+
+    /**
+     * \brief Check if the opaque runs of the mask have been built.
+     */
+    bool hasSpans() const { return d  &&  !d->spanRows.empty(); }
+
+    /**
+     * \brief Return the opaque runs of a row.
+     *
+     * Requires hasSpans().
+     *
+     * \param y The row.
+     * \param outNumSpans Receives the number of runs.
+     * \return The runs, as (start column, length) pairs, sorted from left to
+     *      right.
+     */
+    const uint16_t* getSpans(uint16_t y, size_t& outNumSpans) const
+    {
+        const uint32_t first = d->spanRows[y];
+        outNumSpans = (d->spanRows[y+1] - first) / 2;
+        return d->spans.data() + first;
+    }
+
+    /**
+     * \brief Add an alpha plane to a bitmap that has none.
+     *
+     * All pixels start out fully opaque, except for those that are masked
+     * out. Views can't get an alpha plane of their own. Create it on the
+     * original bitmap before creating any views instead.
+     *
+     * \return true if the bitmap has an alpha plane now, false if there is
+     *      not enough memory or the bitmap is a view.
+     */
+    bool createAlpha();
+
+    ///@}
+
+
     /// \name Pixel Access
     ///@{
 
     uint16_t getPixelRaw(uint16_t x, uint16_t y) const
-            { return d  &&  d->d ? d->d[y*d->w+x] : 0; }
+            { return d  &&  d->d ? d->d[y*d->stride+x] : 0; }
 
-    Color getPixel(uint16_t x, uint16_t y) const { return Color(getPixelRaw(x, y)); }
+    Color getPixel(uint16_t x, uint16_t y) const { return Color::fromPixel(getPixelRaw(x, y)); }
 
     bool getMaskPixel(uint16_t x, uint16_t y) const
     {
         if (!d  ||  !d->m) return false;
-        uint16_t maskByteW = (d->w+7)/8;
-        return (d->m[y*maskByteW + (x>>3)] & (0x80 >> (x&7))) != 0;
+        const uint32_t bit = x + d->maskBitOffset;
+        return (d->m[y*d->maskStride + (bit>>3)] & (0x80 >> (bit&7))) != 0;
     }
 
     void setPixel(uint16_t x, uint16_t y, const Color& color)
     {
         if (!d  ||  !d->d) return;
-        d->d[x*d->w+x] = color.toRGB565();
+        d->d[y*d->stride+x] = color.toPixel();
+    }
+
+    uint8_t getAlphaPixel(uint16_t x, uint16_t y) const
+            { return d  &&  d->a ? d->a[y*d->stride+x] : 255; }
+
+    void setAlphaPixel(uint16_t x, uint16_t y, uint8_t alpha)
+    {
+        if (!d  ||  !d->a) return;
+        d->a[y*d->stride+x] = alpha;
     }
 
     void setMaskPixel(uint16_t x, uint16_t y, bool set) const
     {
         if (!d  ||  !d->m) return;
-        uint16_t maskByteW = (d->w+7)/8;
+        if (!d->spanRows.empty()) {
+            d->spanRows = std::vector<uint32_t>();
+            d->spans = std::vector<uint16_t>();
+        }
+        const uint32_t bit = x + d->maskBitOffset;
         if (set) {
-            d->m[y*maskByteW + (x>>3)] |= (0x80 >> (x&7));
+            d->m[y*d->maskStride + (bit>>3)] |= (0x80 >> (bit&7));
         } else {
-            d->m[y*maskByteW + (x>>3)] &= ~(0x80 >> (x&7));
+            d->m[y*d->maskStride + (bit>>3)] &= ~(0x80 >> (bit&7));
         }
-        //return (d->m[y*maskByteW + (x>>3)] & (0x80 >> (x&7))) != 0;
     }
 
     ///@}
@@ -229,16 +390,63 @@ public:
     /**
      * \brief Return a scaled-up or scaled-down version of this bitmap.
      *
-     * Only scaling by integer multiples is supported. Currently, downscaling
-     * is not supported at all and will simply return the original bitmap
-     * unchanged.
+     * Only scaling by integer multiples is supported here. See
+     * scaled(uint16_t, uint16_t) for arbitrary sizes. To draw a bitmap scaled
+     * without a copy, use Screen::drawBitmapTransformed().
      *
      * \param factor The scale factor. A factor of 1 or -1 yields the original
      *      image. Higher values scale up the image. Negative values scale down
      *      the image by the absolute value of the factor.
-     * \return The scaled bitmap.
+     * \return The scaled bitmap, or an invalid bitmap for a factor of 0.
      */
     Bitmap scaled(int16_t factor) const;
+
+    /**
+     * \brief Return a copy of this bitmap scaled to the given size.
+     *
+     * Pixels are picked by nearest neighbour, without any filtering. If this
+     * bitmap has a mask or alpha plane, they are scaled as well.
+     *
+     * \param w The new width.
+     * \param h The new height.
+     * \return The scaled bitmap, or an invalid bitmap if the size is 0 or
+     *      there is not enough memory.
+     */
+    Bitmap scaled(uint16_t w, uint16_t h) const;
+
+    /**
+     * \brief Return a copy of a rectangular part of this bitmap.
+     *
+     * The rectangle is clipped to the bitmap. If this bitmap has a mask or
+     * alpha plane, they are copied as well.
+     *
+     * \param x The left edge of the part.
+     * \param y The top edge of the part.
+     * \param w The width of the part.
+     * \param h The height of the part.
+     * \return The copy, or an invalid bitmap if the part is empty or there is
+     *      not enough memory.
+     */
+    Bitmap cropped(uint16_t x, uint16_t y, uint16_t w, uint16_t h) const;
+
+    /**
+     * \brief Return a view into a rectangular part of this bitmap.
+     *
+     * Unlike cropped(), no pixels are copied: The view shares the pixels, mask
+     * and alpha plane of this bitmap, so changes to one are visible in the other. The
+     * view keeps the shared data alive on its own, so this bitmap does not
+     * need to be kept around.
+     *
+     * If this bitmap has spans (see buildSpans()), the view gets its own.
+     *
+     * \param x The left edge of the part.
+     * \param y The top edge of the part.
+     * \param w The width of the part.
+     * \param h The height of the part.
+     * \return The view, or an invalid bitmap if the part is empty. The
+     *      rectangle is clipped to the bitmap.
+     */
+    Bitmap view(uint16_t x, uint16_t y, uint16_t w, uint16_t h) const;
     
     ///@}
     
@@ -259,8 +467,8 @@ public:
     ///@}
 
 private:
-    Bitmap(uint16_t w, uint16_t h, uint16_t* d, uint8_t* m, bool own)
-        : d(std::make_shared<Data>(w, h, d, m, own)) {}
+    Bitmap(uint16_t w, uint16_t h, uint16_t* d, uint8_t* m, bool own, uint8_t* a = nullptr)
+        : d(std::make_shared<Data>(w, h, d, m, own, a)) {}
 
 private:
     std::shared_ptr<Data> d;
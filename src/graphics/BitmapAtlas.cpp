@@ -0,0 +1,96 @@
+#include "BitmapAtlas.h"
+
+#include <cstring>
+
+
+namespace MINTGGGameEngine
+{
+
+
+BitmapAtlas BitmapAtlas::loadBMP(const char* path, const char** outErrmsg)
+{
+    Bitmap sheet = Bitmap::loadBMP(path, 0, 0, UINT16_MAX, UINT16_MAX, outErrmsg);
+    if (!sheet) {
+        return BitmapAtlas();
+    }
+    return BitmapAtlas(sheet);
+}
+
+BitmapAtlas::BitmapAtlas(const Bitmap& sheet)
+    : d(std::make_shared<Data>())
+{
+    d->sheet = sheet;
+}
+
+Bitmap BitmapAtlas::addRegion(const char* name, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    if (!d) {
+        return Bitmap();
+    }
+    Bitmap region = d->sheet.view(x, y, w, h);
+    if (region) {
+        d->regions.emplace_back(name, region);
+    }
+    return region;
+}
+
+size_t BitmapAtlas::addRegions(const Region* regions, size_t numRegions)
+{
+    size_t numAdded = 0;
+    for (size_t i = 0 ; i < numRegions ; i++) {
+        const Region& r = regions[i];
+        if (addRegion(r.name, r.x, r.y, r.w, r.h)) {
+            numAdded++;
+        }
+    }
+    return numAdded;
+}
+
+size_t BitmapAtlas::addGrid (
+    const char* prefix,
+    uint16_t x, uint16_t y,
+    uint16_t cellW, uint16_t cellH,
+    uint16_t cols, uint16_t rows
+) {
+    size_t numAdded = 0;
+    std::string name(prefix);
+    const size_t prefixLen = name.length();
+    for (uint16_t row = 0 ; row < rows ; row++) {
+        for (uint16_t col = 0 ; col < cols ; col++) {
+            name.resize(prefixLen);
+            name += std::to_string(static_cast<unsigned int>(row)*cols + col);
+            if (addRegion(name.c_str(), x + col*cellW, y + row*cellH, cellW, cellH)) {
+                numAdded++;
+            }
+        }
+    }
+    return numAdded;
+}
+
+Bitmap BitmapAtlas::get(const char* name) const
+{
+    if (!d) {
+        return Bitmap();
+    }
+    for (const auto& region : d->regions) {
+        if (strcmp(region.first.c_str(), name) == 0) {
+            return region.second;
+        }
+    }
+    return Bitmap();
+}
+
+size_t BitmapAtlas::getMemoryUsage() const
+{
+    size_t memUsage = 0;
+    if (d) {
+        memUsage += sizeof(Data) + d->sheet.getMemoryUsage();
+        for (const auto& region : d->regions) {
+            memUsage += sizeof(region) + region.first.capacity() + region.second.getMemoryUsage();
+        }
+    }
+    return memUsage;
+}
+
+
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "../Globals.h"
+#include "Bitmap.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace MINTGGGameEngine
+{
+
+/**
+ * \brief A sprite sheet that hands out named parts of a single bitmap.
+ *
+ * The sheet is loaded with a single allocation and a single pass over the
+ * file. Its parts (regions) are views into the sheet (see Bitmap::view()), so
+ * no pixels are copied, no matter how many regions there are:
+ *
+ * \code{.cpp}
+ *      static const BitmapAtlas::Region regions[] = {
+ *          {"player", 0, 0, 16, 16},
+ *          {"enemy", 16, 0, 16, 16},
+ *          {"coin", 32, 0, 8, 8}
+ *      };
+ *      BitmapAtlas atlas = BitmapAtlas::loadBMP("/spiffs/sheet.bmp");
+ *      atlas.addRegions(regions, 3);
+ *      GameObject player = GameObject::createBitmap(0, 0, atlas.get("player"));
+ * \endcode
+ *
+ * Looking up a region by name is a linear search, so it should be done once
+ * while setting up the game, not every frame.
+ *
+ * This class uses shared pointers, so copying is cheap.
+ */
+class BitmapAtlas
+{
+public:
+    /**
+     * \brief A named rectangle in the sheet, e.g. for static region tables.
+     */
+    struct Region
+    {
+        const char* name;
+        uint16_t x;
+        uint16_t y;
+        uint16_t w;
+        uint16_t h;
+    };
+
+private:
+    struct Data
+    {
+        Bitmap sheet;
+        std::vector<std::pair<std::string, Bitmap>> regions;
+    };
+
+public:
+    /**
+     * \brief Load the sheet from a BMP file.
+     *
+     * \param path The file path.
+     * \param outErrmsg Receives an error message if loading fails. Can be null.
+     * \return The atlas, without any regions yet, or an invalid atlas on error.
+     */
+    static BitmapAtlas loadBMP(const char* path, const char** outErrmsg = nullptr);
+
+public:
+    /**
+     * \brief Create an invalid atlas.
+     */
+    BitmapAtlas() {}
+
+    /**
+     * \brief Create an atlas from an existing sheet, without copying.
+     */
+    explicit BitmapAtlas(const Bitmap& sheet);
+
+    BitmapAtlas(const BitmapAtlas& other) : d(other.d) {}
+
+    Bitmap getSheet() const { return d ? d->sheet : Bitmap(); }
+
+    /**
+     * \brief Add a named region.
+     *
+     * \return The view of the region, or an invalid bitmap if it is outside
+     *      the sheet.
+     */
+    Bitmap addRegion(const char* name, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+
+    /**
+     * \brief Add multiple named regions at once.
+     *
+     * \return The number of regions that were inside the sheet.
+     */
+    size_t addRegions(const Region* regions, size_t numRegions);
+
+    /**
+     * \brief Add a grid of equally-sized regions, named by appending their
+     *      index to a prefix.
+     *
+     * The regions are numbered from left to right and top to bottom, starting
+     * at 0, e.g. "walk0", "walk1", ... for the prefix "walk".
+     *
+     * \param prefix The name prefix.
+     * \param x The left edge of the grid.
+     * \param y The top edge of the grid.
+     * \param cellW The width of each region.
+     * \param cellH The height of each region.
+     * \param cols The number of regions per row.
+     * \param rows The number of rows.
+     * \return The number of regions added.
+     */
+    size_t addGrid (
+        const char* prefix,
+        uint16_t x, uint16_t y,
+        uint16_t cellW, uint16_t cellH,
+        uint16_t cols, uint16_t rows
+        );
+
+    /**
+     * \brief Return the view of a region, or an invalid bitmap if there is
+     *      no region with that name.
+     */
+    Bitmap get(const char* name) const;
+
+    size_t getRegionCount() const { return d ? d->regions.size() : 0; }
+
+    /**
+     * \brief Return the memory used by the sheet and all regions.
+     */
+    size_t getMemoryUsage() const;
+
+    /**
+     * \brief Check if the atlas is valid.
+     */
+    operator bool() const { return d  &&  d->sheet; }
+
+    BitmapAtlas& operator=(const BitmapAtlas& other) { d = other.d; return *this; }
+
+private:
+    std::shared_ptr<Data> d;
+};
+
+}
@@ -11,6 +11,10 @@ namespace MINTGGGameEngine
  *
  * This class currently uses RGB565 format internally, but provides some helpers
  * for converting to and from RGB888.
+ *
+ * Frame buffers and bitmaps store pixels in the byte order of the display,
+ * which may differ from the native RGB565 values. Use toPixel() and
+ * fromPixel() to convert between the two.
  */
 class Color
 {
@@ -64,6 +68,70 @@ public:
      */
     operator uint16_t() const { return toRGB565(); }
 
+    /**
+     * \brief Return the color as a pixel value for frame buffers and bitmaps.
+     *
+     * This is the RGB565 value, byte-swapped if pixels are stored in the
+     * display's big-endian order (MINTGGGAMEENGINE_PIXELS_SWAPPED).
+     */
+    uint16_t toPixel() const
+    {
+#ifdef MINTGGGAMEENGINE_PIXELS_SWAPPED
+        return __builtin_bswap16(rgb565);
+#else
+        return rgb565;
+#endif
+    }
+
+    /**
+     * \brief Create color from a pixel value of a frame buffer or bitmap.
+     *
+     * \see toPixel()
+     */
+    static Color fromPixel(uint16_t pixel)
+    {
+#ifdef MINTGGGAMEENGINE_PIXELS_SWAPPED
+        return Color(static_cast<uint16_t>(__builtin_bswap16(pixel)));
+#else
+        return Color(pixel);
+#endif
+    }
+
+    /**
+     * \brief Blend two pixel values (see toPixel()).
+     *
+     * All three channels are blended with a single multiplication: The RGB565
+     * value is spread over a 32-bit word (green in the upper half, red and blue
+     * in the lower one), so that each channel has room for its product.
+     *
+     * \param dst The background pixel.
+     * \param src The foreground pixel.
+     * \param alpha The opacity of src, from 0 (dst) to 32 (src).
+     * \see toBlendAlpha()
+     */
+    static uint16_t blendPixels(uint16_t dst, uint16_t src, uint8_t alpha)
+    {
+#ifdef MINTGGGAMEENGINE_PIXELS_SWAPPED
+        dst = __builtin_bswap16(dst);
+        src = __builtin_bswap16(src);
+#endif
+        const uint32_t d = (dst | (static_cast<uint32_t>(dst) << 16)) & 0x07E0F81F;
+        const uint32_t s = (src | (static_cast<uint32_t>(src) << 16)) & 0x07E0F81F;
+        const uint32_t r = ((((s - d) * alpha) >> 5) + d) & 0x07E0F81F;
+        const uint16_t res = static_cast<uint16_t>(r | (r >> 16));
+#ifdef MINTGGGAMEENGINE_PIXELS_SWAPPED
+        return __builtin_bswap16(res);
+#else
+        return res;
+#endif
+    }
+
+    /**
+     * \brief Convert an 8-bit alpha value (0 to 255) to the 0 to 32 range of
+     *      blendPixels().
+     */
+    static uint8_t toBlendAlpha(uint8_t alpha) { return (alpha + 4) >> 3; }
+
     Color & operator=(const Color &other)
     {
         if (this == &other)
@@ -1,8 +1,10 @@
 #include "Font.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "../util/Util.h"
+#include "GlyphCache.h"
 #include "util/Log.h"
 
 
@@ -1156,7 +1158,7 @@ Font Font::loadFONTX2 (
     bool* ok,
     const char** outErrmsg
 ) {
-    if (fullSize < 16) {
+    if (fullSize < 17) {
         // We don't even have a full header
         if (outErrmsg) *outErrmsg = "premature end of file";
         if (ok) *ok = false;
@@ -1181,15 +1183,16 @@ Font Font::loadFONTX2 (
 
         const size_t blockSize = 256*glyphSize;
 
-        if (fullSize < 16+blockSize) {
+        if (fullSize < 17+blockSize) {
             if (outErrmsg) *outErrmsg = "premature end of file";
             if (ok) *ok = false;
             return {};
         }
     } else {
-        // Double-byte format
+        // Double-byte format: The table of code blocks, followed by the
+        // glyphs of all blocks
 
-        if (fullSize < 17) {
+        if (fullSize < 18) {
             if (outErrmsg) *outErrmsg = "premature end of file";
             if (ok) *ok = false;
             return {};
@@ -1197,37 +1200,47 @@ Font Font::loadFONTX2 (
 
         const uint8_t numCodeBlocks = rawData[17];
 
-        const uint8_t* blockPtr = rawData+17;
-        size_t sizeLeft = fullSize-17;
+        if (fullSize < 18 + numCodeBlocks*4u) {
+            if (outErrmsg) *outErrmsg = "premature end of file";
+            if (ok) *ok = false;
+            return {};
+        }
 
+        size_t numGlyphs = 0;
         for (uint8_t i = 0 ; i < numCodeBlocks ; i++) {
-            if (sizeLeft < 4) {
-                if (outErrmsg) *outErrmsg = "premature end of file";
-                if (ok) *ok = false;
-                return {};
-            }
-
-            const uint16_t firstCP = FromLittleEndian(*reinterpret_cast<const uint16_t*>(blockPtr));
-            const uint16_t lastCP = FromLittleEndian(*reinterpret_cast<const uint16_t*>(blockPtr+2));
-            const size_t blockSize = (lastCP-firstCP+1)*glyphSize;
-
-            if (sizeLeft < 4+blockSize) {
-                if (outErrmsg) *outErrmsg = "premature end of file";
+            const uint8_t* blockPtr = rawData + 18 + i*4;
+            const uint16_t firstCP = blockPtr[0] | (blockPtr[1] << 8);
+            const uint16_t lastCP = blockPtr[2] | (blockPtr[3] << 8);
+            if (lastCP < firstCP) {
+                if (outErrmsg) *outErrmsg = "invalid code block";
                 if (ok) *ok = false;
                 return {};
             }
+            numGlyphs += lastCP-firstCP+1;
+        }
 
-            sizeLeft -= 4+blockSize;
-            blockPtr += 4+blockSize;
+        if (fullSize < 18 + numCodeBlocks*4 + numGlyphs*glyphSize) {
+            if (outErrmsg) *outErrmsg = "premature end of file";
+            if (ok) *ok = false;
+            return {};
         }
     }
 
-    *ok = true;
+    if (ok) *ok = true;
     return Font(rawData, bufOwned);
 }
 
 
 
+Font::Data::~Data()
+{
+    if (bufOwned) {
+        // Cached glyphs are identified by their address in rawData
+        GlyphCache::getInstance().clear();
+        free(const_cast<uint8_t*>(rawData));
+    }
+}
+
 Font::Font(const std::string_view& name)
 {
     auto it = fontRegistry.find(std::string(name));
@@ -1248,6 +1261,27 @@ Font::Font(const uint8_t* rawData, bool bufOwned) : d(std::make_shared<Data>(raw
     const char* namePtr = reinterpret_cast<const char*>(d->rawData + 6);
     const char* nptr = static_cast<const char*>(memchr(namePtr, '\0', 8));
     d->name = nptr ? std::string(namePtr, (nptr-namePtr)) : std::string(namePtr, 8);
+
+    if (d->rawData[16] != 0) {
+        // Index the code blocks once, so that looking up a glyph is a binary
+        // search instead of a walk over all blocks
+        const uint8_t numCbs = d->rawData[17];
+        const size_t glyphSize = getGlyphSize();
+        const uint8_t* glyphs = d->rawData + 18 + numCbs*4;
+        d->blocks.reserve(numCbs);
+        for (uint8_t i = 0 ; i < numCbs ; i++) {
+            const uint8_t* blockPtr = d->rawData + 18 + i*4;
+            CodeBlock cb;
+            cb.firstCP = blockPtr[0] | (blockPtr[1] << 8);
+            cb.lastCP = blockPtr[2] | (blockPtr[3] << 8);
+            cb.glyphs = glyphs;
+            d->blocks.push_back(cb);
+            glyphs += (cb.lastCP-cb.firstCP+1)*glyphSize;
+        }
+        std::sort(d->blocks.begin(), d->blocks.end(), [](const CodeBlock& a, const CodeBlock& b) {
+            return a.firstCP < b.firstCP;
+        });
+    }
 }
 
 std::string Font::getName() const
@@ -1284,19 +1318,16 @@ const uint8_t* Font::getGlyphBuffer(uint16_t cp) const
         }
         return d->rawData + 17 + cp*getGlyphSize();
     } else {
-        // Double byte format
-        const uint8_t numCbs = d->rawData[17];
-        const size_t glyphSize = getGlyphSize();
-
-        const uint8_t* blockPtr = d->rawData + 18;
-
-        for (uint8_t i = 0 ; i < numCbs ; i++) {
-            const uint16_t firstCP = FromLittleEndian(*reinterpret_cast<const uint16_t*>(blockPtr));
-            const uint16_t lastCP = FromLittleEndian(*reinterpret_cast<const uint16_t*>(blockPtr+2));
-            if (cp >= firstCP  &&  cp <= lastCP) {
-                return blockPtr + 4 + (cp-firstCP)*glyphSize;
-            }
-            blockPtr += (lastCP-firstCP+1)*glyphSize;
+        // Double byte format: Find the last block starting at or before cp
+        auto it = std::upper_bound(d->blocks.begin(), d->blocks.end(), cp, [](uint16_t cp, const CodeBlock& cb) {
+            return cp < cb.firstCP;
+        });
+        if (it == d->blocks.begin()) {
+            return nullptr;
+        }
+        --it;
+        if (cp <= it->lastCP) {
+            return it->glyphs + (cp-it->firstCP)*getGlyphSize();
         }
 
         return nullptr;
@@ -5,6 +5,7 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "../storage/Reader.h"
 
@@ -42,15 +43,24 @@ private:
         );
 
 private:
+    struct CodeBlock
+    {
+        uint16_t firstCP;
+        uint16_t lastCP;
+        const uint8_t* glyphs;
+    };
+
     struct Data
     {
         Data(const uint8_t* rawData, bool bufOwned) : rawData(rawData), bufOwned(bufOwned) {}
-        ~Data() { if (bufOwned) free(const_cast<uint8_t*>(rawData)); }
+        ~Data();
 
         const uint8_t* rawData;
         bool bufOwned;
 
         std::string name;
+
+        std::vector<CodeBlock> blocks; // Double-byte format only, sorted by firstCP
     };
 
 public:
@@ -66,6 +76,11 @@ public:
 
     size_t getGlyphSize() const;
 
+    /**
+     * \brief Return the bitmap of a glyph, or null if the font doesn't have it.
+     *
+     * For double-byte fonts, the code block is found by binary search.
+     */
     const uint8_t* getGlyphBuffer(uint16_t cp) const;
 
 private:
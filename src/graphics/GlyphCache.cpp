@@ -0,0 +1,131 @@
+#include "GlyphCache.h"
+
+#include <cstring>
+
+
+namespace MINTGGGameEngine
+{
+
+
+GlyphCache& GlyphCache::getInstance()
+{
+    // Never destroyed, because fonts owned by global objects (e.g. the font
+    // registry) might clear it while being destroyed.
+    static GlyphCache* inst = new GlyphCache;
+    return *inst;
+}
+
+GlyphCache::GlyphCache()
+    : maxBytes(DefaultMaxBytes), usedBytes(0)
+{
+}
+
+bool GlyphCache::get(const uint8_t* glyph, uint8_t w, uint8_t h, const Run*& runs, size_t& numRuns)
+{
+    if (!glyph  ||  maxBytes == 0) {
+        return false;
+    }
+
+    auto it = index.find(glyph);
+    if (it != index.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+        runs = it->second->runs.data();
+        numRuns = it->second->runs.size();
+        return true;
+    }
+
+    Entry e;
+    e.glyph = glyph;
+    rasterize(glyph, w, h, e.runs);
+    e.runs.shrink_to_fit();
+
+    const size_t bytes = calcEntryBytes(e);
+    if (bytes > maxBytes) {
+        return false;
+    }
+    evict(maxBytes - bytes);
+
+    lru.push_front(std::move(e));
+    index[glyph] = lru.begin();
+    usedBytes += bytes;
+
+    runs = lru.front().runs.data();
+    numRuns = lru.front().runs.size();
+    return true;
+}
+
+void GlyphCache::clear()
+{
+    index.clear();
+    lru.clear();
+    usedBytes = 0;
+}
+
+void GlyphCache::setMaxBytes(size_t maxBytes)
+{
+    this->maxBytes = maxBytes;
+    evict(maxBytes);
+}
+
+void GlyphCache::rasterize(const uint8_t* glyph, uint8_t w, uint8_t h, std::vector<Run>& runs)
+{
+    const uint8_t byteW = (w+7) / 8;
+
+    // Indices of the rectangles that reach down to the previous row, i.e. the
+    // ones that can be extended by an equal run in the current row. A row has
+    // at most 128 runs.
+    uint16_t open[128];
+    uint16_t nextOpen[128];
+    size_t numOpen = 0;
+
+    for (uint8_t y = 0 ; y < h ; y++) {
+        const uint8_t* row = glyph + y*byteW;
+        size_t numNextOpen = 0;
+
+        uint8_t x = 0;
+        while (x < w) {
+            if (!(row[x>>3] & (0x80 >> (x&7)))) {
+                x++;
+                continue;
+            }
+            const uint8_t start = x;
+            while (x < w  &&  (row[x>>3] & (0x80 >> (x&7)))) {
+                x++;
+            }
+            const uint8_t len = x - start;
+
+            size_t i = 0;
+            while (i < numOpen  &&  (runs[open[i]].x != start  ||  runs[open[i]].w != len)) {
+                i++;
+            }
+            if (i < numOpen) {
+                runs[open[i]].h++;
+                nextOpen[numNextOpen++] = open[i];
+            } else {
+                nextOpen[numNextOpen++] = static_cast<uint16_t>(runs.size());
+                runs.push_back({ start, y, len, 1 });
+            }
+        }
+
+        memcpy(open, nextOpen, numNextOpen*sizeof(open[0]));
+        numOpen = numNextOpen;
+    }
+}
+
+size_t GlyphCache::calcEntryBytes(const Entry& e)
+{
+    // The list node and the index's hash node cost about two pointers each
+    return sizeof(Entry) + 4*sizeof(void*) + e.runs.capacity()*sizeof(Run);
+}
+
+void GlyphCache::evict(size_t maxBytes)
+{
+    while (usedBytes > maxBytes  &&  !lru.empty()) {
+        usedBytes -= calcEntryBytes(lru.back());
+        index.erase(lru.back().glyph);
+        lru.pop_back();
+    }
+}
+
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "../Globals.h"
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+
+namespace MINTGGGameEngine
+{
+
+/**
+ * \brief A cache of font glyphs, pre-rasterized into rectangles.
+ *
+ * Font glyphs are stored as 1-bit bitmaps, so drawing one directly means
+ * testing every bit. Instead, each glyph is converted once into a list of
+ * rectangles covering its set pixels: Runs of set pixels in a row become
+ * rectangles, and equal runs in consecutive rows are merged into one. A glyph
+ * can then be drawn with a few filled rectangles, i.e. row spans on screens
+ * with a frame buffer.
+ *
+ * The rectangles are in unscaled glyph pixels, so one entry is used for all
+ * scale factors.
+ *
+ * The cache is bounded by its memory usage (see setMaxBytes()). When it is
+ * full, the glyphs that were used least recently are dropped.
+ *
+ * Use getInstance() to get the single global object of this class.
+ */
+class GlyphCache
+{
+public:
+    enum
+    {
+        DefaultMaxBytes = 4096
+    };
+
+    /**
+     * \brief A rectangle of set glyph pixels.
+     */
+    struct Run
+    {
+        uint8_t x;
+        uint8_t y;
+        uint8_t w;
+        uint8_t h;
+    };
+
+private:
+    struct Entry
+    {
+        const uint8_t* glyph;
+        std::vector<Run> runs;
+    };
+
+public:
+    static GlyphCache& getInstance();
+
+public:
+    GlyphCache(const GlyphCache& other) = delete;
+
+    /**
+     * \brief Return the rectangles of a glyph, rasterizing it if it's not
+     *      cached yet.
+     *
+     * The rectangles are valid until the next call to get() or clear().
+     *
+     * \param glyph The glyph's bitmap, as returned by Font::getGlyphBuffer().
+     *      Glyphs are identified by this pointer.
+     * \param w The glyph width.
+     * \param h The glyph height.
+     * \param runs Receives the rectangles.
+     * \param numRuns Receives the number of rectangles.
+     * \return true if successful, false if the cache is disabled or the glyph
+     *      doesn't fit into it.
+     */
+    bool get(const uint8_t* glyph, uint8_t w, uint8_t h, const Run*& runs, size_t& numRuns);
+
+    /**
+     * \brief Drop all glyphs.
+     *
+     * This must be called when a font's data is freed, because glyphs are
+     * identified by their address.
+     */
+    void clear();
+
+    /**
+     * \brief Set the maximum memory usage, dropping glyphs if necessary.
+     *
+     * \param maxBytes The maximum, or 0 to disable the cache.
+     */
+    void setMaxBytes(size_t maxBytes);
+
+    size_t getMaxBytes() const { return maxBytes; }
+
+    /**
+     * \brief Return the approximate memory used by the cached glyphs.
+     */
+    size_t getMemoryUsage() const { return usedBytes; }
+
+private:
+    GlyphCache();
+
+    static void rasterize(const uint8_t* glyph, uint8_t w, uint8_t h, std::vector<Run>& runs);
+
+    static size_t calcEntryBytes(const Entry& e);
+
+    void evict(size_t maxBytes);
+
+private:
+    std::list<Entry> lru; // Most recently used first
+    std::unordered_map<const uint8_t*, std::list<Entry>::iterator> index;
+
+    size_t maxBytes;
+    size_t usedBytes;
+};
+
+}
@@ -40,39 +40,51 @@ ImageLoader::ImageLoader()
 {
 }
 
+Bitmap ImageLoader::makeBitmap(uint16_t w, uint16_t h, uint16_t* rgb, uint8_t* mask, uint8_t* alpha)
+{
+    Bitmap bmp = Bitmap::takeOwnership(w, h, rgb, mask, alpha);
+    if (mask) {
+        // Without spans, the bitmap can still be drawn, just slower
+        bmp.buildSpans();
+    }
+    return bmp;
+}
+
 Bitmap ImageLoader::loadBitmapBMP(Reader& reader)
 {
     uint16_t* rgb = nullptr;
     uint8_t* mask = nullptr;
+    uint8_t* alpha = nullptr;
     uint16_t w, h;
-    if (!loadBMPRaw565(reader, &rgb, &mask, &w, &h, 0)) {
+    if (!loadBMPRaw565(reader, &rgb, &mask, &alpha, &w, &h, 0)) {
         return {};
     }
-    return Bitmap::takeOwnership(w, h, rgb, mask);
+    return makeBitmap(w, h, rgb, mask, alpha);
 }
 
 Bitmap ImageLoader::loadBitmapBMP(const std::string_view& path)
 {
     uint16_t* rgb = nullptr;
     uint8_t* mask = nullptr;
+    uint8_t* alpha = nullptr;
     uint16_t w, h;
-    if (!loadBMPRaw565(path, &rgb, &mask, &w, &h, 0)) {
+    if (!loadBMPRaw565(path, &rgb, &mask, &alpha, &w, &h, 0)) {
         return {};
     }
-    return Bitmap::takeOwnership(w, h, rgb, mask);
+    return makeBitmap(w, h, rgb, mask, alpha);
 }
 
 Bitmap ImageLoader::loadBitmapBMPSeparateMask(Reader& rgbReader, Reader& maskReader)
 {
     uint16_t* rgb = nullptr;
     uint16_t w, h;
-    if (!loadBMPRaw565(rgbReader, &rgb, nullptr, &w, &h, 0)) {
+    if (!loadBMPRaw565(rgbReader, &rgb, nullptr, nullptr, &w, &h, 0)) {
         return {};
     }
 
     uint8_t* mask = nullptr;
     uint16_t wm, hm;
-    if (!loadBMPRaw565(maskReader, nullptr, &mask, &wm, &hm, BMPLoadFlagMaskFromColor)) {
+    if (!loadBMPRaw565(maskReader, nullptr, &mask, nullptr, &wm, &hm, BMPLoadFlagMaskFromColor)) {
         free(rgb);
         return {};
     }
@@ -84,7 +96,7 @@ Bitmap ImageLoader::loadBitmapBMPSeparateMask(Reader& rgbReader, Reader& maskRea
         return {};
     }
 
-    return Bitmap::takeOwnership(w, h, rgb, mask);
+    return makeBitmap(w, h, rgb, mask);
 }
 
 Bitmap ImageLoader::loadBitmapBMPSeparateMask (
@@ -93,13 +105,13 @@ Bitmap ImageLoader::loadBitmapBMPSeparateMask (
 ) {
     uint16_t* rgb = nullptr;
     uint16_t w, h;
-    if (!loadBMPRaw565(rgbPath, &rgb, nullptr, &w, &h, 0)) {
+    if (!loadBMPRaw565(rgbPath, &rgb, nullptr, nullptr, &w, &h, 0)) {
         return {};
     }
 
     uint8_t* mask = nullptr;
     uint16_t wm, hm;
-    if (!loadBMPRaw565(maskPath, nullptr, &mask, &wm, &hm, BMPLoadFlagMaskFromColor)) {
+    if (!loadBMPRaw565(maskPath, nullptr, &mask, nullptr, &wm, &hm, BMPLoadFlagMaskFromColor)) {
         free(rgb);
         return {};
     }
@@ -111,12 +123,148 @@ Bitmap ImageLoader::loadBitmapBMPSeparateMask (
         return {};
     }
 
-    return Bitmap::takeOwnership(w, h, rgb, mask);
+    return makeBitmap(w, h, rgb, mask);
+}
+
+IndexedBitmap ImageLoader::loadIndexedBitmapBMP(const std::string_view& path, int16_t transparentIndex)
+{
+    char fbuf[512];
+    FileReader freader{File(path)};
+    if (!freader.open(&errmsg)) {
+        return {};
+    }
+    BufferedReader reader(freader, fbuf, sizeof(fbuf));
+    return loadIndexedBitmapBMP(reader, transparentIndex);
+}
+
+IndexedBitmap ImageLoader::loadIndexedBitmapBMP(Reader& reader, int16_t transparentIndex)
+{
+    ssize_t bmpOrigin = reader.tell();
+    if (bmpOrigin < 0) {
+        setError("file position not available");
+        return {};
+    }
+
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+
+    if (reader.read(&fileHeader, sizeof(fileHeader)) != sizeof(fileHeader)) {
+        setError("premature end of file header");
+        return {};
+    }
+    if (fileHeader.signature[0] != 'B'  ||  fileHeader.signature[1] != 'M') {
+        setError("invalid BMP signature");
+        return {};
+    }
+    if (reader.read(&infoHeader, sizeof(infoHeader)) != sizeof(infoHeader)) {
+        setError("premature end of info header");
+        return {};
+    }
+    if (infoHeader.infoHeaderSize < 40) {
+        setError("unsupported info header");
+        return {};
+    }
+
+    const uint8_t bpp = static_cast<uint8_t>(infoHeader.bitsPerPixel);
+    if (infoHeader.bitsPerPixel != 1  &&  infoHeader.bitsPerPixel != 4  &&  infoHeader.bitsPerPixel != 8) {
+        setError("unsupported bits per pixel");
+        return {};
+    }
+    if (infoHeader.compression != 0) {
+        setError("compressed BMPs are not supported");
+        return {};
+    }
+    if (infoHeader.width > UINT16_MAX  ||  infoHeader.height > UINT16_MAX) {
+        setError("image too large");
+        return {};
+    }
+
+    // The palette follows the info header, as BGRX quadruples
+    uint16_t numColors = infoHeader.colorsUsed != 0
+            ? static_cast<uint16_t>(std::min<uint32_t>(infoHeader.colorsUsed, 256))
+            : (1 << bpp);
+    if (!reader.seek(bmpOrigin + sizeof(BMPFileHeader) + infoHeader.infoHeaderSize, File::SeekSet)) {
+        setError("error seeking palette");
+        return {};
+    }
+    Palette palette(numColors, transparentIndex);
+    for (uint16_t i = 0 ; i < numColors ; i++) {
+        uint8_t bgrx[4];
+        if (reader.read(bgrx, 4) != 4) {
+            setError("premature end of palette");
+            return {};
+        }
+        palette.setColor(i, Color(bgrx[2], bgrx[1], bgrx[0]));
+    }
+
+    const uint16_t sx = std::min(offsetX, static_cast<uint16_t>(infoHeader.width));
+    const uint16_t sy = std::min(offsetY, static_cast<uint16_t>(infoHeader.height));
+    const uint16_t w = std::min(maxWidth, static_cast<uint16_t>(infoHeader.width-sx));
+    const uint16_t h = std::min(maxHeight, static_cast<uint16_t>(infoHeader.height-sy));
+
+    const size_t bytesPerLine = IndexedBitmap::calcBytesPerLine(w, bpp);
+    auto indices = static_cast<uint8_t*>(malloc(std::max<size_t>(bytesPerLine*h, 1)));
+    if (!indices) {
+        setError("index allocation failed");
+        return {};
+    }
+    memset(indices, 0, bytesPerLine*h);
+
+    if (w != 0  &&  h != 0) {
+        // Lines are padded to multiples of 4 bytes
+        const size_t lineSize = ((infoHeader.width*bpp + 31) / 32) * 4;
+        const size_t readSize = IndexedBitmap::calcBytesPerLine(sx+w, bpp);
+        const uint16_t ey = sy+h-1;
+
+        if (!reader.seek(bmpOrigin + fileHeader.dataOffset + (infoHeader.height-ey-1)*lineSize, File::SeekSet)) {
+            free(indices);
+            setError("error seeking data");
+            return {};
+        }
+
+        auto line = static_cast<uint8_t*>(malloc(readSize));
+        if (!line) {
+            free(indices);
+            setError("line allocation failed");
+            return {};
+        }
+
+        const bool byteAligned = ((static_cast<uint32_t>(sx)*bpp) & 7) == 0;
+        for (uint16_t outY = h-1 ; outY != UINT16_MAX ; outY--) { // Assumes integer underflow, which IS well-defined
+            if (reader.read(line, readSize) != readSize) {
+                free(line);
+                free(indices);
+                setError("premature end of data");
+                return {};
+            }
+            uint8_t* outRow = indices + outY*bytesPerLine;
+            if (byteAligned) {
+                memcpy(outRow, line + static_cast<size_t>(sx)*bpp/8, bytesPerLine);
+            } else {
+                for (uint16_t outX = 0 ; outX < w ; outX++) {
+                    const uint8_t idx = IndexedBitmap::unpackIndex(line, sx+outX, bpp);
+                    const uint32_t bit = static_cast<uint32_t>(outX)*bpp;
+                    outRow[bit >> 3] |= idx << (8 - bpp - (bit & 7));
+                }
+            }
+            if (outY != 0) { // Important, otherwise seek might fail at end of file!
+                if (!reader.seek(lineSize - readSize, File::SeekCur)) {
+                    free(line);
+                    free(indices);
+                    setError("error seeking data");
+                    return {};
+                }
+            }
+        }
+        free(line);
+    }
+
+    return IndexedBitmap::takeOwnership(w, h, bpp, indices, palette);
 }
 
 bool ImageLoader::loadBMPRaw565 (
     const std::string_view& path,
-    uint16_t** outRgb, uint8_t** outMask,
+    uint16_t** outRgb, uint8_t** outMask, uint8_t** outAlpha,
     uint16_t* outWidth, uint16_t* outHeight,
     int flags
 ) {
@@ -126,12 +274,12 @@ bool ImageLoader::loadBMPRaw565 (
         return false;
     }
     BufferedReader reader(freader, fbuf, sizeof(fbuf));
-    return loadBMPRaw565(reader, outRgb, outMask, outWidth, outHeight, flags);
+    return loadBMPRaw565(reader, outRgb, outMask, outAlpha, outWidth, outHeight, flags);
 }
 
 bool ImageLoader::loadBMPRaw565 (
     Reader& reader,
-    uint16_t** outRgb, uint8_t** outMask,
+    uint16_t** outRgb, uint8_t** outMask, uint8_t** outAlpha,
     uint16_t* outWidth, uint16_t* outHeight,
     int flags
 ) {
@@ -199,8 +347,10 @@ bool ImageLoader::loadBMPRaw565 (
 
     uint16_t* rgb = nullptr;
     uint8_t* mask = nullptr;
+    uint8_t* alpha = nullptr; // Only allocated once a partially-transparent pixel shows up
     bool rgbOwned = false;
     bool maskOwned = false;
+    const bool loadAlpha = loadMask  &&  outAlpha  &&  (flags & BMPLoadFlagMaskFromColor) == 0;
     const size_t maskBytesPerLine = Bitmap::calcMaskBytesPerLine(w);
 
     if (outRgb) {
@@ -268,10 +418,11 @@ bool ImageLoader::loadBMPRaw565 (
                         return setError("premature end of data");
                     }
                     if (rgb) {
-                        rgb[outY*w + outX] =
+                        rgb[outY*w + outX] = Color (
                             ((bgr[2] >> 3) << 11)   // R
                             | ((bgr[1] >> 2) << 5)  // G
-                            | (bgr[0] >> 3);        // B
+                            | (bgr[0] >> 3)         // B
+                            ).toPixel();
                     }
                     if (loadMask) {
                         uint16_t rgbSum = static_cast<uint16_t>(bgr[0])
@@ -299,13 +450,15 @@ bool ImageLoader::loadBMPRaw565 (
                     if (numRead != 4) {
                         if (rgbOwned) free(rgb);
                         if (maskOwned) free(mask);
+                        free(alpha);
                         return setError("premature end of data");
                     }
                     if (rgb) {
-                        rgb[outY*w + outX] =
+                        rgb[outY*w + outX] = Color (
                             ((bgra[2] >> 3) << 11)  // R
                             | ((bgra[1] >> 2) << 5) // G
-                            | (bgra[0] >> 3);       // B
+                            | (bgra[0] >> 3)        // B
+                            ).toPixel();
                     }
                     if (loadMask) {
                         if ((flags & BMPLoadFlagMaskFromColor) != 0) {
@@ -316,7 +469,28 @@ bool ImageLoader::loadBMPRaw565 (
                                 mask[maskLineOffset + (outX>>3)] |= (0x80 >> (outX&7));
                             }
                         } else {
-                            if (bgra[3] > 127) {
+                            if (loadAlpha  &&  !alpha  &&  bgra[3] != 0  &&  bgra[3] != 255) {
+                                // Until now, all pixels were either opaque or
+                                // transparent, so the mask tells their alpha.
+                                alpha = static_cast<uint8_t*>(malloc(w * h));
+                                if (!alpha) {
+                                    if (rgbOwned) free(rgb);
+                                    if (maskOwned) free(mask);
+                                    return setError("alpha allocation failed");
+                                }
+                                for (uint16_t ay = 0 ; ay < h ; ay++) {
+                                    for (uint16_t ax = 0 ; ax < w ; ax++) {
+                                        const bool set = mask[ay*maskBytesPerLine + (ax>>3)] & (0x80 >> (ax&7));
+                                        alpha[ay*w + ax] = set ? 255 : 0;
+                                    }
+                                }
+                            }
+                            if (alpha) {
+                                alpha[outY*w + outX] = bgra[3];
+                            }
+                            // With an alpha plane, only fully transparent
+                            // pixels are masked out.
+                            if (alpha ? bgra[3] != 0 : bgra[3] > 127) {
                                 mask[maskLineOffset + (outX>>3)] |= (0x80 >> (outX&7));
                             }
                         }
@@ -326,6 +500,7 @@ bool ImageLoader::loadBMPRaw565 (
                     if (!reader.seek(interLineSkipSize, File::SeekCur)) {
                         if (rgbOwned) free(rgb);
                         if (maskOwned) free(mask);
+                        free(alpha);
                         return setError("error seeking data");
                     }
                 }
@@ -349,6 +524,9 @@ bool ImageLoader::loadBMPRaw565 (
     if (outMask  &&  !*outMask) {
         *outMask = mask;
     }
+    if (outAlpha) {
+        *outAlpha = alpha;
+    }
 
     return true;
 }
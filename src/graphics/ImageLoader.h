@@ -4,6 +4,7 @@
 
 #include "../storage/Reader.h"
 #include "Bitmap.h"
+#include "IndexedBitmap.h"
 
 
 namespace MINTGGGameEngine
@@ -31,6 +32,13 @@ public:
 
     const char* getErrorMessage() const { return errmsg; }
 
+    /**
+     * \brief Load a bitmap from an uncompressed 24 or 32-bit BMP.
+     *
+     * For 32-bit files, pixels with an alpha of 0 are masked out. If there are
+     * any partially-transparent pixels, the bitmap also gets an alpha plane
+     * (see Bitmap::getAlpha()).
+     */
     Bitmap loadBitmapBMP(Reader& reader);
     Bitmap loadBitmapBMP(const std::string_view& path);
 
@@ -38,16 +46,29 @@ public:
     Bitmap loadBitmapBMPSeparateMask (
         const std::string_view& rgbPath, const std::string_view& maskPath);
 
+    /**
+     * \brief Load an uncompressed BMP with 1, 4 or 8 bits per pixel, keeping
+     *      its palette indices.
+     *
+     * \param reader The reader positioned at the start of the BMP file.
+     * \param transparentIndex The palette index to treat as transparent, or
+     *      Palette::NoTransparency.
+     */
+    IndexedBitmap loadIndexedBitmapBMP(Reader& reader, int16_t transparentIndex = Palette::NoTransparency);
+    IndexedBitmap loadIndexedBitmapBMP(const std::string_view& path, int16_t transparentIndex = Palette::NoTransparency);
+
 private:
+    Bitmap makeBitmap(uint16_t w, uint16_t h, uint16_t* rgb, uint8_t* mask, uint8_t* alpha = nullptr);
+
     bool loadBMPRaw565 (
         const std::string_view& path,
-        uint16_t** outRgb, uint8_t** outMask,
+        uint16_t** outRgb, uint8_t** outMask, uint8_t** outAlpha,
         uint16_t* outWidth, uint16_t* outHeight,
         int flags
         );
     bool loadBMPRaw565 (
         Reader& reader,
-        uint16_t** outRgb, uint8_t** outMask,
+        uint16_t** outRgb, uint8_t** outMask, uint8_t** outAlpha,
         uint16_t* outWidth, uint16_t* outHeight,
         int flags
         );
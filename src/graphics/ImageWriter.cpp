@@ -0,0 +1,176 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace MINTGGGameEngine
+{
+
+
+static uint8_t* PutLE(uint8_t* p, uint32_t value, size_t numBytes)
+{
+    for (size_t i = 0 ; i < numBytes ; i++) {
+        *p++ = static_cast<uint8_t>(value >> (i*8));
+    }
+    return p;
+}
+
+
+
+ImageWriter::ImageWriter()
+    : file(nullptr), width(0), rowsLeft(0), chunk(nullptr), chunkUsed(0), row(nullptr), rowSize(0),
+      errmsg(nullptr)
+{
+}
+
+ImageWriter::~ImageWriter()
+{
+    free(chunk);
+    free(row);
+}
+
+bool ImageWriter::beginBMP(File& file, uint16_t w, uint16_t h)
+{
+    // Lines are padded to multiples of 4 bytes
+    const size_t rowSize = (static_cast<size_t>(w)*3 + 3) & ~static_cast<size_t>(3);
+
+    if (!chunk) {
+        chunk = static_cast<uint8_t*>(malloc(ChunkSize));
+    }
+    if (!row  ||  rowSize > this->rowSize) {
+        free(row);
+        row = static_cast<uint8_t*>(malloc(rowSize));
+    }
+    if (!chunk  ||  !row) {
+        return setError("buffer allocation failed");
+    }
+    memset(row, 0, rowSize);
+
+    this->file = &file;
+    this->width = w;
+    this->rowsLeft = h;
+    this->rowSize = rowSize;
+    chunkUsed = 0;
+
+    const uint32_t headerSize = 14 + 40;
+    const uint32_t dataSize = static_cast<uint32_t>(rowSize) * h;
+
+    uint8_t header[headerSize];
+    uint8_t* p = header;
+
+    // BITMAPFILEHEADER
+    *p++ = 'B';
+    *p++ = 'M';
+    p = PutLE(p, headerSize + dataSize, 4);
+    p = PutLE(p, 0, 4);
+    p = PutLE(p, headerSize, 4); // Data offset
+
+    // BITMAPINFOHEADER
+    p = PutLE(p, 40, 4);
+    p = PutLE(p, w, 4);
+    p = PutLE(p, h, 4); // Positive height: bottom-up
+    p = PutLE(p, 1, 2); // Planes
+    p = PutLE(p, 24, 2); // Bits per pixel
+    p = PutLE(p, 0, 4); // BI_RGB
+    p = PutLE(p, dataSize, 4);
+    p = PutLE(p, 2835, 4); // 72 DPI
+    p = PutLE(p, 2835, 4);
+    p = PutLE(p, 0, 4);
+    p = PutLE(p, 0, 4);
+
+    return put(header, headerSize);
+}
+
+bool ImageWriter::writeBMPRows(const uint16_t* pixels, size_t stride, uint16_t numRows)
+{
+    if (!file) {
+        return setError("not started");
+    }
+    if (numRows > rowsLeft) {
+        return setError("too many rows");
+    }
+
+    for (uint16_t y = numRows ; y != 0 ; y--) {
+        const uint16_t* src = pixels + (y-1)*stride;
+        uint8_t* dst = row;
+        for (uint16_t x = 0 ; x < width ; x++) {
+            const uint16_t c = Color::fromPixel(src[x]).toRGB565();
+            const uint8_t r = (c >> 11) & 0x1F;
+            const uint8_t g = (c >> 5) & 0x3F;
+            const uint8_t b = c & 0x1F;
+
+            // Replicate the top bits, so that white stays white
+            *dst++ = (b << 3) | (b >> 2);
+            *dst++ = (g << 2) | (g >> 4);
+            *dst++ = (r << 3) | (r >> 2);
+        }
+        if (!put(row, rowSize)) {
+            return false;
+        }
+    }
+
+    rowsLeft -= numRows;
+    return true;
+}
+
+bool ImageWriter::endBMP()
+{
+    if (!file) {
+        return setError("not started");
+    }
+    bool ok = flushChunk()  &&  file->flush();
+    if (ok  &&  rowsLeft != 0) {
+        ok = setError("missing rows");
+    }
+    file = nullptr;
+    return ok;
+}
+
+bool ImageWriter::saveBitmapBMP(const Bitmap& bitmap, const std::string_view& path)
+{
+    if (!bitmap  ||  !bitmap.getData()) {
+        return setError("bitmap has no data");
+    }
+
+    File f(path);
+    if (!f.open(File::WriteOnly, &errmsg)) {
+        return false;
+    }
+    const bool ok =
+            beginBMP(f, bitmap.getWidth(), bitmap.getHeight())
+        &&  writeBMPRows(bitmap.getData(), bitmap.getStride(), bitmap.getHeight())
+        &&  endBMP();
+    file = nullptr;
+    f.close();
+    return ok;
+}
+
+bool ImageWriter::put(const void* data, size_t size)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (size != 0) {
+        const size_t n = std::min(size, ChunkSize - chunkUsed);
+        memcpy(chunk + chunkUsed, p, n);
+        chunkUsed += n;
+        p += n;
+        size -= n;
+        if (chunkUsed == ChunkSize  &&  !flushChunk()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ImageWriter::flushChunk()
+{
+    if (chunkUsed != 0  &&  file->write(chunk, chunkUsed) != chunkUsed) {
+        chunkUsed = 0;
+        return setError("error writing data");
+    }
+    chunkUsed = 0;
+    return true;
+}
+
+
+}
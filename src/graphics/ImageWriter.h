@@ -0,0 +1,101 @@
+#pragma once
+
+#include "../Globals.h"
+
+#include "../storage/File.h"
+#include "Bitmap.h"
+
+#include <string_view>
+
+
+namespace MINTGGGameEngine
+{
+
+
+/**
+ * \brief Writes RGB565 pixels to uncompressed 24-bit BMP files.
+ *
+ * Rows are converted a block at a time, and the file is written in chunks of
+ * ChunkSize bytes at offsets that are multiples of ChunkSize, which is what
+ * SD cards handle best. The files can be loaded again with ImageLoader.
+ *
+ * The image can be written in blocks of rows, so that it never has to be in
+ * memory in its entirety (see beginBMP()).
+ */
+class ImageWriter
+{
+public:
+    enum
+    {
+        ChunkSize = 4096
+    };
+
+public:
+    ImageWriter();
+    ImageWriter(const ImageWriter& other) = delete;
+    ~ImageWriter();
+
+    const char* getErrorMessage() const { return errmsg; }
+
+    /**
+     * \brief Start writing a BMP file.
+     *
+     * BMP files store their rows bottom-up, so the rows must be passed to
+     * writeBMPRows() starting with the last block of the image. Call endBMP()
+     * when all rows have been written.
+     *
+     * \param file The file, open for writing.
+     * \param w The image width.
+     * \param h The image height.
+     * \return true if successful, false otherwise.
+     */
+    bool beginBMP(File& file, uint16_t w, uint16_t h);
+
+    /**
+     * \brief Write a block of rows.
+     *
+     * \param pixels The pixels of the first (topmost) row of the block, in
+     *      pixel order (see Color::toPixel()).
+     * \param stride The distance between two rows, in pixels.
+     * \param numRows The number of rows in the block. They are written
+     *      bottom-up.
+     * \return true if successful, false otherwise.
+     */
+    bool writeBMPRows(const uint16_t* pixels, size_t stride, uint16_t numRows);
+
+    /**
+     * \brief Write the remaining data and finish the file.
+     *
+     * The file is flushed, but not closed.
+     *
+     * \return true if successful, false if writing failed or not all rows were
+     *      written.
+     */
+    bool endBMP();
+
+    /**
+     * \brief Write a bitmap to a BMP file. The mask and alpha are ignored.
+     */
+    bool saveBitmapBMP(const Bitmap& bitmap, const std::string_view& path);
+
+private:
+    bool put(const void* data, size_t size);
+    bool flushChunk();
+
+    bool setError(const char* errmsg) { this->errmsg = errmsg; return false; }
+
+private:
+    File* file;
+    uint16_t width;
+    uint16_t rowsLeft;
+
+    uint8_t* chunk;
+    size_t chunkUsed;
+    uint8_t* row; // One converted row, including padding
+    size_t rowSize;
+
+    const char* errmsg;
+};
+
+
+}
@@ -0,0 +1,121 @@
+#include "IndexedBitmap.h"
+
+#include "ImageLoader.h"
+
+
+namespace MINTGGGameEngine
+{
+
+
+static bool IsValidBitsPerPixel(uint8_t bpp)
+{
+    return bpp == 1  ||  bpp == 2  ||  bpp == 4  ||  bpp == 8;
+}
+
+
+IndexedBitmap IndexedBitmap::takeOwnership(uint16_t w, uint16_t h, uint8_t bpp, uint8_t* indices, const Palette& palette)
+{
+    IndexedBitmap bmp;
+    if (!IsValidBitsPerPixel(bpp)) {
+        return bmp;
+    }
+    bmp.d = std::make_shared<Data>(w, h, bpp, indices, true);
+    bmp.palette = palette;
+    return bmp;
+}
+
+IndexedBitmap IndexedBitmap::loadBMP (
+    const char* path,
+    int16_t transparentIndex,
+    const char** outErrmsg
+) {
+    ImageLoader il;
+    IndexedBitmap bmp = il.loadIndexedBitmapBMP(path, transparentIndex);
+    if (!bmp) {
+        if (outErrmsg) *outErrmsg = il.getErrorMessage();
+    }
+    return bmp;
+}
+
+IndexedBitmap::IndexedBitmap(uint16_t w, uint16_t h, uint8_t bpp, const Palette& palette)
+    : palette(palette)
+{
+    if (!IsValidBitsPerPixel(bpp)) {
+        return;
+    }
+    const size_t size = calcBytesPerLine(w, bpp)*h;
+    auto idx = static_cast<uint8_t*>(malloc(size));
+    if (!idx) {
+        return;
+    }
+    memset(idx, 0, size);
+    d = std::make_shared<Data>(w, h, bpp, idx, true);
+}
+
+void IndexedBitmap::setIndex(uint16_t x, uint16_t y, uint8_t index)
+{
+    uint8_t* row = d->idx + y*getBytesPerLine();
+    if (d->bpp == 8) {
+        row[x] = index;
+        return;
+    }
+    const uint32_t bit = static_cast<uint32_t>(x)*d->bpp;
+    const uint8_t shift = 8 - d->bpp - (bit & 7);
+    const uint8_t mask = ((1 << d->bpp) - 1) << shift;
+    row[bit >> 3] = (row[bit >> 3] & ~mask) | ((index << shift) & mask);
+}
+
+Bitmap IndexedBitmap::toBitmap() const
+{
+    if (!d  ||  !palette) {
+        return Bitmap();
+    }
+
+    const uint16_t w = d->w;
+    const uint16_t h = d->h;
+    const int16_t transparent = palette.getTransparentIndex();
+    const uint16_t* lut = palette.getPixels();
+    const uint16_t numColors = palette.getSize();
+
+    auto rgb = static_cast<uint16_t*>(malloc(w*h*sizeof(uint16_t)));
+    if (!rgb) {
+        return Bitmap();
+    }
+    const size_t maskByteW = Bitmap::calcMaskBytesPerLine(w);
+    uint8_t* mask = nullptr;
+    if (transparent != Palette::NoTransparency) {
+        mask = static_cast<uint8_t*>(malloc(maskByteW*h));
+        if (!mask) {
+            free(rgb);
+            return Bitmap();
+        }
+        memset(mask, 0, maskByteW*h);
+    }
+
+    const size_t bytesPerLine = getBytesPerLine();
+    for (uint16_t y = 0 ; y < h ; y++) {
+        const uint8_t* row = d->idx + y*bytesPerLine;
+        for (uint16_t x = 0 ; x < w ; x++) {
+            const uint8_t idx = unpackIndex(row, x, d->bpp);
+            const bool opaque = idx != transparent  &&  idx < numColors;
+            rgb[y*w + x] = opaque ? lut[idx] : 0;
+            if (mask  &&  opaque) {
+                mask[y*maskByteW + (x>>3)] |= (0x80 >> (x&7));
+            }
+        }
+    }
+
+    Bitmap bmp = Bitmap::takeOwnership(w, h, rgb, mask);
+    if (mask) {
+        bmp.buildSpans();
+    }
+    return bmp;
+}
+
+size_t IndexedBitmap::getMemoryUsage() const
+{
+    return d ? sizeof(Data) + getBytesPerLine()*d->h : 0;
+}
+
+
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "../Globals.h"
+#include "Bitmap.h"
+#include "Palette.h"
+
+#include <memory>
+
+
+namespace MINTGGGameEngine
+{
+
+/**
+ * \brief A bitmap storing palette indices instead of colors.
+ *
+ * Each pixel is an index into a Palette, packed with 1, 2, 4 or 8 bits per
+ * pixel. Rows start on byte boundaries, and the leftmost pixel of a byte is in
+ * its most significant bits (just like in BMP files). A 64x64 sprite with up
+ * to 16 colors thus takes 2 KB instead of the 8 KB of a Bitmap.
+ *
+ * Indices are expanded through the palette while drawing (see
+ * Screen::drawIndexedBitmap()). Pixels using the palette's transparent index,
+ * or an index beyond the end of the palette, are not drawn.
+ *
+ * The palette is not part of the shared pixel data, so withPalette() creates
+ * a color variant of a bitmap without copying any pixels.
+ *
+ * This class uses shared pointers, so copying is cheap.
+ */
+class IndexedBitmap
+{
+private:
+    struct Data
+    {
+        Data(uint16_t w, uint16_t h, uint8_t bpp, uint8_t* idx, bool own) : w(w), h(h), bpp(bpp), idx(idx), own(own) {}
+        ~Data() { if (own) { free(idx); } }
+
+        uint16_t w;
+        uint16_t h;
+        uint8_t bpp;
+        uint8_t* idx;
+        bool own;
+    };
+
+public:
+    /**
+     * \brief Create a bitmap from packed index data, without copying.
+     *
+     * The new bitmap takes ownership of the data, which must have been
+     * allocated with malloc().
+     *
+     * \param w The width in pixels.
+     * \param h The height in pixels.
+     * \param bpp The bits per pixel: 1, 2, 4 or 8.
+     * \param indices The packed indices, with calcBytesPerLine() bytes per
+     *      row.
+     * \param palette The palette.
+     * \return The new bitmap, or an invalid one if bpp is not supported.
+     */
+    static IndexedBitmap takeOwnership(uint16_t w, uint16_t h, uint8_t bpp, uint8_t* indices, const Palette& palette);
+
+    /**
+     * \brief Load a bitmap from an uncompressed BMP file with 1, 4 or 8 bits
+     *      per pixel, including its palette.
+     *
+     * BMP files have no notion of a transparent color, so it has to be given
+     * here.
+     *
+     * \param path The file path.
+     * \param transparentIndex The palette index to treat as transparent, or
+     *      Palette::NoTransparency.
+     * \param outErrmsg Receives an error message if loading fails. Can be null.
+     * \return The loaded bitmap, or an invalid one on error.
+     */
+    static IndexedBitmap loadBMP (
+        const char* path,
+        int16_t transparentIndex = Palette::NoTransparency,
+        const char** outErrmsg = nullptr
+        );
+
+    static size_t calcBytesPerLine(uint16_t w, uint8_t bpp) { return (static_cast<size_t>(w)*bpp + 7) / 8; }
+
+    /**
+     * \brief Return the index of a pixel in a packed row.
+     */
+    static uint8_t unpackIndex(const uint8_t* row, int32_t x, uint8_t bpp)
+    {
+        if (bpp == 8) {
+            return row[x];
+        }
+        const uint32_t bit = static_cast<uint32_t>(x)*bpp;
+        return (row[bit >> 3] >> (8 - bpp - (bit & 7))) & ((1 << bpp) - 1);
+    }
+
+public:
+    /**
+     * \brief Create an invalid bitmap.
+     */
+    IndexedBitmap() {}
+
+    /**
+     * \brief Create a bitmap with all indices set to 0.
+     *
+     * \param w The width in pixels.
+     * \param h The height in pixels.
+     * \param bpp The bits per pixel: 1, 2, 4 or 8.
+     * \param palette The palette.
+     */
+    IndexedBitmap(uint16_t w, uint16_t h, uint8_t bpp, const Palette& palette);
+
+    /**
+     * \brief Create a bitmap from packed index data, without copying.
+     *
+     * No ownership is taken, so the data must remain valid for the entire
+     * lifetime of the bitmap. This is primarily useful for global static data.
+     *
+     * \see takeOwnership()
+     */
+    IndexedBitmap(uint16_t w, uint16_t h, uint8_t bpp, const uint8_t* indices, const Palette& palette)
+            : d(std::make_shared<Data>(w, h, bpp, const_cast<uint8_t*>(indices), false)), palette(palette) {}
+
+    IndexedBitmap(const IndexedBitmap& o) : d(o.d), palette(o.palette) {}
+
+
+    uint16_t getWidth() const { return d ? d->w : 0; }
+    uint16_t getHeight() const { return d ? d->h : 0; }
+    uint8_t getBitsPerPixel() const { return d ? d->bpp : 0; }
+    size_t getBytesPerLine() const { return d ? calcBytesPerLine(d->w, d->bpp) : 0; }
+
+    /**
+     * \brief Return the packed indices.
+     */
+    const uint8_t* getIndices() const { return d ? d->idx : nullptr; }
+
+    const Palette& getPalette() const { return palette; }
+
+    /**
+     * \brief Use a different palette for this bitmap.
+     *
+     * Only this object is affected, not other bitmaps sharing its indices.
+     */
+    void setPalette(const Palette& palette) { this->palette = palette; }
+
+    /**
+     * \brief Return a bitmap sharing the indices of this one, but drawn with a
+     *      different palette.
+     */
+    IndexedBitmap withPalette(const Palette& palette) const
+            { IndexedBitmap bmp(*this); bmp.palette = palette; return bmp; }
+
+    uint8_t getIndex(uint16_t x, uint16_t y) const
+            { return unpackIndex(d->idx + y*getBytesPerLine(), x, d->bpp); }
+
+    void setIndex(uint16_t x, uint16_t y, uint8_t index);
+
+    /**
+     * \brief Return a full-color copy of this bitmap.
+     *
+     * The copy has a mask (with spans, see Bitmap::buildSpans()) if the palette
+     * has a transparent index.
+     */
+    Bitmap toBitmap() const;
+
+    /**
+     * \brief Return the memory used by the indices. The palette is not
+     *      included, as it is usually shared.
+     */
+    size_t getMemoryUsage() const;
+
+    /**
+     * \brief Check if the bitmap is valid.
+     */
+    operator bool() const { return (bool) d; }
+
+    IndexedBitmap& operator=(const IndexedBitmap& other) { d = other.d; palette = other.palette; return *this; }
+
+    bool operator==(const IndexedBitmap& other) const { return d == other.d  &&  palette == other.palette; }
+    bool operator!=(const IndexedBitmap& other) const { return !(*this == other); }
+
+private:
+    std::shared_ptr<Data> d;
+    Palette palette;
+};
+
+}
@@ -0,0 +1,38 @@
+#include "Palette.h"
+
+#include <algorithm>
+
+
+namespace MINTGGGameEngine
+{
+
+
+Palette::Palette(uint16_t numColors, int16_t transparentIndex)
+    : d(std::make_shared<Data>())
+{
+    d->pixels.resize(std::min<uint16_t>(numColors, 256), Color::BLACK.toPixel());
+    d->transparentIndex = transparentIndex;
+}
+
+Palette::Palette(const Color* colors, uint16_t numColors, int16_t transparentIndex)
+    : d(std::make_shared<Data>())
+{
+    numColors = std::min<uint16_t>(numColors, 256);
+    d->pixels.reserve(numColors);
+    for (uint16_t i = 0 ; i < numColors ; i++) {
+        d->pixels.push_back(colors[i].toPixel());
+    }
+    d->transparentIndex = transparentIndex;
+}
+
+Palette Palette::copy() const
+{
+    Palette p;
+    if (d) {
+        p.d = std::make_shared<Data>(*d);
+    }
+    return p;
+}
+
+
+}
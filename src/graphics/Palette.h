@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../Globals.h"
+#include "Color.h"
+
+#include <memory>
+#include <vector>
+
+
+namespace MINTGGGameEngine
+{
+
+/**
+ * \brief A table of up to 256 colors, used by IndexedBitmap.
+ *
+ * One entry can be reserved as transparent. Pixels using that index are not
+ * drawn at all.
+ *
+ * The colors are stored in the display's byte order (see Color::toPixel()),
+ * so drawing an indexed bitmap is a plain table lookup per pixel.
+ *
+ * This class uses shared pointers, so copying is cheap. All copies refer to
+ * the same colors, so changing a color affects every bitmap using the
+ * palette. Use copy() to create an independent palette, e.g. for color
+ * variants of a sprite.
+ */
+class Palette
+{
+public:
+    static constexpr int16_t NoTransparency = -1;
+
+private:
+    struct Data
+    {
+        std::vector<uint16_t> pixels; // In pixel order
+        int16_t transparentIndex;
+    };
+
+public:
+    /**
+     * \brief Create an invalid palette.
+     */
+    Palette() {}
+
+    /**
+     * \brief Create a palette with all colors set to black.
+     *
+     * \param numColors The number of colors, at most 256.
+     * \param transparentIndex The index of the transparent color, or
+     *      NoTransparency.
+     */
+    explicit Palette(uint16_t numColors, int16_t transparentIndex = NoTransparency);
+
+    /**
+     * \brief Create a palette from the given colors.
+     *
+     * \param colors The colors. Copied into the palette.
+     * \param numColors The number of colors, at most 256.
+     * \param transparentIndex The index of the transparent color, or
+     *      NoTransparency.
+     */
+    Palette(const Color* colors, uint16_t numColors, int16_t transparentIndex = NoTransparency);
+
+    Palette(const Palette& other) : d(other.d) {}
+
+    /**
+     * \brief Return the number of colors.
+     */
+    uint16_t getSize() const { return d ? static_cast<uint16_t>(d->pixels.size()) : 0; }
+
+    Color getColor(uint8_t index) const { return Color::fromPixel(d->pixels[index]); }
+
+    /**
+     * \brief Change a color.
+     *
+     * This affects all bitmaps using this palette (or a shallow copy of it).
+     * Objects that are already on the screen are only redrawn with the new
+     * color after Game::invalidate().
+     */
+    void setColor(uint8_t index, const Color& color) { d->pixels[index] = color.toPixel(); }
+
+    int16_t getTransparentIndex() const { return d ? d->transparentIndex : NoTransparency; }
+    void setTransparentIndex(int16_t index) { d->transparentIndex = index; }
+
+    /**
+     * \brief Return the colors in pixel order (see Color::toPixel()).
+     */
+    const uint16_t* getPixels() const { return d ? d->pixels.data() : nullptr; }
+
+    /**
+     * \brief Return a deep copy of this palette.
+     */
+    Palette copy() const;
+
+    size_t getMemoryUsage() const { return d ? sizeof(Data) + d->pixels.capacity()*sizeof(uint16_t) : 0; }
+
+    /**
+     * \brief Check if the palette is valid.
+     */
+    operator bool() const { return (bool) d; }
+
+    Palette& operator=(const Palette& other) { d = other.d; return *this; }
+
+    bool operator==(const Palette& other) const { return d == other.d; }
+    bool operator!=(const Palette& other) const { return d != other.d; }
+
+private:
+    std::shared_ptr<Data> d;
+};
+
+}
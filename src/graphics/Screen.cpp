@@ -1,8 +1,13 @@
 #include "Screen.h"
 
+#include <algorithm>
 #include <cassert>
 
 #include "../storage/File.h"
+#include "../util/WorkerTask.h"
+#include "GlyphCache.h"
+#include "ImageWriter.h"
+#include "ScreenRecorder.h"
 
 
 LOG_USE_TAG("Screen")
@@ -14,11 +19,24 @@ namespace MINTGGGameEngine
 
 void Screen::drawText(const Text& text, int32_t ox, int32_t oy)
 {
+    if (text.getCodePoints().empty()) {
+        return;
+    }
+
     const Text::HAlign halign = text.getHAlign();
 
     int32_t ax = text.getX();
     int32_t ay = text.getY();
 
+    if (text.isRenderCached()) {
+        const Bitmap& bitmap = text.getRenderedBitmap();
+        if (bitmap) {
+            text.transformAnchorPosition(Text::Anchor::TopLeft, &ax, &ay);
+            drawBitmap(ax+ox, ay+oy, bitmap);
+            return;
+        }
+    }
+
     if (halign == Text::HAlign::Left) {
         text.transformAnchorPosition(Text::Anchor::TopLeft, &ax, &ay);
         drawTextLinear<true>(text, ax+ox, ay+oy);
@@ -33,32 +51,334 @@ void Screen::drawText(const Text& text, int32_t ox, int32_t oy)
     }
 }
 
+void Screen::drawIndexedBitmap(int32_t x, int32_t y, const IndexedBitmap& bitmap, FlipDir flipDir)
+{
+    drawIndexedBitmapHelper (
+        x, y,
+        bitmap,
+        flipDir,
+        [](Screen* s, int32_t x, int32_t y, uint16_t c) { s->drawPixel(x, y, Color::fromPixel(c)); },
+        static_cast<void (*)(Screen*, int32_t, int32_t, const uint16_t*, int32_t)>(nullptr),
+        this
+        );
+}
+
+void Screen::drawBitmapTransformed (
+    float cx, float cy,
+    const Bitmap& bitmap,
+    float scaleX, float scaleY,
+    float angle
+) {
+    drawBitmapTransformedHelper (
+        cx, cy,
+        bitmap,
+        scaleX, scaleY,
+        angle,
+        [](Screen* s, int32_t x, int32_t y, uint16_t c) { s->drawPixel(x, y, Color::fromPixel(c)); },
+        static_cast<void (*)(Screen*, int32_t, int32_t, const uint16_t*, int32_t)>(nullptr),
+        this
+        );
+}
+
+void Screen::drawBitmapBlended (
+    int32_t x, int32_t y,
+    const Bitmap& bitmap,
+    uint8_t alpha,
+    FlipDir flipDir
+) {
+    const int32_t w = bitmap.getWidth();
+    const int32_t h = bitmap.getHeight();
+    if (!bitmap.getData()  ||  alpha == 0) {
+        return;
+    }
+
+    const bool flipX = flipDir == FlipDir::Horizontal  ||  flipDir == FlipDir::Both;
+    const bool flipY = flipDir == FlipDir::Vertical  ||  flipDir == FlipDir::Both;
+    const bool masked = bitmap.getMask() != nullptr;
+
+    // Without access to a frame buffer, every pixel has to be read back
+    const Rect r = getClipRect().intersected(Rect(x, y, w, h));
+    for (int32_t sy = r.y ; sy < r.getBottom() ; sy++) {
+        const uint16_t by = flipY ? h-1-(sy-y) : sy-y;
+        for (int32_t sx = r.x ; sx < r.getRight() ; sx++) {
+            const uint16_t bx = flipX ? w-1-(sx-x) : sx-x;
+            if (masked  &&  !bitmap.getMaskPixel(bx, by)) {
+                continue;
+            }
+            const uint8_t a = Color::toBlendAlpha((bitmap.getAlphaPixel(bx, by)*alpha + 255) >> 8);
+            if (a == 0) {
+                continue;
+            }
+            const uint16_t pixel = Color::blendPixels(readPixel(sx, sy).toPixel(), bitmap.getPixelRaw(bx, by), a);
+            drawPixel(sx, sy, Color::fromPixel(pixel));
+        }
+    }
+}
+
+// Blends two adjacent pixels that were loaded as one 32-bit word
+static inline uint32_t BlendPixelPair(uint32_t dst, uint32_t src, uint8_t alphaLo, uint8_t alphaHi)
+{
+    return Color::blendPixels(static_cast<uint16_t>(dst), static_cast<uint16_t>(src), alphaLo)
+            | (static_cast<uint32_t>(Color::blendPixels(dst >> 16, src >> 16, alphaHi)) << 16);
+}
+
+void Screen::blendPixelRow(uint16_t* dst, const uint16_t* src, const uint8_t* srcAlpha, int32_t n, uint8_t alpha)
+{
+    if (n <= 0) {
+        return;
+    }
+
+    if (!srcAlpha) {
+        const uint8_t a = Color::toBlendAlpha(alpha);
+        if (a == 0) {
+            return;
+        } else if (a == 32) {
+            memcpy(dst, src, n*sizeof(uint16_t));
+            return;
+        }
+        if (reinterpret_cast<uintptr_t>(dst) & 2) {
+            *dst = Color::blendPixels(*dst, *src, a);
+            dst++;
+            src++;
+            n--;
+        }
+        if ((reinterpret_cast<uintptr_t>(src) & 2) == 0) {
+            for (; n >= 2 ; n -= 2, dst += 2, src += 2) {
+                uint32_t d2, s2;
+                memcpy(&d2, __builtin_assume_aligned(dst, 4), 4);
+                memcpy(&s2, __builtin_assume_aligned(src, 4), 4);
+                d2 = BlendPixelPair(d2, s2, a, a);
+                memcpy(__builtin_assume_aligned(dst, 4), &d2, 4);
+            }
+        }
+        for (; n > 0 ; n--, dst++, src++) {
+            *dst = Color::blendPixels(*dst, *src, a);
+        }
+        return;
+    }
+
+    auto pixelAlpha = [alpha](uint8_t pa) {
+        return Color::toBlendAlpha(alpha == 255 ? pa : (pa*alpha + 255) >> 8);
+    };
+
+    if (reinterpret_cast<uintptr_t>(dst) & 2) {
+        *dst = Color::blendPixels(*dst, *src, pixelAlpha(*srcAlpha));
+        dst++;
+        src++;
+        srcAlpha++;
+        n--;
+    }
+    if ((reinterpret_cast<uintptr_t>(src) & 2) == 0) {
+        for (; n >= 2 ; n -= 2, dst += 2, src += 2, srcAlpha += 2) {
+            // The alpha of the pixel at the lower address is in the same half
+            // of a2 as that pixel is in the 32-bit words, on any endianness.
+            uint16_t a2;
+            memcpy(&a2, srcAlpha, 2);
+            if (a2 == 0) {
+                continue;
+            }
+            uint32_t s2;
+            memcpy(&s2, __builtin_assume_aligned(src, 4), 4);
+            if (a2 != 0xFFFF  ||  alpha != 255) {
+                uint32_t d2;
+                memcpy(&d2, __builtin_assume_aligned(dst, 4), 4);
+                s2 = BlendPixelPair(d2, s2, pixelAlpha(a2 & 0xFF), pixelAlpha(a2 >> 8));
+            }
+            memcpy(__builtin_assume_aligned(dst, 4), &s2, 4);
+        }
+    }
+    for (; n > 0 ; n--, dst++, src++, srcAlpha++) {
+        *dst = Color::blendPixels(*dst, *src, pixelAlpha(*srcAlpha));
+    }
+}
+
+void Screen::copyPixelsReversed(uint16_t* dst, const uint16_t* src, int32_t n)
+{
+    if (n <= 0) {
+        return;
+    }
+
+    // src is read backwards from its end
+    src += n;
+    if (reinterpret_cast<uintptr_t>(dst) & 2) {
+        *dst++ = *--src;
+        n--;
+    }
+    if ((reinterpret_cast<uintptr_t>(src) & 2) == 0) {
+        for (; n >= 2 ; n -= 2, dst += 2, src -= 2) {
+            // Swapping the halves of the word swaps the two pixels in memory,
+            // on any endianness
+            uint32_t pair;
+            memcpy(&pair, __builtin_assume_aligned(src-2, 4), 4);
+            pair = (pair >> 16) | (pair << 16);
+            memcpy(__builtin_assume_aligned(dst, 4), &pair, 4);
+        }
+    }
+    for (; n > 0 ; n--) {
+        *dst++ = *--src;
+    }
+}
+
+Rect Screen::calcTransformedBounds (
+    float cx, float cy,
+    uint16_t w, uint16_t h,
+    float scaleX, float scaleY,
+    float angle
+) {
+    // Half the extents of the rotated rectangle
+    const float c = fabsf(cosf(angle));
+    const float s = fabsf(sinf(angle));
+    const float hw = 0.5f * w * fabsf(scaleX);
+    const float hh = 0.5f * h * fabsf(scaleY);
+    const float ex = c*hw + s*hh;
+    const float ey = s*hw + c*hh;
+
+    const int32_t x0 = static_cast<int32_t>(floorf(cx - ex));
+    const int32_t y0 = static_cast<int32_t>(floorf(cy - ey));
+    const int32_t x1 = static_cast<int32_t>(ceilf(cx + ex));
+    const int32_t y1 = static_cast<int32_t>(ceilf(cy + ey));
+    return Rect(x0, y0, x1-x0, y1-y0);
+}
+
+void Screen::readRegion(const Rect& rect, uint16_t* out, size_t outStride)
+{
+    for (int32_t y = rect.y ; y < rect.y+rect.h ; y++) {
+        uint16_t* outRow = out + (y-rect.y)*outStride;
+        for (int32_t x = rect.x ; x < rect.x+rect.w ; x++) {
+            outRow[x-rect.x] = readPixel(x, y).toPixel();
+        }
+    }
+}
+
 bool Screen::saveScreenshot(const char* path)
 {
-    // TODO: Support writing BMP files (based on extension maybe)
-    File f(path);
-    if (!f.open(File::WriteOnly)) {
+    if (getBandHeight() != 0) {
+        // Everything outside of the current band would be read as black.
+        LogError("Screenshots are not supported while drawing in bands.");
         return false;
     }
+
     const uint16_t w = getWidth();
     const uint16_t h = getHeight();
-    for (uint16_t y = 0 ; y < h ; y++) {
-        for (uint16_t x = 0 ; x < w ; x++) {
-            uint16_t pixel = readPixel(static_cast<int32_t>(x), static_cast<int32_t>(y)).toRGB565();
-            f.write(&pixel, sizeof(pixel));
-        }
+
+    // Read as many rows at once as fit into one file chunk
+    const uint16_t blockRows = std::max<size_t>(1, ImageWriter::ChunkSize / (w*sizeof(uint16_t)));
+    uint16_t* block = static_cast<uint16_t*>(malloc(w*blockRows*sizeof(uint16_t)));
+    if (!block) {
+        LogError("Unable to allocate screenshot buffer.");
+        return false;
     }
-    f.flush();
+
+    File f(path);
+    const char* errmsg = nullptr;
+    if (!f.open(File::WriteOnly, &errmsg)) {
+        LogError("Unable to open screenshot file '%s': %s", path, errmsg ? errmsg : "unknown error");
+        free(block);
+        return false;
+    }
+
+    ImageWriter writer;
+    bool ok = writer.beginBMP(f, w, h);
+
+    // BMP rows are stored bottom-up
+    int32_t y = h;
+    while (ok  &&  y > 0) {
+        const uint16_t numRows = std::min<int32_t>(y, blockRows);
+        y -= numRows;
+        readRegion(Rect(0, y, w, numRows), block, w);
+        ok = writer.writeBMPRows(block, w, numRows);
+    }
+    ok = ok  &&  writer.endBMP();
+
     f.close();
+    free(block);
+
+    if (!ok) {
+        LogError("Error writing screenshot '%s': %s", path, writer.getErrorMessage());
+    }
+    return ok;
+}
+
+bool Screen::saveScreenshotAsync(const char* path, WorkerTask& worker)
+{
+    if (getBandHeight() != 0) {
+        LogError("Screenshots are not supported while drawing in bands.");
+        return false;
+    }
+
+    const uint16_t w = getWidth();
+    const uint16_t h = getHeight();
+
+    uint16_t* data = static_cast<uint16_t*>(malloc(w*h*sizeof(uint16_t)));
+    if (!data) {
+        LogError("Unable to allocate %ux%u screenshot copy.", (unsigned int) w, (unsigned int) h);
+        return false;
+    }
+    readRegion(Rect(0, 0, w, h), data, w);
+
+    const Bitmap copy = Bitmap::takeOwnership(w, h, data);
+    worker.addWorkItem([copy, p = std::string(path)]() {
+        ImageWriter writer;
+        if (!writer.saveBitmapBMP(copy, p)) {
+            LogError("Error writing screenshot '%s': %s", p.c_str(), writer.getErrorMessage());
+        }
+    });
     return true;
 }
 
+void Screen::fillRects(int32_t x, int32_t y, const Rect* rects, size_t numRects, const Color& color)
+{
+    for (size_t i = 0 ; i < numRects ; i++) {
+        const Rect& r = rects[i];
+        drawRect(x + r.x, y + r.y, r.w, r.h, color, true);
+    }
+}
+
+void Screen::recordRows(int32_t y, int32_t numRows)
+{
+    if (recorder) {
+        recorder->recordRows(y, numRows);
+    }
+}
+
+void Screen::setClipRect(const Rect& rect)
+{
+    clipRect = rect.intersected(Rect(0, 0, getWidth(), getHeight()));
+    hasClip = true;
+}
+
+void Screen::resetClipRect()
+{
+    hasClip = false;
+}
+
+void Screen::commitRegions(const Rect* regions, size_t numRegions)
+{
+    if (numRegions != 0) {
+        commit();
+    }
+}
+
 void Screen::drawGlyph (
     int32_t x, int32_t y,
     const uint8_t* d, uint8_t w, uint8_t h,
     uint16_t scale,
     const Color& color
 ) {
+    if (!d) {
+        return;
+    }
+
+    const GlyphCache::Run* runs;
+    size_t numRuns;
+    if (GlyphCache::getInstance().get(d, w, h, runs, numRuns)) {
+        for (size_t i = 0 ; i < numRuns ; i++) {
+            const GlyphCache::Run& r = runs[i];
+            drawRect(x + r.x*scale, y + r.y*scale, r.w*scale, r.h*scale, color, true);
+        }
+        return;
+    }
+
     const uint8_t byteW = (w+7) / 8;
     int32_t py = y;
     for (uint8_t oy = 0 ; oy < h ; oy++) {
@@ -82,7 +402,7 @@ void Screen::drawTextCenteredTC(const Text& text, int32_t px, int32_t py)
 {
     const int32_t pxStart = px;
 
-    const std::string& str = text.getText();
+    const std::vector<uint16_t>& str = text.getCodePoints();
     const Font& font = text.getFont();
 
     const uint8_t glyphWidth = font.getGlyphWidth();
@@ -93,16 +413,13 @@ void Screen::drawTextCenteredTC(const Text& text, int32_t px, int32_t py)
     const int32_t scaledGlyphWidth = static_cast<int32_t>(glyphWidth)*scaleFactor;
     const int32_t scaledGlyphHeight = static_cast<int32_t>(glyphHeight)*scaleFactor;
 
-    const char* cptr = str.data();
-    const char* cptrEnd = cptr + str.length();
+    const uint16_t* cptr = str.data();
+    const uint16_t* cptrEnd = cptr + str.size();
 
-    const char* eolPtr;
+    const uint16_t* eolPtr;
     do {
         // Find end of line
-        eolPtr = static_cast<const char*>(memchr(cptr, '\n', cptrEnd-cptr));
-        if (!eolPtr) {
-            eolPtr = cptrEnd;
-        }
+        eolPtr = std::find(cptr, cptrEnd, '\n');
 
         // Calculate line width
         size_t lineNumChars = eolPtr - cptr;
@@ -111,7 +428,7 @@ void Screen::drawTextCenteredTC(const Text& text, int32_t px, int32_t py)
         // Draw single line
         px = pxStart - lineWidth/2;
         while (cptr != eolPtr) {
-            const char c = *cptr;
+            const uint16_t c = *cptr;
             drawGlyph(px, py, font.getGlyphBuffer(c), glyphWidth, glyphHeight, scaleFactor, color);
             px += scaledGlyphWidth;
             cptr++;
@@ -1,17 +1,28 @@
 #pragma once
 
 #include "../Globals.h"
+#include "../util/Rect.h"
 #include "Bitmap.h"
 #include "Color.h"
+#include "IndexedBitmap.h"
 #include "Text.h"
 
+#include <algorithm>
+#include <cmath>
+
 
 namespace MINTGGGameEngine
 {
 
+class ScreenRecorder;
+class WorkerTask;
+
 class Screen
 {
 public:
+    Screen() : hasClip(false), recorder(nullptr) {}
+    virtual ~Screen() {}
+
     virtual uint16_t getWidth() const = 0;
     virtual uint16_t getHeight() const = 0;
 
@@ -22,15 +33,237 @@ public:
     virtual void drawCircle(int32_t cx, int32_t cy, int32_t r, const Color& color, bool filled = false) = 0;
     virtual void drawBitmap(int32_t x, int32_t y, const Bitmap& bitmap, FlipDir flipDir = FlipDir::None) = 0;
 
+    /**
+     * \brief Draw a palette-indexed bitmap.
+     *
+     * The indices are expanded through the bitmap's palette while drawing.
+     * Transparent pixels are skipped. The default implementation uses
+     * drawPixel(), so screens with direct access to their frame buffer should
+     * override it with drawIndexedBitmapHelper().
+     */
+    virtual void drawIndexedBitmap(int32_t x, int32_t y, const IndexedBitmap& bitmap, FlipDir flipDir = FlipDir::None);
+
+    /**
+     * \brief Draw a bitmap scaled and rotated around its center.
+     *
+     * Pixels are picked by nearest neighbour, and the mask is honored. Nothing
+     * is allocated, so this can be used for zoom effects and rotating sprites
+     * every frame. Bitmaps must be smaller than 32768 pixels in both
+     * directions.
+     *
+     * The default implementation uses drawPixel(), so screens with direct
+     * access to their frame buffer should override it with
+     * drawBitmapTransformedHelper().
+     *
+     * \param cx The x coordinate of the bitmap's center on the screen.
+     * \param cy The y coordinate of the bitmap's center on the screen.
+     * \param bitmap The bitmap.
+     * \param scaleX The horizontal scale factor. Negative values flip the
+     *      bitmap horizontally.
+     * \param scaleY The vertical scale factor. Negative values flip the
+     *      bitmap vertically.
+     * \param angle The clockwise rotation, in radians.
+     */
+    virtual void drawBitmapTransformed (
+        float cx, float cy,
+        const Bitmap& bitmap,
+        float scaleX, float scaleY,
+        float angle = 0.0f
+        );
+
+    /**
+     * \brief Draw a bitmap blended over the current screen contents.
+     *
+     * The opacity of each pixel is its alpha value (see Bitmap::getAlpha()),
+     * or fully opaque for bitmaps without an alpha plane, multiplied by the
+     * global alpha. Masked-out pixels are never drawn. This allows shadows,
+     * glows and antialiased edges, and with the global alpha, fading whole
+     * bitmaps in and out.
+     *
+     * Colors are blended with 5 bits of precision, which is all that RGB565
+     * has for red and blue anyway.
+     *
+     * The default implementation uses readPixel() and drawPixel(), so screens
+     * with direct access to their frame buffer should override it with
+     * drawBitmapBlendedHelper().
+     *
+     * \param x The left edge on the screen.
+     * \param y The top edge on the screen.
+     * \param bitmap The bitmap.
+     * \param alpha The global alpha, from 0 (invisible) to 255 (only the
+     *      bitmap's own alpha).
+     * \param flipDir The direction to flip the bitmap in.
+     */
+    virtual void drawBitmapBlended (
+        int32_t x, int32_t y,
+        const Bitmap& bitmap,
+        uint8_t alpha = 255,
+        FlipDir flipDir = FlipDir::None
+        );
+
+    /**
+     * \brief Fill a list of rectangles with a single color.
+     *
+     * This draws shapes that were rasterized in advance, like circle sprites
+     * (see Sprite::createCircle()). The default implementation calls
+     * drawRect() for every rectangle, so screens with direct access to their
+     * frame buffer should override it.
+     *
+     * \param x The x offset of all rectangles on the screen.
+     * \param y The y offset of all rectangles on the screen.
+     * \param rects The rectangles.
+     * \param numRects The number of rectangles.
+     * \param color The color.
+     */
+    virtual void fillRects(int32_t x, int32_t y, const Rect* rects, size_t numRects, const Color& color);
+
+    /**
+     * \brief Return the pixels that drawBitmapTransformed() may cover.
+     */
+    static Rect calcTransformedBounds (
+        float cx, float cy,
+        uint16_t w, uint16_t h,
+        float scaleX, float scaleY,
+        float angle
+        );
+
     virtual Color readPixel(int32_t x, int32_t y) = 0;
 
+    /**
+     * \brief Read a rectangle of pixels from the screen.
+     *
+     * The default implementation uses readPixel(), so screens with direct
+     * access to their frame buffer should override it.
+     *
+     * \param rect The rectangle to read. It must lie within the screen.
+     * \param out Receives the pixels, in pixel order (see Color::toPixel()).
+     * \param outStride The distance between two rows of out, in pixels.
+     */
+    virtual void readRegion(const Rect& rect, uint16_t* out, size_t outStride);
+
     virtual void drawText(const Text& text, int32_t ox = 0, int32_t oy = 0);
 
+    /**
+     * \brief Save the current screen contents to a 24-bit BMP file.
+     *
+     * The screen is read a block of rows at a time (see readRegion()) and
+     * written while reading, so no full copy of the screen is needed.
+     *
+     * Screens that draw into a buffer only hold the current frame between
+     * drawing it and commit(), so that's when screenshots should be taken.
+     * Screens that swap buffers on commit() (e.g. ScreenHAGL with async
+     * flush) hold an older frame after commit(), until it's drawn over.
+     *
+     * Screens that draw in bands (see getBandHeight()) never hold the whole
+     * frame, so screenshots fail on them.
+     *
+     * \return true if successful, false otherwise.
+     * \see saveScreenshotAsync()
+     */
     virtual bool saveScreenshot(const char* path);
+
+    /**
+     * \brief Save the current screen contents to a BMP file in the background.
+     *
+     * The screen is copied into memory, which is all that the calling task has
+     * to wait for. The file is written by a work item on the worker task.
+     *
+     * \param path The file path.
+     * \param worker A started worker task.
+     * \return true if the copy was made and the work item queued, false if
+     *      there is not enough memory or the screen draws in bands (see
+     *      saveScreenshot()). Errors while writing are only logged.
+     */
+    bool saveScreenshotAsync(const char* path, WorkerTask& worker);
+
+    /**
+     * \brief Restrict all drawing operations to the given rectangle.
+     *
+     * This includes fillScreen(), which only fills the clip rectangle.
+     *
+     * \param rect The clip rectangle in screen coordinates.
+     */
+    virtual void setClipRect(const Rect& rect);
+
+    /**
+     * \brief Allow drawing on the entire screen again.
+     */
+    virtual void resetClipRect();
+
+    /**
+     * \brief Return the current clip rectangle (the entire screen if not set).
+     */
+    Rect getClipRect() const { return hasClip ? clipRect : Rect(0, 0, getWidth(), getHeight()); }
+
+    /**
+     * \brief Check if the screen keeps its contents between frames, so that
+     *      only changed regions need to be redrawn before commitRegions().
+     */
+    virtual bool supportsPartialRedraw() const { return false; }
     
     virtual void commit() = 0;
 
+    /**
+     * \brief Send only the given regions of the screen to the display.
+     *
+     * The default implementation calls commit() if any regions are given.
+     *
+     * \param regions The regions to send, in screen coordinates. They should
+     *      not overlap.
+     * \param numRegions The number of regions. If 0, nothing is sent.
+     */
+    virtual void commitRegions(const Rect* regions, size_t numRegions);
+
+    /**
+     * \brief Return the height of the bands that a frame is drawn in, or 0 if
+     *      the screen has a full frame buffer.
+     *
+     * Screens that only have a small strip buffer draw each frame as a
+     * series of horizontal bands. For every band, beginBand() is called, then
+     * everything on the screen is drawn again (only the parts inside the band
+     * are actually drawn), and then commitBand() sends the band to the
+     * display. Game::draw() does this automatically.
+     */
+    virtual uint16_t getBandHeight() const { return 0; }
+
+    /**
+     * \brief Start drawing the band beginning at the given row.
+     *
+     * All drawing is clipped to the band until commitBand() is called.
+     * Coordinates are still screen coordinates.
+     *
+     * \param y The first row of the band. Should be a multiple of
+     *      getBandHeight().
+     */
+    virtual void beginBand(int32_t y) {}
+
+    /**
+     * \brief Send the current band to the display.
+     *
+     * This also resets the clip rectangle.
+     */
+    virtual void commitBand() {}
+
+    /**
+     * \brief Pass every committed frame to the given recorder.
+     *
+     * Called by ScreenRecorder::start() and ScreenRecorder::stop().
+     *
+     * \param recorder The recorder, or null to stop recording.
+     */
+    void setRecorder(ScreenRecorder* recorder) { this->recorder = recorder; }
+
+    ScreenRecorder* getRecorder() const { return recorder; }
+
 protected:
+    /**
+     * \brief Pass committed rows to the recorder, if any.
+     *
+     * Display backends call this in commit(), commitRegions() and
+     * commitBand(), before the rows are sent or the buffer is swapped.
+     */
+    void recordRows(int32_t y, int32_t numRows);
+
     virtual void drawGlyph (
         int32_t x, int32_t y,
         const uint8_t* d, uint8_t w, uint8_t h,
@@ -38,130 +271,530 @@ protected:
         const Color& color
         );
 
-    template <typename DrawPixelT, typename DrawPixelsT, typename ContextT>
+    /**
+     * \brief Copy a bitmap into a frame buffer.
+     *
+     * The flip direction and the kind of mask are dispatched once per call, to
+     * a kernel that is specialized for them (see blitBitmapRows()).
+     *
+     * \param pixelRow Called as pixelRow(context, y), returns a pointer to the
+     *      frame buffer's pixel at column 0 of screen row y.
+     */
+    template <typename PixelRowT, typename ContextT>
     void drawBitmapHelper (
         int32_t x, int32_t y,
         const Bitmap& bitmap,
         FlipDir flipDir,
+        PixelRowT pixelRow,
+        ContextT context
+        );
+
+    template <typename DrawPixelT, typename DrawPixelsT, typename ContextT>
+    void drawBitmapTransformedHelper (
+        float cx, float cy,
+        const Bitmap& bitmap,
+        float scaleX, float scaleY,
+        float angle,
+        DrawPixelT drawPixel,
+        DrawPixelsT drawPixels,
+        ContextT userPtr
+        );
+
+    /**
+     * \brief Blend a bitmap into a frame buffer.
+     *
+     * \param pixelRow Called as pixelRow(context, y), returns a pointer to the
+     *      frame buffer's pixel at column 0 of screen row y.
+     */
+    template <typename PixelRowT, typename ContextT>
+    void drawBitmapBlendedHelper (
+        int32_t x, int32_t y,
+        const Bitmap& bitmap,
+        uint8_t alpha,
+        FlipDir flipDir,
+        PixelRowT pixelRow,
+        ContextT context
+        );
+
+    /**
+     * \brief Blend a row of pixels over a row of a frame buffer.
+     *
+     * Two pixels are loaded and stored as one 32-bit word wherever the
+     * alignment of both rows allows it.
+     *
+     * \param dst The frame buffer pixels.
+     * \param src The pixels to blend over them.
+     * \param srcAlpha The alpha of each pixel in src, or null if all of them
+     *      are opaque.
+     * \param n The number of pixels.
+     * \param alpha The global alpha, multiplied with srcAlpha.
+     */
+    static void blendPixelRow(uint16_t* dst, const uint16_t* src, const uint8_t* srcAlpha, int32_t n, uint8_t alpha);
+
+    template <typename DrawPixelT, typename DrawPixelsT, typename ContextT>
+    void drawIndexedBitmapHelper (
+        int32_t x, int32_t y,
+        const IndexedBitmap& bitmap,
+        FlipDir flipDir,
         DrawPixelT drawPixel,
         DrawPixelsT drawPixels,
         ContextT userPtr
         );
 
 private:
+    enum class BlitMask
+    {
+        None,   ///< No mask, whole rows are copied.
+        Spans,  ///< The bitmap's opaque runs (see Bitmap::buildSpans()) are copied.
+        Bits    ///< The mask bit of each pixel is tested.
+    };
+
+    /**
+     * \brief Copy the clipped part of a bitmap, row by row.
+     *
+     * Vertical flipping only changes the order of the bitmap rows, so it is
+     * not part of the specialization.
+     *
+     * \param r The screen rectangle to draw into, already clipped.
+     * \param bxLo The first bitmap column to copy, in unflipped coordinates.
+     * \param by The bitmap row that goes to screen row r.y.
+     * \param byStep 1, or -1 if the bitmap is flipped vertically.
+     */
+    template <bool flipX, BlitMask mask, typename PixelRowT, typename ContextT>
+    static void blitBitmapRows (
+        const Bitmap& bitmap,
+        const Rect& r,
+        int32_t bxLo,
+        int32_t by, int32_t byStep,
+        PixelRowT pixelRow,
+        ContextT context
+        );
+
+    /**
+     * \brief Copy n pixels in reverse order, i.e. dst[i] = src[n-1-i].
+     *
+     * Two pixels are moved per 32-bit word if both rows have the same
+     * alignment.
+     */
+    static void copyPixelsReversed(uint16_t* dst, const uint16_t* src, int32_t n);
+
     template <bool forward>
     void drawTextLinear(const Text& text, int32_t px, int32_t py);
 
     void drawTextCenteredTC(const Text& text, int32_t px, int32_t py);
+
+protected:
+    Rect clipRect;
+    bool hasClip;
+    ScreenRecorder* recorder;
 };
 
 
-template <typename DrawPixelT, typename DrawPixelsT, typename ContextT>
+template <typename PixelRowT, typename ContextT>
 void Screen::drawBitmapHelper (
     int32_t x, int32_t y,
     const Bitmap& bitmap,
     FlipDir flipDir,
-    DrawPixelT drawPixel,
-    DrawPixelsT drawPixels,
+    PixelRowT pixelRow,
     ContextT context
 ) {
-    const uint16_t sw = getWidth();
-    const uint16_t sh = getHeight();
+    const int32_t w = bitmap.getWidth();
+    const int32_t h = bitmap.getHeight();
+    const uint8_t* m = bitmap.getMask();
+
+    if (!bitmap.getData()) {
+        return;
+    }
+
+    const Rect r = getClipRect().intersected(Rect(x, y, w, h));
+    if (r.isEmpty()) {
+        return;
+    }
 
-    const uint16_t w = bitmap.getWidth();
-    const uint16_t h = bitmap.getHeight();
+    const bool flipX = flipDir == FlipDir::Horizontal  ||  flipDir == FlipDir::Both;
+    const bool flipY = flipDir == FlipDir::Vertical  ||  flipDir == FlipDir::Both;
+
+    // The clipped part in bitmap columns is [bxLo, bxLo+r.w). Column bx lands
+    // on screen column x+bx, or x+w-1-bx if mirrored.
+    const int32_t bxLo = flipX ? x+w-r.getRight() : r.x-x;
+    const int32_t by = flipY ? h-1-(r.y-y) : r.y-y;
+    const int32_t byStep = flipY ? -1 : 1;
+
+    if (!m) {
+        if (flipX) {
+            blitBitmapRows<true, BlitMask::None>(bitmap, r, bxLo, by, byStep, pixelRow, context);
+        } else {
+            blitBitmapRows<false, BlitMask::None>(bitmap, r, bxLo, by, byStep, pixelRow, context);
+        }
+    } else if (bitmap.hasSpans()) {
+        if (flipX) {
+            blitBitmapRows<true, BlitMask::Spans>(bitmap, r, bxLo, by, byStep, pixelRow, context);
+        } else {
+            blitBitmapRows<false, BlitMask::Spans>(bitmap, r, bxLo, by, byStep, pixelRow, context);
+        }
+    } else {
+        if (flipX) {
+            blitBitmapRows<true, BlitMask::Bits>(bitmap, r, bxLo, by, byStep, pixelRow, context);
+        } else {
+            blitBitmapRows<false, BlitMask::Bits>(bitmap, r, bxLo, by, byStep, pixelRow, context);
+        }
+    }
+}
 
+template <bool flipX, Screen::BlitMask mask, typename PixelRowT, typename ContextT>
+void Screen::blitBitmapRows (
+    const Bitmap& bitmap,
+    const Rect& r,
+    int32_t bxLo,
+    int32_t by, int32_t byStep,
+    PixelRowT pixelRow,
+    ContextT context
+) {
+    const uint16_t* d = bitmap.getData();
+    const uint8_t* m = bitmap.getMask();
+    const int32_t stride = bitmap.getStride();
+    const uint16_t maskStride = bitmap.getMaskStride();
+    const int32_t mo = bitmap.getMaskBitOffset();
+    const int32_t bxHi = bxLo + r.w;
+
+    for (int32_t sy = r.y ; sy < r.getBottom() ; sy++, by += byStep) {
+        const uint16_t* drow = d + by*stride;
+        uint16_t* row = pixelRow(context, sy) + r.x;
+
+        if (mask == BlitMask::None) {
+            if (flipX) {
+                copyPixelsReversed(row, drow + bxLo, r.w);
+            } else {
+                memcpy(row, drow + bxLo, r.w*sizeof(uint16_t));
+            }
+        } else if (mask == BlitMask::Spans) {
+            size_t numSpans;
+            const uint16_t* span = bitmap.getSpans(by, numSpans);
+            for (; numSpans != 0  &&  span[0] < bxHi ; numSpans--, span += 2) {
+                const int32_t s = std::max<int32_t>(span[0], bxLo);
+                const int32_t e = std::min<int32_t>(span[0]+span[1], bxHi);
+                if (s >= e) {
+                    continue;
+                }
+                if (flipX) {
+                    copyPixelsReversed(row + (bxHi-e), drow + s, e-s);
+                } else {
+                    memcpy(row + (s-bxLo), drow + s, (e-s)*sizeof(uint16_t));
+                }
+            }
+        } else {
+            // Whole mask bytes are tested at once where possible, so that groups
+            // of 8 fully transparent or opaque pixels need no test per pixel.
+            const uint8_t* mrow = m + by*maskStride;
+            uint16_t* dst = flipX ? row + r.w-1 : row;
+            for (int32_t bx = bxLo ; bx < bxHi ;) {
+                const int32_t bit = bx + mo;
+                const uint8_t mbyte = mrow[bit>>3];
+                if ((bit&7) == 0  &&  bxHi-bx >= 8  &&  (mbyte == 0x00  ||  mbyte == 0xFF)) {
+                    if (mbyte == 0xFF) {
+                        if (flipX) {
+                            copyPixelsReversed(dst-7, drow + bx, 8);
+                        } else {
+                            memcpy(dst, drow + bx, 8*sizeof(uint16_t));
+                        }
+                    }
+                    bx += 8;
+                    dst += flipX ? -8 : 8;
+                    continue;
+                }
+                if (mbyte & (0x80 >> (bit&7))) {
+                    *dst = drow[bx];
+                }
+                bx++;
+                dst += flipX ? -1 : 1;
+            }
+        }
+    }
+}
+
+template <typename DrawPixelT, typename DrawPixelsT, typename ContextT>
+void Screen::drawBitmapTransformedHelper (
+    float cx, float cy,
+    const Bitmap& bitmap,
+    float scaleX, float scaleY,
+    float angle,
+    DrawPixelT drawPixel,
+    DrawPixelsT drawPixels,
+    ContextT context
+) {
+    const int32_t w = bitmap.getWidth();
+    const int32_t h = bitmap.getHeight();
     const uint16_t* d = bitmap.getData();
     const uint8_t* m = bitmap.getMask();
 
-    if (!d) {
+    if (!d  ||  scaleX == 0.0f  ||  scaleY == 0.0f) {
         return;
     }
 
-    int32_t byStart, byEnd, byStep;
-    int32_t bxStart, bxEnd, bxStep;
-    if (flipDir == FlipDir::None) {
-        byStart = 0;
-        byEnd = h;
-        byStep = 1;
-        bxStart = 0;
-        bxEnd = w;
-        bxStep = 1;
-    } else if (flipDir == FlipDir::Horizontal) {
-        byStart = 0;
-        byEnd = h;
-        byStep = 1;
-        bxStart = w-1;
-        bxEnd = -1;
-        bxStep = -1;
-    } else if (flipDir == FlipDir::Vertical) {
-        byStart = h-1;
-        byEnd = -1;
-        byStep = -1;
-        bxStart = 0;
-        bxEnd = w;
-        bxStep = 1;
-    } else {
-        byStart = h-1;
-        byEnd = -1;
-        byStep = -1;
-        bxStart = w-1;
-        bxEnd = -1;
-        bxStep = -1;
+    const Rect bounds = calcTransformedBounds(cx, cy, w, h, scaleX, scaleY, angle);
+    const Rect r = getClipRect().intersected(bounds);
+    if (r.isEmpty()) {
+        return;
+    }
+
+    const int32_t stride = bitmap.getStride();
+    const uint16_t maskStride = bitmap.getMaskStride();
+    const int32_t mo = bitmap.getMaskBitOffset();
+
+    // Inverse mapping from screen to bitmap pixels, in 16.16 fixed point. Going
+    // one pixel right on the screen moves (du/dx, dv/dx) in the bitmap, going
+    // one pixel down moves (du/dy, dv/dy).
+    const float c = cosf(angle);
+    const float s = sinf(angle);
+    const int32_t dudx = static_cast<int32_t>(lroundf(c/scaleX * 65536.0f));
+    const int32_t dvdx = static_cast<int32_t>(lroundf(-s/scaleY * 65536.0f));
+    const int32_t dudy = static_cast<int32_t>(lroundf(s/scaleX * 65536.0f));
+    const int32_t dvdy = static_cast<int32_t>(lroundf(c/scaleY * 65536.0f));
+
+    // Bitmap position of the center of pixel (r.x, r.y). It is stepped from
+    // the unclipped corner, so that the result doesn't depend on the clip
+    // rectangle (e.g. when drawing in bands).
+    const float dx = bounds.x + 0.5f - cx;
+    const float dy = bounds.y + 0.5f - cy;
+    int64_t uRow = static_cast<int64_t>(llroundf((w*0.5f + (c*dx + s*dy)/scaleX) * 65536.0f))
+            + static_cast<int64_t>(dudx)*(r.x-bounds.x) + static_cast<int64_t>(dudy)*(r.y-bounds.y);
+    int64_t vRow = static_cast<int64_t>(llroundf((h*0.5f + (-s*dx + c*dy)/scaleY) * 65536.0f))
+            + static_cast<int64_t>(dvdx)*(r.x-bounds.x) + static_cast<int64_t>(dvdy)*(r.y-bounds.y);
+
+    // Narrows [kMin, kMax] to the steps k for which 0 <= p0 + k*dp < limit.
+    auto clipSpan = [](int64_t p0, int32_t dp, int64_t limit, int32_t& kMin, int32_t& kMax) {
+        auto floorDiv = [](int64_t a, int64_t b) { return a >= 0 ? a/b : -((-a+b-1) / b); };
+        if (dp == 0) {
+            if (p0 < 0  ||  p0 >= limit) {
+                kMax = kMin-1;
+            }
+        } else if (dp > 0) {
+            kMin = static_cast<int32_t>(std::max<int64_t>(kMin, -floorDiv(p0, dp)));
+            kMax = static_cast<int32_t>(std::min<int64_t>(kMax, floorDiv(limit-1-p0, dp)));
+        } else {
+            kMin = static_cast<int32_t>(std::max<int64_t>(kMin, -floorDiv(limit-1-p0, -dp)));
+            kMax = static_cast<int32_t>(std::min<int64_t>(kMax, floorDiv(p0, -dp)));
+        }
+    };
+
+    uint16_t buf[64];
+    auto flushRun = [&](int32_t runX, int32_t sy, int32_t n) {
+        if (drawPixels) {
+            drawPixels(context, runX, sy, buf, n);
+        } else {
+            for (int32_t i = 0 ; i < n ; i++) {
+                drawPixel(context, runX+i, sy, buf[i]);
+            }
+        }
+    };
+
+    for (int32_t sy = r.y ; sy < r.getBottom() ; sy++, uRow += dudy, vRow += dvdy) {
+        // Only the part of the row that maps into the bitmap, so that the
+        // inner loop needs no bounds checks
+        int32_t kMin = 0;
+        int32_t kMax = r.w-1;
+        clipSpan(uRow, dudx, static_cast<int64_t>(w) << 16, kMin, kMax);
+        clipSpan(vRow, dvdx, static_cast<int64_t>(h) << 16, kMin, kMax);
+        if (kMin > kMax) {
+            continue;
+        }
+
+        int32_t u = static_cast<int32_t>(uRow + static_cast<int64_t>(dudx)*kMin);
+        int32_t v = static_cast<int32_t>(vRow + static_cast<int64_t>(dvdx)*kMin);
+        int32_t runX = r.x + kMin;
+        int32_t n = 0;
+        for (int32_t sx = r.x + kMin ; sx <= r.x + kMax ; sx++, u += dudx, v += dvdx) {
+            const int32_t bx = u >> 16;
+            const int32_t by = v >> 16;
+            if (m) {
+                const int32_t bit = bx + mo;
+                if (!(m[by*maskStride + (bit>>3)] & (0x80 >> (bit&7)))) {
+                    if (n != 0) {
+                        flushRun(runX, sy, n);
+                        n = 0;
+                    }
+                    runX = sx+1;
+                    continue;
+                }
+            }
+            buf[n++] = d[by*stride + bx];
+            if (n == sizeof(buf)/sizeof(buf[0])) {
+                flushRun(runX, sy, n);
+                n = 0;
+                runX = sx+1;
+            }
+        }
+        if (n != 0) {
+            flushRun(runX, sy, n);
+        }
+    }
+}
+
+template <typename PixelRowT, typename ContextT>
+void Screen::drawBitmapBlendedHelper (
+    int32_t x, int32_t y,
+    const Bitmap& bitmap,
+    uint8_t alpha,
+    FlipDir flipDir,
+    PixelRowT pixelRow,
+    ContextT context
+) {
+    const int32_t w = bitmap.getWidth();
+    const int32_t h = bitmap.getHeight();
+    const uint16_t* d = bitmap.getData();
+    const uint8_t* m = bitmap.getMask();
+    const uint8_t* a = bitmap.getAlpha();
+
+    if (!d  ||  alpha == 0) {
+        return;
     }
 
-    if (x >= sw  ||  x+w < 0  ||  y >= sh  ||  y+h < 0) {
-        // Bitmap is completely off-screen
+    const Rect r = getClipRect().intersected(Rect(x, y, w, h));
+    if (r.isEmpty()) {
         return;
     }
 
-    if (x < 0) {
-        // Left side of bitmap is off-screen
-        bxStart -= x*bxStep;
-        x = 0;
-    } else if (x+w > sw) {
-        // Right side of bitmap is off-screen
-        bxEnd -= (x+w-sw)*bxStep;
-    }
-    if (y < 0) {
-        // Top side of bitmap is off-screen
-        byStart -= y*byStep;
-        y = 0;
-    } else if (y+h > sh) {
-        // Bottom side of bitmap is off-screen
-        byEnd -= (y+h-sh)*byStep;
-    }
-
-    const int32_t origX = x;
-
-    if (m) {
-        uint16_t mw = (w+7) / 8;
-        for (int32_t by = byStart ; by != byEnd ; by += byStep, y++) {
-            const uint16_t* dptr = d + (by*w) + bxStart;
-            const uint8_t* mptr = m + by*mw;
-            x = origX;
-            for (int32_t bx = bxStart ; bx != bxEnd ; bx += bxStep, x++) {
-                if (mptr[bx>>3] & (0x80 >> (bx&7))) {
-                    drawPixel(context, x, y, *dptr);
+    const int32_t stride = bitmap.getStride();
+    const uint16_t maskStride = bitmap.getMaskStride();
+    const int32_t mo = bitmap.getMaskBitOffset();
+    const bool flipX = flipDir == FlipDir::Horizontal  ||  flipDir == FlipDir::Both;
+    const bool flipY = flipDir == FlipDir::Vertical  ||  flipDir == FlipDir::Both;
+    const bool useSpans = m  &&  bitmap.hasSpans();
+
+    // The clipped part in bitmap columns is [bxLo, bxHi). Column bx lands on
+    // screen column x+bx, or x+w-1-bx if mirrored.
+    const int32_t bxLo = flipX ? x+w-r.getRight() : r.x-x;
+    const int32_t bxHi = bxLo + r.w;
+
+    uint16_t buf[64];
+    uint8_t abuf[64];
+    auto blendRun = [&](uint16_t* row, const uint16_t* drow, const uint8_t* arow, int32_t s, int32_t e) {
+        if (!flipX) {
+            blendPixelRow(row + x + s, drow + s, arow ? arow + s : nullptr, e-s, alpha);
+            return;
+        }
+        // Mirror the run through small buffers
+        int32_t sx = x + w - e;
+        for (int32_t bx = e ; bx > s ;) {
+            const int32_t n = std::min<int32_t>(bx-s, 64);
+            for (int32_t i = 0 ; i < n ; i++) {
+                bx--;
+                buf[i] = drow[bx];
+                if (arow) {
+                    abuf[i] = arow[bx];
                 }
-                dptr += bxStep;
             }
+            blendPixelRow(row + sx, buf, arow ? abuf : nullptr, n, alpha);
+            sx += n;
         }
-    } else {
-        if (drawPixels  &&  bxStep == 1) {
-            for (int32_t by = byStart ; by != byEnd ; by += byStep, y++) {
-                const uint16_t* dptr = d + (by*w) + bxStart;
-                drawPixels(context, x, y, dptr, bxEnd-bxStart);
+    };
+
+    for (int32_t sy = r.y ; sy < r.getBottom() ; sy++) {
+        const int32_t by = flipY ? h-1-(sy-y) : sy-y;
+        const uint16_t* drow = d + by*stride;
+        const uint8_t* arow = a ? a + by*stride : nullptr;
+        uint16_t* row = pixelRow(context, sy);
+
+        if (useSpans) {
+            size_t numSpans;
+            const uint16_t* span = bitmap.getSpans(by, numSpans);
+            for (; numSpans != 0  &&  span[0] < bxHi ; numSpans--, span += 2) {
+                const int32_t s = std::max<int32_t>(span[0], bxLo);
+                const int32_t e = std::min<int32_t>(span[0]+span[1], bxHi);
+                if (s < e) {
+                    blendRun(row, drow, arow, s, e);
+                }
             }
+        } else if (m) {
+            const uint8_t* mrow = m + by*maskStride;
+            auto isSet = [&](int32_t bx) { return (mrow[(bx+mo)>>3] & (0x80 >> ((bx+mo)&7))) != 0; };
+            int32_t bx = bxLo;
+            while (bx < bxHi) {
+                if (!isSet(bx)) {
+                    bx++;
+                    continue;
+                }
+                const int32_t s = bx;
+                while (bx < bxHi  &&  isSet(bx)) {
+                    bx++;
+                }
+                blendRun(row, drow, arow, s, bx);
+            }
+        } else {
+            blendRun(row, drow, arow, bxLo, bxHi);
+        }
+    }
+}
+
+template <typename DrawPixelT, typename DrawPixelsT, typename ContextT>
+void Screen::drawIndexedBitmapHelper (
+    int32_t x, int32_t y,
+    const IndexedBitmap& bitmap,
+    FlipDir flipDir,
+    DrawPixelT drawPixel,
+    DrawPixelsT drawPixels,
+    ContextT context
+) {
+    const int32_t w = bitmap.getWidth();
+    const int32_t h = bitmap.getHeight();
+    const uint8_t* indices = bitmap.getIndices();
+    const Palette& palette = bitmap.getPalette();
+
+    if (!indices  ||  !palette) {
+        return;
+    }
+
+    const Rect r = getClipRect().intersected(Rect(x, y, w, h));
+    if (r.isEmpty()) {
+        return;
+    }
+
+    const uint16_t* lut = palette.getPixels();
+    const uint16_t numColors = palette.getSize();
+    const int32_t transparent = palette.getTransparentIndex();
+    const uint8_t bpp = bitmap.getBitsPerPixel();
+    const size_t bytesPerLine = bitmap.getBytesPerLine();
+    const bool flipX = flipDir == FlipDir::Horizontal  ||  flipDir == FlipDir::Both;
+    const bool flipY = flipDir == FlipDir::Vertical  ||  flipDir == FlipDir::Both;
+    const int32_t bxStep = flipX ? -1 : 1;
+
+    // Opaque runs are expanded into a small buffer, and then copied as a whole
+    uint16_t buf[64];
+    auto flushRun = [&](int32_t runX, int32_t sy, int32_t n) {
+        if (drawPixels) {
+            drawPixels(context, runX, sy, buf, n);
         } else {
-            for (int32_t by = byStart ; by != byEnd ; by += byStep, y++) {
-                const uint16_t* dptr = d + (by*w) + bxStart;
-                x = origX;
-                for (int32_t bx = bxStart ; bx != bxEnd ; bx += bxStep, x++) {
-                    drawPixel(context, x, y, *dptr);
-                    dptr += bxStep;
+            for (int32_t i = 0 ; i < n ; i++) {
+                drawPixel(context, runX+i, sy, buf[i]);
+            }
+        }
+    };
+
+    for (int32_t sy = r.y ; sy < r.getBottom() ; sy++) {
+        const int32_t by = flipY ? h-1-(sy-y) : sy-y;
+        const uint8_t* row = indices + by*bytesPerLine;
+        int32_t bx = flipX ? w-1-(r.x-x) : r.x-x;
+        int32_t runX = r.x;
+        int32_t n = 0;
+        for (int32_t sx = r.x ; sx < r.getRight() ; sx++, bx += bxStep) {
+            const uint8_t idx = IndexedBitmap::unpackIndex(row, bx, bpp);
+            if (idx == transparent  ||  idx >= numColors) {
+                if (n != 0) {
+                    flushRun(runX, sy, n);
+                    n = 0;
                 }
+                runX = sx+1;
+                continue;
             }
+            buf[n++] = lut[idx];
+            if (n == sizeof(buf)/sizeof(buf[0])) {
+                flushRun(runX, sy, n);
+                n = 0;
+                runX = sx+1;
+            }
+        }
+        if (n != 0) {
+            flushRun(runX, sy, n);
         }
     }
 }
@@ -169,15 +802,15 @@ void Screen::drawBitmapHelper (
 template <bool forward>
 void Screen::drawTextLinear(const Text& text, int32_t px, int32_t py)
 {
-    const std::string& str = text.getText();
-    const char* cptr;
-    const char* cptrEnd;
+    const std::vector<uint16_t>& str = text.getCodePoints();
+    const uint16_t* cptr;
+    const uint16_t* cptrEnd;
     if constexpr(forward) {
         cptr = str.data();
-        cptrEnd = cptr + str.length();
+        cptrEnd = cptr + str.size();
     } else {
         cptrEnd = str.data()-1;
-        cptr = cptrEnd + str.length();
+        cptr = cptrEnd + str.size();
     }
 
     const Font& font = text.getFont();
@@ -198,7 +831,7 @@ void Screen::drawTextLinear(const Text& text, int32_t px, int32_t py)
     const int32_t pxLineStart = px;
 
     while (cptr != cptrEnd) {
-        const char c = *cptr;
+        const uint16_t c = *cptr;
 
         if (c == '\n') {
             px = pxLineStart;
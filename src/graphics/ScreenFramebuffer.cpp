@@ -0,0 +1,433 @@
+#include "ScreenFramebuffer.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "../util/Log.h"
+#include "GlyphCache.h"
+
+
+LOG_USE_TAG("ScreenFramebuffer")
+
+
+namespace MINTGGGameEngine
+{
+
+
+static inline void StorePixelPair(uint16_t* p, uint32_t pair)
+{
+    memcpy(__builtin_assume_aligned(p, 4), &pair, 4);
+}
+
+
+ScreenFramebuffer::ScreenFramebuffer()
+    : width(0), height(0), buf(nullptr), bufY(0), bufRows(0), ownBuf(false), hasUserClip(false)
+{
+}
+
+ScreenFramebuffer::ScreenFramebuffer(uint16_t width, uint16_t height)
+    : ScreenFramebuffer()
+{
+    setSize(width, height);
+    auto b = static_cast<uint16_t*>(malloc(width*height*sizeof(uint16_t)));
+    if (!b) {
+        LogError("Unable to allocate %ux%u frame buffer.", (unsigned int) width, (unsigned int) height);
+        return;
+    }
+    setBuffer(b, 0, height);
+    ownBuf = true;
+}
+
+ScreenFramebuffer::~ScreenFramebuffer()
+{
+    if (ownBuf) {
+        free(buf);
+    }
+}
+
+void ScreenFramebuffer::setSize(uint16_t width, uint16_t height)
+{
+    this->width = width;
+    this->height = height;
+    updateClip();
+}
+
+void ScreenFramebuffer::setBuffer(uint16_t* buf, int32_t firstRow, uint16_t numRows)
+{
+    if (ownBuf) {
+        free(this->buf);
+        ownBuf = false;
+    }
+    this->buf = buf;
+    bufY = firstRow;
+    bufRows = buf ? numRows : 0;
+    updateClip();
+}
+
+void ScreenFramebuffer::setClipRect(const Rect& rect)
+{
+    userClip = rect;
+    hasUserClip = true;
+    updateClip();
+}
+
+void ScreenFramebuffer::resetClipRect()
+{
+    hasUserClip = false;
+    updateClip();
+}
+
+void ScreenFramebuffer::updateClip()
+{
+    // Screen::getClipRect() is used by all helpers, so it must never reach
+    // outside the buffer.
+    const Rect screen(0, 0, width, height);
+    const Rect buffered = screen.intersected(Rect(0, bufY, width, bufRows));
+    if (!hasUserClip  &&  buffered == screen) {
+        hasClip = false;
+    } else {
+        clipRect = hasUserClip ? buffered.intersected(userClip) : buffered;
+        hasClip = true;
+    }
+}
+
+void ScreenFramebuffer::fillPixels(uint16_t* p, int32_t n, uint16_t pixel)
+{
+    if (n <= 0) {
+        return;
+    }
+    if (reinterpret_cast<uintptr_t>(p) & 2) {
+        *p++ = pixel;
+        n--;
+    }
+    const uint32_t pair = pixel | (static_cast<uint32_t>(pixel) << 16);
+    for (; n >= 8 ; n -= 8, p += 8) {
+        StorePixelPair(p, pair);
+        StorePixelPair(p+2, pair);
+        StorePixelPair(p+4, pair);
+        StorePixelPair(p+6, pair);
+    }
+    for (; n >= 2 ; n -= 2, p += 2) {
+        StorePixelPair(p, pair);
+    }
+    if (n != 0) {
+        *p = pixel;
+    }
+}
+
+void ScreenFramebuffer::fillSpan(int32_t x0, int32_t x1, int32_t y, uint16_t pixel)
+{
+    const Rect clip = getClipRect();
+    if (y < clip.y  ||  y >= clip.getBottom()) {
+        return;
+    }
+    x0 = std::max(x0, clip.x);
+    x1 = std::min(x1, clip.getRight()-1);
+    if (x0 <= x1) {
+        fillPixels(getPixelRow(y) + x0, x1-x0+1, pixel);
+    }
+}
+
+void ScreenFramebuffer::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t pixel)
+{
+    const Rect r = getClipRect().intersected(Rect(x, y, w, h));
+    if (r.isEmpty()  ||  !buf) {
+        return;
+    }
+    if (r.x == 0  &&  r.w == width) {
+        // Whole rows are contiguous
+        fillPixels(getPixelRow(r.y), r.w*r.h, pixel);
+        return;
+    }
+    for (int32_t ry = r.y ; ry < r.getBottom() ; ry++) {
+        fillPixels(getPixelRow(ry) + r.x, r.w, pixel);
+    }
+}
+
+void ScreenFramebuffer::fillScreen(const Color& color)
+{
+    fillRect(0, 0, width, height, color.toPixel());
+}
+
+void ScreenFramebuffer::drawPixel(int32_t x, int32_t y, const Color& color)
+{
+    if (getClipRect().contains(x, y)) {
+        getPixelRow(y)[x] = color.toPixel();
+    }
+}
+
+void ScreenFramebuffer::drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, const Color& color)
+{
+    if (!buf) {
+        return;
+    }
+    const uint16_t pixel = color.toPixel();
+
+    if (y0 == y1) {
+        fillSpan(std::min(x0, x1), std::max(x0, x1), y0, pixel);
+        return;
+    }
+    if (x0 == x1) {
+        fillRect(x0, std::min(y0, y1), 1, std::abs(y1-y0)+1, pixel);
+        return;
+    }
+
+    const Rect clip = getClipRect();
+    if (clip.isEmpty()  ||  !clip.intersects(Rect(std::min(x0, x1), std::min(y0, y1), std::abs(x1-x0)+1, std::abs(y1-y0)+1))) {
+        return;
+    }
+
+    // Bresenham, walking the major axis
+    const int32_t dx = std::abs(x1-x0);
+    const int32_t dy = std::abs(y1-y0);
+    if (dx >= dy) {
+        // Mostly horizontal: Emit horizontal runs of pixels with the same y
+        if (x0 > x1) {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+        }
+        const int32_t sy = y1 > y0 ? 1 : -1;
+        int32_t err = dx/2;
+        int32_t runStart = x0;
+        int32_t y = y0;
+        for (int32_t x = x0 ; x <= x1 ; x++) {
+            err -= dy;
+            if (err < 0) {
+                fillSpan(runStart, x, y, pixel);
+                runStart = x+1;
+                y += sy;
+                err += dx;
+            }
+        }
+        if (runStart <= x1) {
+            fillSpan(runStart, x1, y, pixel);
+        }
+    } else {
+        if (y0 > y1) {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+        }
+        const int32_t sx = x1 > x0 ? 1 : -1;
+        int32_t err = dy/2;
+        int32_t x = x0;
+        for (int32_t y = y0 ; y <= y1 ; y++) {
+            if (clip.contains(x, y)) {
+                getPixelRow(y)[x] = pixel;
+            }
+            err -= dx;
+            if (err < 0) {
+                x += sx;
+                err += dy;
+            }
+        }
+    }
+}
+
+void ScreenFramebuffer::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, const Color& color, bool filled)
+{
+    if (w <= 0  ||  h <= 0) {
+        return;
+    }
+    const uint16_t pixel = color.toPixel();
+    if (filled  ||  w <= 2  ||  h <= 2) {
+        fillRect(x, y, w, h, pixel);
+        return;
+    }
+    fillRect(x, y, w, 1, pixel);
+    fillRect(x, y+h-1, w, 1, pixel);
+    fillRect(x, y+1, 1, h-2, pixel);
+    fillRect(x+w-1, y+1, 1, h-2, pixel);
+}
+
+void ScreenFramebuffer::drawCircle(int32_t cx, int32_t cy, int32_t r, const Color& color, bool filled)
+{
+    if (r < 0  ||  !buf) {
+        return;
+    }
+    const Rect clip = getClipRect();
+    if (!clip.intersects(Rect(cx-r, cy-r, 2*r+1, 2*r+1))) {
+        return;
+    }
+    const uint16_t pixel = color.toPixel();
+
+    // Midpoint circle, walking the octant from the top (x = 0, y = r) to the
+    // diagonal. Each step mirrors to eight points, or to four spans.
+    int32_t x = 0;
+    int32_t y = r;
+    int32_t d = 1 - r;
+    while (x <= y) {
+        if (filled) {
+            // Rows cy±x are visited only once
+            fillSpan(cx-y, cx+y, cy+x, pixel);
+            if (x != 0) {
+                fillSpan(cx-y, cx+y, cy-x, pixel);
+            }
+            // Rows cy±y only once their widest point is reached, i.e. right
+            // before y changes
+            if (d >= 0  &&  x != y) {
+                fillSpan(cx-x, cx+x, cy+y, pixel);
+                fillSpan(cx-x, cx+x, cy-y, pixel);
+            }
+        } else {
+            const int32_t px[8] = { cx+x, cx-x, cx+x, cx-x, cx+y, cx-y, cx+y, cx-y };
+            const int32_t py[8] = { cy+y, cy+y, cy-y, cy-y, cy+x, cy+x, cy-x, cy-x };
+            for (int i = 0 ; i < 8 ; i++) {
+                if (clip.contains(px[i], py[i])) {
+                    getPixelRow(py[i])[px[i]] = pixel;
+                }
+            }
+        }
+
+        if (d < 0) {
+            d += 2*x + 3;
+        } else {
+            d += 2*(x-y) + 5;
+            y--;
+        }
+        x++;
+    }
+}
+
+void ScreenFramebuffer::drawBitmap(int32_t x, int32_t y, const Bitmap& bitmap, FlipDir flipDir)
+{
+    if (!buf) {
+        return;
+    }
+    drawBitmapHelper (
+        x, y,
+        bitmap,
+        flipDir,
+        [](ScreenFramebuffer* s, int32_t y) { return s->getPixelRow(y); },
+        this
+        );
+}
+
+void ScreenFramebuffer::drawIndexedBitmap(int32_t x, int32_t y, const IndexedBitmap& bitmap, FlipDir flipDir)
+{
+    if (!buf) {
+        return;
+    }
+    drawIndexedBitmapHelper (
+        x, y,
+        bitmap,
+        flipDir,
+        &ScreenFramebuffer::drawBitmapHelper_drawPixel,
+        &ScreenFramebuffer::drawBitmapHelper_drawPixels,
+        this
+        );
+}
+
+void ScreenFramebuffer::drawBitmapTransformed(float cx, float cy, const Bitmap& bitmap, float scaleX, float scaleY, float angle)
+{
+    if (!buf) {
+        return;
+    }
+    drawBitmapTransformedHelper (
+        cx, cy,
+        bitmap,
+        scaleX, scaleY,
+        angle,
+        &ScreenFramebuffer::drawBitmapHelper_drawPixel,
+        &ScreenFramebuffer::drawBitmapHelper_drawPixels,
+        this
+        );
+}
+
+void ScreenFramebuffer::drawBitmapBlended(int32_t x, int32_t y, const Bitmap& bitmap, uint8_t alpha, FlipDir flipDir)
+{
+    if (!buf) {
+        return;
+    }
+    drawBitmapBlendedHelper (
+        x, y,
+        bitmap,
+        alpha,
+        flipDir,
+        [](ScreenFramebuffer* s, int32_t y) { return s->getPixelRow(y); },
+        this
+        );
+}
+
+void ScreenFramebuffer::fillRects(int32_t x, int32_t y, const Rect* rects, size_t numRects, const Color& color)
+{
+    if (!buf) {
+        return;
+    }
+    const Rect clip = getClipRect();
+    const uint16_t pixel = color.toPixel();
+    for (size_t i = 0 ; i < numRects ; i++) {
+        const Rect& r = rects[i];
+        const Rect c = clip.intersected(Rect(x + r.x, y + r.y, r.w, r.h));
+        if (c.isEmpty()) {
+            continue;
+        }
+        uint16_t* p = getPixelRow(c.y) + c.x;
+        for (int32_t ry = 0 ; ry < c.h ; ry++, p += width) {
+            fillPixels(p, c.w, pixel);
+        }
+    }
+}
+
+Color ScreenFramebuffer::readPixel(int32_t x, int32_t y)
+{
+    if (!buf  ||  x < 0  ||  x >= width  ||  y < bufY  ||  y >= bufY+bufRows) {
+        return Color::BLACK;
+    }
+    return Color::fromPixel(getPixelRow(y)[x]);
+}
+
+void ScreenFramebuffer::readRegion(const Rect& rect, uint16_t* out, size_t outStride)
+{
+    for (int32_t y = rect.y ; y < rect.y+rect.h ; y++) {
+        uint16_t* outRow = out + (y-rect.y)*outStride;
+        if (buf  &&  y >= bufY  &&  y < bufY+bufRows) {
+            memcpy(outRow, getPixelRow(y) + rect.x, rect.w*sizeof(uint16_t));
+        } else {
+            fillPixels(outRow, rect.w, Color::BLACK.toPixel());
+        }
+    }
+}
+
+void ScreenFramebuffer::drawGlyph (
+    int32_t x, int32_t y,
+    const uint8_t* d, uint8_t w, uint8_t h,
+    uint16_t scale,
+    const Color& color
+) {
+    if (!buf  ||  !d  ||  !getClipRect().intersects(Rect(x, y, w*scale, h*scale))) {
+        return;
+    }
+    const uint16_t pixel = color.toPixel();
+
+    const GlyphCache::Run* runs;
+    size_t numRuns;
+    if (GlyphCache::getInstance().get(d, w, h, runs, numRuns)) {
+        for (size_t i = 0 ; i < numRuns ; i++) {
+            const GlyphCache::Run& r = runs[i];
+            fillRect(x + r.x*scale, y + r.y*scale, r.w*scale, r.h*scale, pixel);
+        }
+        return;
+    }
+
+    // Not cacheable, so find the runs of set pixels directly
+    const uint8_t byteW = (w+7) / 8;
+    for (uint8_t oy = 0 ; oy < h ; oy++) {
+        const uint8_t* row = d + oy*byteW;
+        uint8_t ox = 0;
+        while (ox < w) {
+            if (!(row[ox>>3] & (0x80 >> (ox&7)))) {
+                ox++;
+                continue;
+            }
+            // Draw runs of set glyph pixels as a single rectangle
+            const uint8_t start = ox;
+            while (ox < w  &&  (row[ox>>3] & (0x80 >> (ox&7)))) {
+                ox++;
+            }
+            fillRect(x + start*scale, y + oy*scale, (ox-start)*scale, scale, pixel);
+        }
+    }
+}
+
+
+}
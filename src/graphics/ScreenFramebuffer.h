@@ -0,0 +1,163 @@
+#pragma once
+
+#include "../Globals.h"
+#include "Screen.h"
+
+
+namespace MINTGGGameEngine
+{
+
+/**
+ * \brief A screen that draws into an RGB565 frame buffer in RAM.
+ *
+ * All drawing operations are implemented here, directly on the buffer, so
+ * display backends only need to send it to the display in commit(). Fills and
+ * horizontal spans write two pixels per 32-bit word, rectangles and filled
+ * circles are drawn as row spans, and readPixel() is a plain load.
+ *
+ * The buffer may also hold only a horizontal band of the screen (see
+ * Screen::getBandHeight()). Drawing is then clipped to the rows in the
+ * buffer, in addition to the clip rectangle.
+ *
+ * Created with a size, the screen allocates its own buffer and commit() does
+ * nothing. Such an off-screen screen can be used to render into memory, e.g.
+ * to prepare images once and draw them as bitmaps later.
+ */
+class ScreenFramebuffer : public Screen
+{
+public:
+    /**
+     * \brief Create an off-screen frame buffer of the given size.
+     *
+     * The buffer is not initialized. If it can't be allocated, nothing is
+     * drawn.
+     */
+    ScreenFramebuffer(uint16_t width, uint16_t height);
+
+    ~ScreenFramebuffer() override;
+
+    uint16_t getWidth() const override { return width; }
+    uint16_t getHeight() const override { return height; }
+
+    void fillScreen(const Color& color) override;
+    void drawPixel(int32_t x, int32_t y, const Color& color) override;
+    void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, const Color& color) override;
+    void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, const Color& color, bool filled = false) override;
+    void drawCircle(int32_t cx, int32_t cy, int32_t r, const Color& color, bool filled = false) override;
+    void drawBitmap(int32_t x, int32_t y, const Bitmap& bitmap, FlipDir flipDir = FlipDir::None) override;
+    void drawIndexedBitmap(int32_t x, int32_t y, const IndexedBitmap& bitmap, FlipDir flipDir = FlipDir::None) override;
+    void drawBitmapTransformed(float cx, float cy, const Bitmap& bitmap, float scaleX, float scaleY, float angle = 0.0f) override;
+    void drawBitmapBlended(int32_t x, int32_t y, const Bitmap& bitmap, uint8_t alpha = 255, FlipDir flipDir = FlipDir::None) override;
+    void fillRects(int32_t x, int32_t y, const Rect* rects, size_t numRects, const Color& color) override;
+
+    /**
+     * \brief Return the color of a pixel.
+     *
+     * Pixels outside of the buffer (e.g. outside the current band) are
+     * returned as black.
+     */
+    Color readPixel(int32_t x, int32_t y) override;
+
+    /**
+     * \brief Copy a rectangle of pixels from the buffer, one row at a time.
+     *
+     * Rows outside of the buffer are returned as black.
+     */
+    void readRegion(const Rect& rect, uint16_t* out, size_t outStride) override;
+
+    void setClipRect(const Rect& rect) override;
+    void resetClipRect() override;
+
+    bool supportsPartialRedraw() const override { return true; }
+
+    void commit() override { recordRows(0, height); }
+
+    /**
+     * \brief Return the frame buffer, in pixel order (see Color::toPixel()).
+     *
+     * Row y of the screen starts at getBuffer() + (y-getBufferY())*getWidth().
+     */
+    const uint16_t* getBuffer() const { return buf; }
+
+    /**
+     * \brief Return the screen row held by the first row of the buffer.
+     */
+    int32_t getBufferY() const { return bufY; }
+
+    /**
+     * \brief Return the number of screen rows held by the buffer.
+     */
+    uint16_t getBufferRows() const { return bufRows; }
+
+protected:
+    /**
+     * \brief Create a screen without a buffer, for display backends that call
+     *      setSize() and setBuffer() once the display is known.
+     */
+    ScreenFramebuffer();
+
+    void setSize(uint16_t width, uint16_t height);
+
+    /**
+     * \brief Draw into the given buffer from now on.
+     *
+     * The buffer is not owned by this screen. Its rows are getWidth() pixels
+     * apart.
+     *
+     * \param buf The buffer, or null to stop drawing.
+     * \param firstRow The screen row held by the first row of the buffer.
+     * \param numRows The number of rows in the buffer.
+     */
+    void setBuffer(uint16_t* buf, int32_t firstRow, uint16_t numRows);
+
+    void drawGlyph (
+        int32_t x, int32_t y,
+        const uint8_t* d, uint8_t w, uint8_t h,
+        uint16_t scale,
+        const Color& color
+        ) override;
+
+    uint16_t* getPixelRow(int32_t y) const { return buf + (y-bufY)*width; }
+
+    /**
+     * \brief Fill pixels [x0, x1] of row y, clipped.
+     */
+    void fillSpan(int32_t x0, int32_t x1, int32_t y, uint16_t pixel);
+
+    /**
+     * \brief Fill a rectangle, clipped.
+     */
+    void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t pixel);
+
+    /**
+     * \brief Fill n pixels, two at a time wherever possible.
+     */
+    static void fillPixels(uint16_t* p, int32_t n, uint16_t pixel);
+
+private:
+    void updateClip();
+
+    static void drawBitmapHelper_drawPixel(ScreenFramebuffer* s, int32_t x, int32_t y, uint16_t c)
+    {
+        s->getPixelRow(y)[x] = c;
+    }
+
+    static void drawBitmapHelper_drawPixels(ScreenFramebuffer* s, int32_t x, int32_t y, const uint16_t* c, int32_t w)
+    {
+        memcpy(s->getPixelRow(y) + x, c, w*sizeof(uint16_t));
+    }
+
+private:
+    uint16_t width;
+    uint16_t height;
+
+    uint16_t* buf;
+    int32_t bufY;
+    uint16_t bufRows;
+    bool ownBuf;
+
+    Rect userClip; // The clip rectangle as set, before clipping to the buffer
+    bool hasUserClip;
+};
+
+}
@@ -2,19 +2,76 @@
 
 #ifdef MINTGGGAMEENGINE_PORT_ESPIDF
 
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "util/Log.h"
 #include "util/Util.h"
 
 
+LOG_USE_TAG("ScreenHAGL")
+
+
+// Defaults for builds without the engine's Kconfig (see Kconfig)
+#ifndef CONFIG_MINTGGGAMEENGINE_SCREEN_FLUSH_TASK_STACK_SIZE
+#define CONFIG_MINTGGGAMEENGINE_SCREEN_FLUSH_TASK_STACK_SIZE 2048
+#endif
+#ifndef CONFIG_MINTGGGAMEENGINE_SCREEN_FLUSH_TASK_PRIORITY
+#define CONFIG_MINTGGGAMEENGINE_SCREEN_FLUSH_TASK_PRIORITY 0
+#endif
+
+
 namespace MINTGGGameEngine
 {
 
+static_assert(sizeof(hagl_color_t) == sizeof(uint16_t), "ScreenHAGL requires 16-bit colors");
 
-// TODO: Maybe try to handle coordinate overflow/underflow more gracefully
+void _ScreenHAGLFlushTaskMain(void* params)
+{
+    static_cast<ScreenHAGL*>(params)->flushTaskMain();
+}
 
 
 ScreenHAGL::ScreenHAGL()
-    : display(nullptr)
+    : display(nullptr),
+      frameBuf(nullptr), regionBuf(nullptr),
+      band(nullptr), bandY(0),
+      halBuf(nullptr), otherBuf(nullptr), flushBand(nullptr), flushBandY(0), flushTask(nullptr),
+      flushRequest(nullptr), flushDone(nullptr),
+      lastFlushWaitUs(0), totalFlushWaitUs(0)
 {
+    memset(bands, 0, sizeof(bands));
+}
+
+ScreenHAGL::~ScreenHAGL()
+{
+    if (flushTask) {
+        // The task only touches the buffers between flushRequest and
+        // flushDone, so it is safe to delete once the last transfer is done.
+        xSemaphoreTake(flushDone, portMAX_DELAY);
+        vTaskDelete(flushTask);
+        vSemaphoreDelete(flushRequest);
+        vSemaphoreDelete(flushDone);
+        flushTask = nullptr;
+    }
+
+#ifndef CONFIG_HAGL_HAL_NO_BUFFERING
+    if (otherBuf) {
+        // Give the HAL its own buffer back, and free the one we allocated.
+        uint8_t* ownBuf = (bb.buffer == halBuf) ? otherBuf : bb.buffer;
+        bb.buffer = halBuf;
+        display->buffer = halBuf;
+        heap_caps_free(ownBuf);
+    }
+#endif
+
+    for (hagl_bitmap_t& b : bands) {
+        heap_caps_free(b.buffer);
+    }
+    heap_caps_free(frameBuf);
+    heap_caps_free(regionBuf);
 }
 
 void ScreenHAGL::begin()
@@ -22,130 +79,359 @@ void ScreenHAGL::begin()
     begin(hagl_init());
 }
 
-void ScreenHAGL::begin(hagl_backend_t* display)
+bool ScreenHAGL::begin(hagl_backend_t* display)
 {
     this->display = display;
+    setSize(display->width, display->height);
+
+#ifdef CONFIG_HAGL_HAL_NO_BUFFERING
+    // Without a HAL frame buffer, all drawing would be discarded.
+#ifdef CONFIG_MINTGGGAMEENGINE_SCREEN_PARTIAL_FLUSH
+    if (enablePartialFlush()) {
+        return true;
+    }
+    LogError("Falling back to drawing in bands.");
+#endif
+#if CONFIG_MINTGGGAMEENGINE_SCREEN_BAND_HEIGHT > 0
+    const uint16_t bandHeight = CONFIG_MINTGGGAMEENGINE_SCREEN_BAND_HEIGHT;
+#else
+    const uint16_t bandHeight = DefaultBandHeight;
+#endif
+    if (!enableBanding(bandHeight)) {
+        LogError("The HAL has no frame buffer and bands could not be allocated. Nothing will be drawn!");
+        updateTarget();
+        return false;
+    }
+#endif
+
+    updateTarget();
+    return true;
 }
 
-void ScreenHAGL::fillScreen(const Color& color)
+bool ScreenHAGL::enableAsyncFlush()
 {
-    if (!display) {
-        return;
+    if (!display  ||  band) {
+        return false;
     }
-    const hagl_color_t hcolor = color.toRGB565();
-    hagl_color_t* bptr = reinterpret_cast<hagl_color_t*>(bb.buffer);
-    hagl_color_t* bptrEnd = bptr + getWidth()*getHeight();
-    while (bptr != bptrEnd) {
-        *bptr = hcolor;
-        bptr++;
+    if (flushTask) {
+        return true;
     }
-    //hagl_fill_rectangle(display, 0, 0, display->width-1, display->height-1, color.toRGB565());
+
+#ifdef CONFIG_HAGL_HAL_NO_BUFFERING
+    LogError("Async flush needs a HAL frame buffer, flushing synchronously.");
+    return false;
+#else
+
+    const size_t bufSize = getWidth()*getHeight()*sizeof(hagl_color_t);
+    otherBuf = static_cast<uint8_t*>(heap_caps_malloc(bufSize, MALLOC_CAP_DMA));
+    if (!otherBuf  ||  !startFlushTask()) {
+        LogError("Unable to enable async flush, flushing synchronously.");
+        heap_caps_free(otherBuf);
+        otherBuf = nullptr;
+        return false;
+    }
+    halBuf = bb.buffer;
+
+    return true;
+#endif
 }
 
-void ScreenHAGL::drawPixel(int32_t x, int32_t y, const Color& color)
+bool ScreenHAGL::enableBanding(uint16_t bandHeight)
 {
-    if (!display) {
+    if (!display  ||  flushTask  ||  frameBuf  ||  bandHeight == 0) {
+        return false;
+    }
+    if (band) {
+        return band->height == bandHeight;
+    }
+
+#ifndef CONFIG_HAGL_HAL_NO_BUFFERING
+    LogError("Banding needs a HAL without frame buffer, drawing entire frames.");
+    return false;
+#else
+
+    const size_t bufSize = getWidth()*bandHeight*sizeof(hagl_color_t);
+    for (hagl_bitmap_t& b : bands) {
+        void* buf = heap_caps_malloc(bufSize, MALLOC_CAP_DMA);
+        if (!buf) {
+            LogError("Unable to allocate band buffers.");
+            heap_caps_free(bands[0].buffer);
+            memset(bands, 0, sizeof(bands));
+            return false;
+        }
+        hagl_bitmap_init(&b, getWidth(), bandHeight, display->depth, buf);
+    }
+
+    if (!startFlushTask()) {
+        // A single band is enough to draw synchronously.
+        LogError("Unable to create flush task, sending bands synchronously.");
+        heap_caps_free(bands[1].buffer);
+        memset(&bands[1], 0, sizeof(bands[1]));
+    }
+
+    band = &bands[0];
+    bandY = 0;
+    updateTarget();
+
+    return true;
+#endif
+}
+
+bool ScreenHAGL::enablePartialFlush()
+{
+    if (!display  ||  flushTask  ||  band) {
+        return false;
+    }
+    if (frameBuf) {
+        return true;
+    }
+
+#ifndef CONFIG_HAGL_HAL_NO_BUFFERING
+    LogError("Partial flush needs a HAL without frame buffer, flushing entire frames.");
+    return false;
+#else
+
+    frameBuf = static_cast<uint16_t*>(heap_caps_malloc(getWidth()*getHeight()*sizeof(uint16_t), MALLOC_CAP_DMA));
+    regionBuf = static_cast<uint16_t*>(heap_caps_malloc(getWidth()*RegionBufRows*sizeof(uint16_t), MALLOC_CAP_DMA));
+    if (!frameBuf  ||  !regionBuf) {
+        LogError("Unable to allocate frame buffer for partial flush.");
+        heap_caps_free(frameBuf);
+        heap_caps_free(regionBuf);
+        frameBuf = nullptr;
+        regionBuf = nullptr;
+        return false;
+    }
+
+    updateTarget();
+
+    return true;
+#endif
+}
+
+bool ScreenHAGL::startFlushTask()
+{
+    flushRequest = xSemaphoreCreateBinary();
+    flushDone = xSemaphoreCreateBinary();
+
+    // By default slightly above the caller, so that finished transfers are
+    // picked up immediately. The task is blocked for most of the time anyway.
+    UBaseType_t priority = CONFIG_MINTGGGAMEENGINE_SCREEN_FLUSH_TASK_PRIORITY;
+    if (priority == 0) {
+        priority = uxTaskPriorityGet(nullptr)+1;
+    }
+
+    BaseType_t res = pdFAIL;
+    if (flushRequest  &&  flushDone) {
+        res = xTaskCreate(&_ScreenHAGLFlushTaskMain, "ScreenFlushTask",
+                CONFIG_MINTGGGAMEENGINE_SCREEN_FLUSH_TASK_STACK_SIZE,
+                this, priority, &flushTask);
+    }
+    if (res != pdPASS) {
+        if (flushRequest) {
+            vSemaphoreDelete(flushRequest);
+            flushRequest = nullptr;
+        }
+        if (flushDone) {
+            vSemaphoreDelete(flushDone);
+            flushDone = nullptr;
+        }
+        flushTask = nullptr;
+        return false;
+    }
+
+    // No transfer is running yet
+    xSemaphoreGive(flushDone);
+
+    return true;
+}
+
+void ScreenHAGL::updateTarget()
+{
+    if (band) {
+        setBuffer(reinterpret_cast<uint16_t*>(band->buffer), bandY, band->height);
+    } else {
+#ifdef CONFIG_HAGL_HAL_NO_BUFFERING
+        setBuffer(frameBuf, 0, frameBuf ? getHeight() : 0);
+#else
+        setBuffer(reinterpret_cast<uint16_t*>(bb.buffer), 0, getHeight());
+#endif
+    }
+}
+
+bool ScreenHAGL::supportsPartialRedraw() const
+{
+    // With async flush or triple buffering, back buffers are swapped on every
+    // flush, so the previous frame's contents are not where we draw next.
+    // Bands don't keep anything between frames at all.
+#ifdef CONFIG_HAGL_HAL_USE_TRIPLE_BUFFERING
+    return false;
+#else
+    return !flushTask  &&  !band;
+#endif
+}
+
+void ScreenHAGL::commit()
+{
+    if (band) {
+        // Everything was already sent by commitBand()
         return;
     }
-    hagl_put_pixel(display, static_cast<int16_t>(x), static_cast<int16_t>(y), color.toRGB565());
+
+    recordRows(0, getHeight());
+
+    if (!flushTask) {
+        flush();
+        return;
+    }
+
+    // The other buffer is only free again once its transfer is done.
+    timer_ustick_t waitStart = TimerGetTickcountUs();
+    xSemaphoreTake(flushDone, portMAX_DELAY);
+    lastFlushWaitUs = (uint32_t) (TimerGetTickcountUs() - waitStart);
+    totalFlushWaitUs += lastFlushWaitUs;
+
+#ifndef CONFIG_HAGL_HAL_NO_BUFFERING
+    // Draw the next frame into the other buffer, and send this one.
+    std::swap(bb.buffer, otherBuf);
+    updateTarget();
+    xSemaphoreGive(flushRequest);
+#endif
 }
 
-void ScreenHAGL::drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, const Color& color)
+void ScreenHAGL::commitRegions(const Rect* regions, size_t numRegions)
 {
-    if (!display) {
+    if (numRegions == 0) {
         return;
     }
-    hagl_draw_line (
-        display,
-        static_cast<int16_t>(x0), static_cast<int16_t>(y0),
-        static_cast<int16_t>(x1), static_cast<int16_t>(y1),
-        color.toRGB565()
-        );
+    if (!frameBuf) {
+        commit();
+        return;
+    }
+
+    recordRows(0, getHeight());
+
+    const Rect screenRect(0, 0, getWidth(), getHeight());
+    for (size_t i = 0 ; i < numRegions ; i++) {
+        const Rect r = regions[i].intersected(screenRect);
+        if (!r.isEmpty()) {
+            sendRegion(r);
+        }
+    }
 }
 
-void ScreenHAGL::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, const Color& color, bool filled)
+void ScreenHAGL::beginBand(int32_t y)
 {
-    if (!display) {
+    if (!band) {
         return;
     }
-    if (filled) {
-        hagl_fill_rectangle_xywh (
-            display,
-            static_cast<int16_t>(x), static_cast<int16_t>(y),
-            static_cast<uint16_t>(w), static_cast<uint16_t>(h),
-            color.toRGB565()
-            );
-    } else {
-        hagl_draw_rectangle_xywh (
-            display,
-            static_cast<int16_t>(x), static_cast<int16_t>(y),
-            static_cast<uint16_t>(w), static_cast<uint16_t>(h),
-            color.toRGB565()
-            );
+    if (y == 0) {
+        lastFlushWaitUs = 0;
     }
+    bandY = y;
+    updateTarget();
 }
 
-void ScreenHAGL::drawCircle(int32_t cx, int32_t cy, int32_t r, const Color& color, bool filled)
+void ScreenHAGL::commitBand()
 {
-    if (!display) {
+    if (!band) {
         return;
     }
-    if (filled) {
-        hagl_fill_circle (
-            display,
-            static_cast<int16_t>(cx), static_cast<int16_t>(cy), static_cast<int16_t>(r),
-            color.toRGB565()
-            );
+
+    recordRows(getBufferY(), getBufferRows());
+
+    if (!flushTask) {
+        sendBand(band, bandY);
     } else {
-        hagl_draw_circle (
-            display,
-            static_cast<int16_t>(cx), static_cast<int16_t>(cy), static_cast<int16_t>(r),
-            color.toRGB565()
-            );
+        // The other band is only free again once its transfer is done.
+        timer_ustick_t waitStart = TimerGetTickcountUs();
+        xSemaphoreTake(flushDone, portMAX_DELAY);
+        uint32_t waitUs = (uint32_t) (TimerGetTickcountUs() - waitStart);
+        lastFlushWaitUs += waitUs;
+        totalFlushWaitUs += waitUs;
+
+        flushBand = band;
+        flushBandY = bandY;
+        band = (band == &bands[0]) ? &bands[1] : &bands[0];
+        updateTarget();
+        xSemaphoreGive(flushRequest);
     }
+
+    resetClipRect();
 }
 
-void ScreenHAGL::drawBitmap(int32_t x, int32_t y, const Bitmap& bitmap, FlipDir flipDir)
+void ScreenHAGL::flush()
 {
     if (!display) {
         return;
     }
-    drawBitmapHelper (
-        x, y,
-        bitmap,
-        flipDir,
-        &ScreenHAGL::drawBitmapHelper_drawPixel,
-        &ScreenHAGL::drawBitmapHelper_drawPixels,
-        display
-        );
+
+    // Pixels are already in the order expected by the display (see
+    // Color::toPixel()), so the buffer can be sent as it is.
+    if (frameBuf) {
+        sendRegion(Rect(0, 0, getWidth(), getHeight()));
+    } else {
+        hagl_flush(display);
+    }
+    updateTarget();
 }
 
-Color ScreenHAGL::readPixel(int32_t x, int32_t y)
+void ScreenHAGL::sendBand(hagl_bitmap_t* b, int32_t y)
 {
-    return Color(hagl_get_pixel(display, static_cast<int16_t>(x), static_cast<int16_t>(y)));
+    // The last band may be cut off at the bottom of the screen. Its first rows
+    // are still contiguous, so just send fewer of them. HAGL would fall back
+    // to drawing single pixels for bitmaps crossing the clip window.
+    hagl_bitmap_t part = *b;
+    part.height = static_cast<int16_t>(std::min<int32_t>(b->height, getHeight()-y));
+    hagl_blit_xy(display, 0, static_cast<int16_t>(y), &part);
 }
 
-void ScreenHAGL::commit()
+void ScreenHAGL::sendRegion(const Rect& r)
 {
-    if (!display) {
+    const int32_t w = getWidth();
+    hagl_bitmap_t part;
+
+    if (r.x == 0  &&  r.w == w) {
+        // Full rows are contiguous in the frame buffer already.
+        hagl_bitmap_init(&part, static_cast<int16_t>(w), static_cast<int16_t>(r.h), display->depth,
+                frameBuf + r.y*w);
+        hagl_blit_xy(display, 0, static_cast<int16_t>(r.y), &part);
         return;
     }
 
-    // Swap endianness for pixels. This is needed at least for ST7735, and probably for all MIPI compatible displays,
-    // because they expect pixels in big-endian format, while ESP32 is little-endian.
-    // TODO: Find a better way. It doesn't seem possible to have the hardware do this for SPI. Another option would be
-    //  to just store RGB565 values in big-endian order all the time, or maybe make this configurable. But is that a
-    //  good idea?
-    hagl_color_t* bptr = reinterpret_cast<hagl_color_t*>(bb.buffer);
-    hagl_color_t* bptrEnd = bptr + getWidth()*getHeight();
-    while (bptr != bptrEnd) {
-        *bptr = __builtin_bswap16(*bptr);
-        bptr++;
+    // Copy as many rows as fit into the region buffer, so that each transfer
+    // has a single address window and no gaps.
+    const int32_t rowsPerBlit = (w*RegionBufRows) / r.w;
+    for (int32_t y = r.y ; y < r.getBottom() ; y += rowsPerBlit) {
+        const int32_t rows = std::min(rowsPerBlit, r.getBottom()-y);
+        for (int32_t i = 0 ; i < rows ; i++) {
+            memcpy(regionBuf + i*r.w, frameBuf + (y+i)*w + r.x, r.w*sizeof(uint16_t));
+        }
+        hagl_bitmap_init(&part, static_cast<int16_t>(r.w), static_cast<int16_t>(rows), display->depth,
+                regionBuf);
+        hagl_blit_xy(display, static_cast<int16_t>(r.x), static_cast<int16_t>(y), &part);
     }
-
-    hagl_flush(display);
 }
 
+void ScreenHAGL::flushTaskMain()
+{
+    while (true) {
+        xSemaphoreTake(flushRequest, portMAX_DELAY);
+
+        // The main task doesn't touch otherBuf or flushBand until flushDone
+        // is given. The HAL sends the backend's buffer, while drawing goes
+        // through bb.
+        if (flushBand) {
+            sendBand(flushBand, flushBandY);
+        } else {
+#ifndef CONFIG_HAGL_HAL_NO_BUFFERING
+            display->buffer = otherBuf;
+            hagl_flush(display);
+#endif
+        }
+
+        xSemaphoreGive(flushDone);
+    }
+}
 
 }
 
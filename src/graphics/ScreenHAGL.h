@@ -1,58 +1,219 @@
 #pragma once
 
 #include "../Globals.h"
-#include "Screen.h"
+#include "ScreenFramebuffer.h"
 
 #ifdef MINTGGGAMEENGINE_PORT_ESPIDF
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
 #include <hagl.h>
 #include <hagl_hal.h>
 
 
+#ifndef CONFIG_HAGL_HAL_NO_BUFFERING
 extern "C" {
 extern hagl_bitmap_t bb;
 }
+#endif
 
 
 namespace MINTGGGameEngine
 {
 
-class ScreenHAGL : public Screen
+/**
+ * \brief A screen on any display supported by the HAGL HAL.
+ *
+ * All drawing is done by ScreenFramebuffer, in the HAL's back buffer, in a
+ * frame buffer of its own (see enablePartialFlush()) or in the current band
+ * (see enableBanding()). This class only sends finished frames, regions or
+ * bands to the display. Without a HAL frame buffer
+ * (CONFIG_HAGL_HAL_NO_BUFFERING), one of the latter two is required, and
+ * begin() enables it automatically.
+ */
+class ScreenHAGL : public ScreenFramebuffer
 {
+    friend void _ScreenHAGLFlushTaskMain(void* params);
+
+public:
+    enum
+    {
+        /**
+         * The band height used by begin() if the HAL has no frame buffer, and
+         * none is configured (see CONFIG_MINTGGGAMEENGINE_SCREEN_BAND_HEIGHT).
+         */
+        DefaultBandHeight = 16
+    };
+
 public:
     ScreenHAGL();
 
-    void begin();
-    void begin(hagl_backend_t* display);
+    /**
+     * \brief Stop the flush task and free all buffers.
+     *
+     * Waits for a running transfer to finish first.
+     */
+    ~ScreenHAGL() override;
 
-    uint16_t getWidth() const override { return display->width; }
-    uint16_t getHeight() const override { return display->height; }
+    void begin();
 
-    void fillScreen(const Color& color) override;
-    void drawPixel(int32_t x, int32_t y, const Color& color) override;
-    void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, const Color& color) override;
-    void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, const Color& color, bool filled = false) override;
-    void drawCircle(int32_t cx, int32_t cy, int32_t r, const Color& color, bool filled = false) override;
-    void drawBitmap(int32_t x, int32_t y, const Bitmap& bitmap, FlipDir flipDir = FlipDir::None) override;
+    /**
+     * \brief Start drawing to a HAGL display.
+     *
+     * If the HAL has no frame buffer (CONFIG_HAGL_HAL_NO_BUFFERING), partial
+     * flush (with CONFIG_MINTGGGAMEENGINE_SCREEN_PARTIAL_FLUSH) or banding is
+     * enabled here, because there would be nothing to draw into otherwise.
+     *
+     * \param display The display.
+     * \return true if successful, false if no buffers could be allocated
+     *      without a HAL frame buffer. Nothing can be drawn in that case.
+     */
+    bool begin(hagl_backend_t* display);
+
+    /**
+     * \brief Switch to double-buffered, asynchronous flushing.
+     *
+     * A second back buffer is allocated in DMA-capable memory, and a separate
+     * task sends finished frames to the display. commit() then only hands the
+     * frame over to that task and returns immediately, while the next frame is
+     * drawn into the other buffer. It only blocks if the previous transfer is
+     * still running, so the transfer overlaps with game logic and drawing.
+     *
+     * Because consecutive frames are drawn into different buffers, partial
+     * redraws are not supported in this mode (see supportsPartialRedraw()).
+     * After commit(), the buffer drawn to holds the frame before the one just
+     * committed, so screenshots (see Screen::saveScreenshot()) must be taken
+     * before commit().
+     *
+     * This relies on the HAL drawing through \c bb and flushing the backend's
+     * own buffer pointer, as the double-buffered HAL does.
+     *
+     * \return true if successful, false if the buffer or task could not be
+     *      created. Flushing stays synchronous in that case.
+     */
+    bool enableAsyncFlush();
+
+    bool isAsyncFlush() const { return flushTask != nullptr; }
+
+    /**
+     * \brief Switch to drawing frames in horizontal bands.
+     *
+     * Instead of the HAL's frame buffer, two strip buffers of bandHeight rows
+     * are allocated in DMA-capable memory. Each frame is drawn band by band
+     * (see Screen::getBandHeight()), and every band is blitted to the display
+     * by a separate task while the next one is drawn. This allows displays
+     * whose frame buffer would not fit into RAM, e.g. 320x240 panels with 16
+     * rows per band need 20 KB instead of 150 KB.
+     *
+     * Only supported with a HAL that has no frame buffer of its own
+     * (CONFIG_HAGL_HAL_NO_BUFFERING), where blits go to the display directly.
+     * A buffering HAL would only copy the bands into its own buffer, which is
+     * never sent. It must be called before anything is drawn.
+     *
+     * Can't be combined with enableAsyncFlush().
+     *
+     * \param bandHeight The number of rows per band.
+     * \return true if successful, false if the HAL has a frame buffer or the
+     *      buffers could not be allocated. If only the flush task could not be
+     *      created, bands are sent synchronously, and true is returned.
+     */
+    bool enableBanding(uint16_t bandHeight);
+
+    /**
+     * \brief Draw into a frame buffer of our own, and only send changed
+     *      regions to the display.
+     *
+     * With a HAL frame buffer, hagl_flush() always sends the entire frame,
+     * and blits only end up in the HAL's buffer. Without one
+     * (CONFIG_HAGL_HAL_NO_BUFFERING), hagl_blit_xy() writes to the display
+     * directly, with an address window around the blitted bitmap. This
+     * allocates a full frame buffer in DMA-capable memory, so that
+     * commitRegions() can send every dirty region on its own.
+     *
+     * Must be called before anything is drawn. Can't be combined with
+     * enableBanding() or enableAsyncFlush().
+     *
+     * \return true if successful, false if the HAL has a frame buffer or the
+     *      buffers could not be allocated.
+     */
+    bool enablePartialFlush();
+
+    bool isPartialFlush() const { return frameBuf != nullptr; }
+
+    /**
+     * \brief Return how long the last commit() waited for the previous
+     *      transfer to finish, in microseconds.
+     *
+     * In band mode, this is the time that commitBand() waited during the
+     * last frame.
+     */
+    uint32_t getLastFlushWaitUs() const { return lastFlushWaitUs; }
+
+    /**
+     * \brief Return how long commit() waited for transfers in total, in
+     *      microseconds.
+     */
+    uint64_t getTotalFlushWaitUs() const { return totalFlushWaitUs; }
+
+    bool supportsPartialRedraw() const override;
 
-    Color readPixel(int32_t x, int32_t y) override;
-    
     void commit() override;
 
+    /**
+     * \brief Send the changed regions to the display.
+     *
+     * In partial flush mode (see enablePartialFlush()), each region is blitted
+     * to the display on its own. Otherwise, the HAL can only flush entire
+     * frames, so the whole back buffer is sent if numRegions is not 0. Frames
+     * without changes are skipped entirely.
+     */
+    void commitRegions(const Rect* regions, size_t numRegions) override;
+
+    uint16_t getBandHeight() const override { return band ? band->height : 0; }
+    void beginBand(int32_t y) override;
+    void commitBand() override;
+
 private:
-    static void drawBitmapHelper_drawPixel(hagl_backend_t* d, int32_t x, int32_t y, hagl_color_t c)
+    enum
     {
-        hagl_color_t* ptr = reinterpret_cast<hagl_color_t*>(bb.buffer) + x + y*d->width;
-        *ptr = c;
-    }
+        // Rows of the screen width that a region is copied in, to be sent in a
+        // single transfer
+        RegionBufRows = 8
+    };
 
-    static void drawBitmapHelper_drawPixels(hagl_backend_t* d, int32_t x, int32_t y, const hagl_color_t* c, int32_t w)
-    {
-        memcpy(reinterpret_cast<hagl_color_t*>(bb.buffer) + y*d->width + x, c, w*sizeof(hagl_color_t));
-    }
+private:
+    bool startFlushTask();
+
+    void flush();
+    void sendBand(hagl_bitmap_t* b, int32_t y);
+    void sendRegion(const Rect& r);
+
+    void flushTaskMain();
+
+    // Point ScreenFramebuffer to the frame buffer, or the current band
+    void updateTarget();
 
 private:
     hagl_backend_t* display;
+
+    uint16_t* frameBuf; // Our own frame buffer in partial flush mode, or null
+    uint16_t* regionBuf; // Rows of a region that is not as wide as the screen
+
+    hagl_bitmap_t bands[2];
+    hagl_bitmap_t* band; // The band drawn to, or null if not in band mode
+    int32_t bandY;
+
+    uint8_t* halBuf; // The HAL's own back buffer, which async flush swaps with otherBuf
+    uint8_t* otherBuf; // The back buffer not drawn to, sent by the flush task
+    hagl_bitmap_t* flushBand; // The band sent by the flush task, if any
+    int32_t flushBandY;
+    TaskHandle_t flushTask;
+    SemaphoreHandle_t flushRequest;
+    SemaphoreHandle_t flushDone;
+    uint32_t lastFlushWaitUs;
+    uint64_t totalFlushWaitUs;
 };
 
 }
@@ -34,6 +34,18 @@ void ScreenNull::drawBitmap(int32_t x, int32_t y, const Bitmap& bitmap, FlipDir
 {
 }
 
+void ScreenNull::drawIndexedBitmap(int32_t x, int32_t y, const IndexedBitmap& bitmap, FlipDir flipDir)
+{
+}
+
+void ScreenNull::drawBitmapTransformed(float cx, float cy, const Bitmap& bitmap, float scaleX, float scaleY, float angle)
+{
+}
+
+void ScreenNull::drawBitmapBlended(int32_t x, int32_t y, const Bitmap& bitmap, uint8_t alpha, FlipDir flipDir)
+{
+}
+
 void ScreenNull::commit()
 {
 }
@@ -21,6 +21,9 @@ public:
     void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, const Color& color, bool filled = false) override;
     void drawCircle(int32_t cx, int32_t cy, int32_t r, const Color& color, bool filled = false) override;
     void drawBitmap(int32_t x, int32_t y, const Bitmap& bitmap, FlipDir flipDir = FlipDir::None) override;
+    void drawIndexedBitmap(int32_t x, int32_t y, const IndexedBitmap& bitmap, FlipDir flipDir = FlipDir::None) override;
+    void drawBitmapTransformed(float cx, float cy, const Bitmap& bitmap, float scaleX, float scaleY, float angle = 0.0f) override;
+    void drawBitmapBlended(int32_t x, int32_t y, const Bitmap& bitmap, uint8_t alpha = 255, FlipDir flipDir = FlipDir::None) override;
     
     void commit() override;
 
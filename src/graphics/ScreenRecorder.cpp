@@ -0,0 +1,391 @@
+#include "ScreenRecorder.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "../util/Log.h"
+#include "../util/Util.h"
+#include "Screen.h"
+
+
+LOG_USE_TAG("ScreenRecorder")
+
+
+namespace MINTGGGameEngine
+{
+
+
+static uint8_t* PutLE(uint8_t* p, uint32_t value, size_t numBytes)
+{
+    for (size_t i = 0 ; i < numBytes ; i++) {
+        *p++ = static_cast<uint8_t>(value >> (i*8));
+    }
+    return p;
+}
+
+
+void _ScreenRecorderTaskMain(void* params)
+{
+    static_cast<ScreenRecorder*>(params)->writerTaskMain();
+}
+
+
+
+ScreenRecorder::ScreenRecorder()
+    : screen(nullptr), fileOk(false), width(0), height(0),
+      blocks(nullptr), numBlocks(0), blockBytes(0), curBlock(nullptr),
+      freeQueue(nullptr), writeQueue(nullptr), writerTask(nullptr),
+      encodeBuf(nullptr), encodeBufBytes(0),
+      resumeRow(-1), firstDeferredRow(-1), frame(0), numDeferredRows(0)
+{
+}
+
+ScreenRecorder::~ScreenRecorder()
+{
+    stop();
+}
+
+bool ScreenRecorder::start(Screen& screen, const char* path, size_t queueBytes)
+{
+    stop();
+
+    width = screen.getWidth();
+    height = screen.getHeight();
+
+    const size_t entryBytes = 2 + width*sizeof(uint16_t);
+    blockBytes = std::max<size_t>(BlockBytes, entryBytes);
+    numBlocks = std::max<size_t>(2, queueBytes / blockBytes);
+
+    // Worst case: Every row has only literals, plus one control byte for
+    // every 128 pixels.
+    const size_t rowsPerBlock = blockBytes / entryBytes;
+    encodeBufBytes = 11 + rowsPerBlock * (4 + width*sizeof(uint16_t) + (width+127)/128);
+
+    blocks = new Block[numBlocks];
+    for (size_t i = 0 ; i < numBlocks ; i++) {
+        Block& block = blocks[i];
+        block.data = static_cast<uint8_t*>(malloc(blockBytes));
+        block.used = 0;
+        block.numRows = 0;
+        block.flags = 0;
+    }
+    encodeBuf = static_cast<uint8_t*>(malloc(encodeBufBytes));
+
+    // One more entry than blocks, for the null block sent by stop()
+    freeQueue = xQueueCreate(numBlocks+1, sizeof(Block*));
+    writeQueue = xQueueCreate(numBlocks+1, sizeof(Block*));
+
+    bool allocOk = encodeBuf  &&  freeQueue  &&  writeQueue;
+    for (size_t i = 0 ; i < numBlocks ; i++) {
+        allocOk = allocOk  &&  blocks[i].data;
+    }
+    if (!allocOk) {
+        LogError("Unable to allocate %u bytes of capture queue.", (unsigned int) (numBlocks*blockBytes));
+        freeBlocks();
+        return false;
+    }
+
+    rowHashes.assign(height, 0);
+    rowKnown.assign(height, 0);
+
+    file.reset(new File(path));
+    const char* errmsg = nullptr;
+    if (!file->open(File::WriteOnly, &errmsg)) {
+        LogError("Unable to open capture file '%s': %s", path, errmsg ? errmsg : "unknown error");
+        freeBlocks();
+        return false;
+    }
+
+    uint8_t header[12];
+    uint8_t* p = header;
+    memcpy(p, "MGCP", 4);
+    p += 4;
+    p = PutLE(p, 1, 2);
+    p = PutLE(p, width, 2);
+    p = PutLE(p, height, 2);
+    p = PutLE(p, 0, 2);
+    fileOk = file->write(header, sizeof(header)) == sizeof(header);
+
+    if (!fileOk  ||  xTaskCreate(&_ScreenRecorderTaskMain, "ScreenRecorder", 4096, this, 1, &writerTask) != pdPASS) {
+        LogError("Unable to start capture.");
+        writerTask = nullptr;
+        file.reset();
+        freeBlocks();
+        return false;
+    }
+
+    for (size_t i = 0 ; i < numBlocks ; i++) {
+        Block* block = &blocks[i];
+        xQueueSend(freeQueue, &block, 0);
+    }
+
+    resumeRow = -1;
+    firstDeferredRow = -1;
+    frame = 0;
+    numDeferredRows = 0;
+    curBlock = nullptr;
+    this->screen = &screen;
+    screen.setRecorder(this);
+    return true;
+}
+
+void ScreenRecorder::stop()
+{
+    if (!screen) {
+        return;
+    }
+
+    screen->setRecorder(nullptr);
+    screen = nullptr;
+
+    if (curBlock) {
+        curBlock->flags |= RecordFlagFrameEnd;
+        submitBlock(curBlock);
+        curBlock = nullptr;
+    }
+
+    // The writer task passes the null block back once everything queued
+    // before it is written, and exits.
+    Block* block = nullptr;
+    xQueueSend(writeQueue, &block, portMAX_DELAY);
+    do {
+        xQueueReceive(freeQueue, &block, portMAX_DELAY);
+    } while (block);
+    writerTask = nullptr;
+
+    file->flush();
+    file.reset();
+    freeBlocks();
+
+    LogInfo("Captured %u frames, %u rows deferred.", (unsigned int) frame, (unsigned int) numDeferredRows);
+}
+
+void ScreenRecorder::recordRows(int32_t y, int32_t numRows)
+{
+    if (!screen) {
+        return;
+    }
+
+    const int32_t yStart = std::max<int32_t>(y, 0);
+    const int32_t yEnd = std::min<int32_t>(y+numRows, height);
+
+    if (yStart < yEnd) {
+        if (resumeRow > yStart  &&  resumeRow < yEnd) {
+            // Start with the rows that were deferred last, so that rows further
+            // down aren't deferred forever while the queue stays full.
+            recordRowRange(resumeRow, yEnd);
+            recordRowRange(yStart, resumeRow);
+        } else {
+            recordRowRange(yStart, yEnd);
+        }
+    }
+
+    if (yEnd >= height) {
+        // Even frames without changes get a record, for their time stamp
+        if (!curBlock) {
+            curBlock = acquireBlock();
+        }
+        if (curBlock) {
+            curBlock->flags |= RecordFlagFrameEnd;
+            submitBlock(curBlock);
+            curBlock = nullptr;
+        }
+        resumeRow = firstDeferredRow;
+        firstDeferredRow = -1;
+        frame++;
+
+        if (frame % KeyframeInterval == 0) {
+            // Record every row again, in case a change went unnoticed because
+            // of a hash collision.
+            std::fill(rowKnown.begin(), rowKnown.end(), 0);
+        }
+    }
+}
+
+void ScreenRecorder::recordRowRange(int32_t yStart, int32_t yEnd)
+{
+    const size_t entryBytes = 2 + width*sizeof(uint16_t);
+
+    for (int32_t row = yStart ; row < yEnd ; row++) {
+        if (curBlock  &&  curBlock->used + entryBytes > blockBytes) {
+            submitBlock(curBlock);
+            curBlock = nullptr;
+        }
+        if (!curBlock) {
+            curBlock = acquireBlock();
+        }
+        if (!curBlock) {
+            // The queue is full. The row keeps its old hash, so if it changed,
+            // it will be recorded in a later frame.
+            if (firstDeferredRow < 0) {
+                firstDeferredRow = row;
+            }
+            numDeferredRows++;
+            continue;
+        }
+
+        uint8_t* entry = curBlock->data + curBlock->used;
+        uint16_t* pixels = reinterpret_cast<uint16_t*>(entry + 2);
+        screen->readRegion(Rect(0, row, width, 1), pixels, width);
+
+        const uint32_t hash = hashRow(pixels, width);
+        if (rowKnown[row]  &&  rowHashes[row] == hash) {
+            continue;
+        }
+        rowHashes[row] = hash;
+        rowKnown[row] = 1;
+
+        const uint16_t rowIndex = static_cast<uint16_t>(row);
+        memcpy(entry, &rowIndex, sizeof(rowIndex));
+        curBlock->used += entryBytes;
+        curBlock->numRows++;
+    }
+}
+
+ScreenRecorder::Block* ScreenRecorder::acquireBlock()
+{
+    Block* block;
+    if (xQueueReceive(freeQueue, &block, 0) != pdTRUE) {
+        return nullptr;
+    }
+    return block;
+}
+
+void ScreenRecorder::submitBlock(Block* block)
+{
+    block->frame = frame;
+    block->timeMs = static_cast<uint32_t>(TimerGetTickcountMs());
+
+    // Never blocks: The queue has room for every block.
+    xQueueSend(writeQueue, &block, portMAX_DELAY);
+}
+
+void ScreenRecorder::writerTaskMain()
+{
+    while (true) {
+        Block* block;
+        xQueueReceive(writeQueue, &block, portMAX_DELAY);
+
+        if (block) {
+            writeBlock(block);
+            block->used = 0;
+            block->numRows = 0;
+            block->flags = 0;
+        }
+
+        // The queues order all accesses to the block, so nothing else needs
+        // to be synchronized.
+        xQueueSend(freeQueue, &block, portMAX_DELAY);
+
+        if (!block) {
+            break;
+        }
+    }
+
+    // FreeRTOS tasks must not return
+    vTaskDelete(nullptr);
+}
+
+void ScreenRecorder::writeBlock(Block* block)
+{
+    if (!fileOk) {
+        return;
+    }
+
+    uint8_t* p = encodeBuf;
+    p = PutLE(p, block->frame, 4);
+    p = PutLE(p, block->timeMs, 4);
+    p = PutLE(p, block->flags, 1);
+    p = PutLE(p, block->numRows, 2);
+
+    const size_t entryBytes = 2 + width*sizeof(uint16_t);
+    for (uint16_t i = 0 ; i < block->numRows ; i++) {
+        const uint8_t* entry = block->data + i*entryBytes;
+        const uint16_t* pixels = reinterpret_cast<const uint16_t*>(entry + 2);
+        uint16_t row;
+        memcpy(&row, entry, 2);
+
+        p = PutLE(p, row, 2);
+        const size_t size = encodeRow(pixels, width, p+2);
+        p = PutLE(p, size, 2);
+        p += size;
+    }
+
+    const size_t size = p - encodeBuf;
+    if (file->write(encodeBuf, size) != size) {
+        LogError("Error writing capture file, stopping to write.");
+        fileOk = false;
+    }
+}
+
+uint32_t ScreenRecorder::hashRow(const uint16_t* row, uint16_t w)
+{
+    // FNV-1a, two pixels at a time
+    uint32_t hash = 2166136261u;
+    uint16_t x = 0;
+    for ( ; x+1 < w ; x += 2) {
+        hash = (hash ^ (row[x] | (static_cast<uint32_t>(row[x+1]) << 16))) * 16777619u;
+    }
+    if (x < w) {
+        hash = (hash ^ row[x]) * 16777619u;
+    }
+    return hash;
+}
+
+size_t ScreenRecorder::encodeRow(const uint16_t* row, uint16_t w, uint8_t* out)
+{
+    uint8_t* p = out;
+    uint16_t x = 0;
+    while (x < w) {
+        // A run of at least 2 equal pixels
+        uint16_t runLen = 1;
+        while (x+runLen < w  &&  runLen < 128  &&  row[x+runLen] == row[x]) {
+            runLen++;
+        }
+        if (runLen >= 2) {
+            *p++ = static_cast<uint8_t>(127 + runLen);
+            p = PutLE(p, Color::fromPixel(row[x]).toRGB565(), 2);
+            x += runLen;
+            continue;
+        }
+
+        // Literals, up to the next run
+        uint16_t litLen = 1;
+        while (x+litLen < w  &&  litLen < 128  &&  !(x+litLen+1 < w  &&  row[x+litLen] == row[x+litLen+1])) {
+            litLen++;
+        }
+        *p++ = static_cast<uint8_t>(litLen - 1);
+        for (uint16_t i = 0 ; i < litLen ; i++) {
+            p = PutLE(p, Color::fromPixel(row[x+i]).toRGB565(), 2);
+        }
+        x += litLen;
+    }
+    return p - out;
+}
+
+void ScreenRecorder::freeBlocks()
+{
+    if (blocks) {
+        for (size_t i = 0 ; i < numBlocks ; i++) {
+            free(blocks[i].data);
+        }
+        delete[] blocks;
+    }
+    blocks = nullptr;
+    numBlocks = 0;
+    free(encodeBuf);
+    encodeBuf = nullptr;
+    encodeBufBytes = 0;
+
+    if (freeQueue) {
+        vQueueDelete(freeQueue);
+        freeQueue = nullptr;
+    }
+    if (writeQueue) {
+        vQueueDelete(writeQueue);
+        writeQueue = nullptr;
+    }
+}
+
+
+}
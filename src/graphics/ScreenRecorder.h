@@ -0,0 +1,190 @@
+#pragma once
+
+#include "../Globals.h"
+
+#include "../storage/File.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <memory>
+#include <vector>
+
+
+namespace MINTGGGameEngine
+{
+
+class Screen;
+
+/**
+ * \brief Records every frame committed to a screen into a capture file.
+ *
+ * This is meant for bug reports and trailers, recorded on the device itself.
+ * Once started, the screen passes every finished frame (or band) to the
+ * recorder when it is committed (see Screen::setRecorder()). The recorder
+ * compares each row with its hash from the previous frame, and only copies
+ * rows that changed into a queue of fixed-size blocks. A background task
+ * compresses the blocks with a run-length encoding and writes them to the
+ * file. The frame loop thus only pays for reading and hashing the rows.
+ *
+ * The queue is bounded (see start()). If the background task falls behind,
+ * changed rows that don't fit into the queue are not recorded in that frame.
+ * Their hashes are kept, so they are recorded in one of the next frames
+ * instead, i.e. the capture lags behind briefly.
+ *
+ * A row that changed, but happens to have the same 32-bit hash as before, is
+ * not recorded. To keep such rows from staying wrong in the capture, every
+ * row is recorded again every KeyframeInterval frames.
+ *
+ * Use tools/capture2video.py to convert a capture file to a video.
+ *
+ * \section fileformat File Format
+ *
+ * All values are little-endian. The file starts with a header:
+ *
+ * - char[4]: "MGCP"
+ * - uint16: Format version (1)
+ * - uint16: Width
+ * - uint16: Height
+ * - uint16: Reserved (0)
+ *
+ * It is followed by any number of records, each holding changed rows of a
+ * frame:
+ *
+ * - uint32: Frame number
+ * - uint32: Time the frame was committed, in milliseconds
+ * - uint8: Flags (RecordFlagFrameEnd if this is the frame's last record)
+ * - uint16: Number of rows
+ *
+ * Every row is stored as:
+ *
+ * - uint16: Row index
+ * - uint16: Size of the encoded pixels, in bytes
+ * - The encoded RGB565 pixels: A control byte c is followed by c+1 literal
+ *   pixels if c < 128, or by a single pixel to be repeated c-127 times
+ *   otherwise.
+ */
+class ScreenRecorder
+{
+    friend void _ScreenRecorderTaskMain(void* params);
+
+public:
+    enum
+    {
+        DefaultQueueBytes = 16384,
+        BlockBytes = 4096,
+
+        // Frames after which all rows are recorded again, changed or not
+        KeyframeInterval = 60
+    };
+
+    enum RecordFlags
+    {
+        RecordFlagFrameEnd = 0x01
+    };
+
+private:
+    struct Block
+    {
+        uint8_t* data; // Entries of uint16 row index and the raw row
+        size_t used;
+        uint16_t numRows;
+        uint32_t frame;
+        uint32_t timeMs;
+        uint8_t flags;
+    };
+
+public:
+    ScreenRecorder();
+    ScreenRecorder(const ScreenRecorder& other) = delete;
+    ~ScreenRecorder();
+
+    /**
+     * \brief Start recording a screen.
+     *
+     * \param screen The screen. It must stay valid until stop() is called.
+     * \param path The capture file to write. An existing file is replaced.
+     * \param queueBytes The memory to use for rows waiting to be written. At
+     *      least two blocks of BlockBytes (or one row, if that's larger) are
+     *      used.
+     * \return true if successful, false if the file can't be created or
+     *      there is not enough memory.
+     */
+    bool start(Screen& screen, const char* path, size_t queueBytes = DefaultQueueBytes);
+
+    /**
+     * \brief Stop recording, waiting until all queued rows are written.
+     */
+    void stop();
+
+    bool isRecording() const { return screen != nullptr; }
+
+    /**
+     * \brief Return the number of frames recorded so far.
+     */
+    uint32_t getNumFrames() const { return frame; }
+
+    /**
+     * \brief Return the number of times that a row was deferred to a later
+     *      frame, because the queue was full.
+     */
+    uint32_t getNumDeferredRows() const { return numDeferredRows; }
+
+    /**
+     * \brief Record rows of the current frame.
+     *
+     * Called by the screen when rows are committed. The frame is finished once
+     * its last row has been passed.
+     *
+     * \param y The first row.
+     * \param numRows The number of rows.
+     */
+    void recordRows(int32_t y, int32_t numRows);
+
+private:
+    void recordRowRange(int32_t yStart, int32_t yEnd);
+
+    Block* acquireBlock();
+    void submitBlock(Block* block);
+    void writeBlock(Block* block);
+
+    void writerTaskMain();
+
+    static uint32_t hashRow(const uint16_t* row, uint16_t w);
+    static size_t encodeRow(const uint16_t* row, uint16_t w, uint8_t* out);
+
+    void freeBlocks();
+
+private:
+    Screen* screen;
+    std::unique_ptr<File> file;
+    bool fileOk;
+
+    uint16_t width;
+    uint16_t height;
+
+    std::vector<uint32_t> rowHashes;
+    std::vector<uint8_t> rowKnown;
+
+    Block* blocks;
+    size_t numBlocks;
+    size_t blockBytes;
+    Block* curBlock;
+
+    // Blocks are passed between the frame loop and the writer task through
+    // these queues only. A null block tells the writer task to exit.
+    QueueHandle_t freeQueue;
+    QueueHandle_t writeQueue;
+    TaskHandle_t writerTask;
+
+    uint8_t* encodeBuf; // Only used by the writer task
+    size_t encodeBufBytes;
+
+    int32_t resumeRow; // First row deferred in the last frame, or -1
+    int32_t firstDeferredRow; // First row deferred in this frame, or -1
+    uint32_t frame;
+    uint32_t numDeferredRows;
+};
+
+}
@@ -1,6 +1,8 @@
 #include "Sprite.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 
 
 namespace MINTGGGameEngine
@@ -20,8 +22,15 @@ Sprite::Sprite(const Sprite& other)
         circle.r = other.circle.r;
         circle.color = other.circle.color;
         circle.filled = other.circle.filled;
+        circleRects = other.circleRects;
     } else if (type == Type::Bitmap) {
         bitmap = other.bitmap;
+        transform.scaleX = other.transform.scaleX;
+        transform.scaleY = other.transform.scaleY;
+        transform.angle = other.transform.angle;
+        transform.alpha = other.transform.alpha;
+    } else if (type == Type::IndexedBitmap) {
+        indexedBitmap = other.indexedBitmap;
     } else {
         assert(false);
     }
@@ -43,13 +52,44 @@ Sprite Sprite::createCircle(float r, const Color& color, bool filled)
     s.circle.r = r;
     s.circle.color = color;
     s.circle.filled = filled;
+
+    if (filled) {
+        auto rects = std::make_shared<std::vector<Rect>>();
+        rasterizeCircle(static_cast<int32_t>(r), *rects);
+        s.circleRects = rects;
+    }
     return s;
 }
 
 Sprite Sprite::createBitmap(const Bitmap& bitmap)
+{
+    return createBitmap(bitmap, 1.0f, 1.0f, 0.0f);
+}
+
+Sprite Sprite::createBitmap(const Bitmap& bitmap, float scaleX, float scaleY, float angle)
 {
     Sprite s(Type::Bitmap);
     s.bitmap = bitmap;
+    s.transform.scaleX = scaleX;
+    s.transform.scaleY = scaleY;
+    s.transform.angle = angle;
+    s.transform.alpha = 255;
+    return s;
+}
+
+Sprite Sprite::createBitmap(const IndexedBitmap& bitmap)
+{
+    Sprite s(Type::IndexedBitmap);
+    s.indexedBitmap = bitmap;
+    return s;
+}
+
+Sprite Sprite::withAlpha(uint8_t alpha) const
+{
+    Sprite s(*this);
+    if (s.type == Type::Bitmap) {
+        s.transform.alpha = alpha;
+    }
     return s;
 }
 
@@ -60,7 +100,9 @@ float Sprite::getWidth() const
     } else if (type == Type::Circle) {
         return 2*circle.r;
     } else if (type == Type::Bitmap) {
-        return bitmap.getWidth();
+        return bitmap.getWidth() * fabsf(transform.scaleX);
+    } else if (type == Type::IndexedBitmap) {
+        return indexedBitmap.getWidth();
     }
     return 0;
 }
@@ -72,7 +114,9 @@ float Sprite::getHeight() const
     } else if (type == Type::Circle) {
         return 2*circle.r;
     } else if (type == Type::Bitmap) {
-        return bitmap.getHeight();
+        return bitmap.getHeight() * fabsf(transform.scaleY);
+    } else if (type == Type::IndexedBitmap) {
+        return indexedBitmap.getHeight();
     }
     return 0;
 }
@@ -82,14 +126,63 @@ void Sprite::draw(Screen& screen, float x, float y, FlipDir flipDir) const
     if (type == Type::Rect) {
         screen.drawRect(roundf(x), roundf(y), rect.w, rect.h, rect.color, rect.filled);
     } else if (type == Type::Circle) {
-        float cx = x + circle.r;
-        float cy = y + circle.r;
-        screen.drawCircle(roundf(cx), roundf(cy), circle.r, circle.color, circle.filled);
+        const int32_t cx = roundf(x + circle.r);
+        const int32_t cy = roundf(y + circle.r);
+        if (circleRects) {
+            screen.fillRects(cx, cy, circleRects->data(), circleRects->size(), circle.color);
+        } else {
+            screen.drawCircle(cx, cy, circle.r, circle.color, circle.filled);
+        }
     } else if (type == Type::Bitmap) {
-        if (bitmap) {
+        if (!bitmap) {
+            // Nothing to draw
+        } else if (isTransformed()) {
+            const bool flipX = flipDir == FlipDir::Horizontal  ||  flipDir == FlipDir::Both;
+            const bool flipY = flipDir == FlipDir::Vertical  ||  flipDir == FlipDir::Both;
+            screen.drawBitmapTransformed (
+                x + getWidth()*0.5f, y + getHeight()*0.5f,
+                bitmap,
+                flipX ? -transform.scaleX : transform.scaleX,
+                flipY ? -transform.scaleY : transform.scaleY,
+                transform.angle
+                );
+        } else if (transform.alpha != 255  ||  bitmap.getAlpha()) {
+            screen.drawBitmapBlended(roundf(x), roundf(y), bitmap, transform.alpha, flipDir);
+        } else {
             screen.drawBitmap(roundf(x), roundf(y), bitmap, flipDir);
         }
+    } else if (type == Type::IndexedBitmap) {
+        if (indexedBitmap) {
+            screen.drawIndexedBitmap(roundf(x), roundf(y), indexedBitmap, flipDir);
+        }
+    }
+}
+
+Rect Sprite::getDrawRect(float x, float y) const
+{
+    // Must round exactly like draw(), so that Game can detect every change of
+    // the drawn pixels.
+    if (type == Type::Rect) {
+        return Rect(roundf(x), roundf(y), rect.w, rect.h);
+    } else if (type == Type::Circle) {
+        int32_t r = circle.r;
+        int32_t cx = roundf(x + circle.r);
+        int32_t cy = roundf(y + circle.r);
+        return Rect(cx-r, cy-r, 2*r+1, 2*r+1);
+    } else if (type == Type::Bitmap) {
+        if (isTransformed()) {
+            return Screen::calcTransformedBounds (
+                x + getWidth()*0.5f, y + getHeight()*0.5f,
+                bitmap.getWidth(), bitmap.getHeight(),
+                transform.scaleX, transform.scaleY,
+                transform.angle
+                );
+        }
+        return Rect(roundf(x), roundf(y), bitmap.getWidth(), bitmap.getHeight());
+    } else if (type == Type::IndexedBitmap) {
+        return Rect(roundf(x), roundf(y), indexedBitmap.getWidth(), indexedBitmap.getHeight());
     }
+    return Rect();
 }
 
 Sprite& Sprite::operator=(const Sprite& other)
@@ -107,14 +200,66 @@ Sprite& Sprite::operator=(const Sprite& other)
         circle.r = other.circle.r;
         circle.color = other.circle.color;
         circle.filled = other.circle.filled;
+        circleRects = other.circleRects;
         bitmap = Bitmap();
     } else if (type == Type::Bitmap) {
         bitmap = other.bitmap;
+        transform.scaleX = other.transform.scaleX;
+        transform.scaleY = other.transform.scaleY;
+        transform.angle = other.transform.angle;
+        transform.alpha = other.transform.alpha;
+    } else if (type == Type::IndexedBitmap) {
+        indexedBitmap = other.indexedBitmap;
+        bitmap = Bitmap();
     } else {
         bitmap = Bitmap();
         assert(false);
     }
+    if (type != Type::IndexedBitmap) {
+        indexedBitmap = IndexedBitmap();
+    }
+    if (type != Type::Circle) {
+        circleRects.reset();
+    }
     return *this;
 }
 
+void Sprite::rasterizeCircle(int32_t r, std::vector<Rect>& rects)
+{
+    rects.clear();
+    if (r < 0) {
+        return;
+    }
+
+    // The half-width of each row, indexed by the distance from the center row
+    std::vector<int32_t> halfWidths(r+1, 0);
+
+    // The same midpoint circle as in ScreenFramebuffer::drawCircle()
+    int32_t x = 0;
+    int32_t y = r;
+    int32_t d = 1 - r;
+    while (x <= y) {
+        halfWidths[y] = std::max(halfWidths[y], x);
+        halfWidths[x] = std::max(halfWidths[x], y);
+        if (d < 0) {
+            d += 2*x + 3;
+        } else {
+            d += 2*(x-y) + 5;
+            y--;
+        }
+        x++;
+    }
+
+    // Rows as wide as the previous one extend its rectangle downwards
+    for (int32_t dy = -r ; dy <= r ; dy++) {
+        const int32_t hw = halfWidths[std::abs(dy)];
+        if (!rects.empty()  &&  rects.back().x == -hw) {
+            rects.back().h++;
+        } else {
+            rects.push_back(Rect(-hw, dy, 2*hw+1, 1));
+        }
+    }
+    rects.shrink_to_fit();
+}
+
 }
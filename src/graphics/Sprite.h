@@ -1,28 +1,43 @@
 #pragma once
 
 #include "../Globals.h"
+#include "../util/Rect.h"
 #include "Bitmap.h"
 #include "Color.h"
+#include "IndexedBitmap.h"
 #include "Screen.h"
 
+#include <memory>
+#include <vector>
+
 namespace MINTGGGameEngine
 {
 
 /**
  * \brief The visual representation of a GameObject.
  *
- * Currently, four types of sprites are supported.
+ * Currently, five types of sprites are supported.
  *
  * The Null type is an invisible sprite. This is useful is an object should
  * function purely as an invisible collider.
  *
  * The Rect type is an axis-aligned rectangle with a solid color.
  *
- * The Circle type is a circle with a solid color.
+ * The Circle type is a circle with a solid color. Filled circles are
+ * rasterized once when the sprite is created, into rectangles of equally wide
+ * rows that are filled when drawing (see Screen::fillRects()). Copies of the
+ * sprite share them, so create a circle sprite once and reuse it, e.g. for all
+ * particles of the same size.
  *
  * The Bitmap type is a rectangular bitmap, i.e. an array of color pixel values.
+ * It can optionally be drawn scaled and rotated around its center, without
+ * creating a copy of the bitmap. Bitmaps with an alpha plane, or sprites with
+ * an alpha below 255 (see withAlpha()), are blended over the background.
+ *
+ * The IndexedBitmap type is a rectangular bitmap of palette indices.
  *
  * \see Bitmap
+ * \see IndexedBitmap
  */
 class Sprite
 {
@@ -32,7 +47,8 @@ public:
         Null,
         Rect,
         Circle,
-        Bitmap
+        Bitmap,
+        IndexedBitmap
     };
 
 public:
@@ -40,6 +56,22 @@ public:
     static Sprite createCircle(float r, const Color& color, bool filled = true);
     static Sprite createBitmap(const Bitmap& bitmap);
 
+    /**
+     * \brief Create a bitmap sprite that is drawn scaled and rotated.
+     *
+     * The sprite's size is that of the scaled, unrotated bitmap, and it is
+     * rotated around its center. Changing the angle every frame is cheap: Just
+     * set a new sprite with GameObject::setSprite().
+     *
+     * \param bitmap The bitmap.
+     * \param scaleX The horizontal scale factor.
+     * \param scaleY The vertical scale factor.
+     * \param angle The clockwise rotation, in radians.
+     * \see Screen::drawBitmapTransformed()
+     */
+    static Sprite createBitmap(const Bitmap& bitmap, float scaleX, float scaleY, float angle = 0.0f);
+    static Sprite createBitmap(const IndexedBitmap& bitmap);
+
 public:
     /**
      * \brief Create a Null sprite, i.e. one that is invisible.
@@ -79,16 +111,64 @@ public:
      */
     Bitmap getBitmap() const { return (type == Type::Bitmap) ? bitmap : Bitmap(); }
 
+    /**
+     * \brief Check if this is a Bitmap type sprite that is drawn scaled or
+     *      rotated.
+     */
+    bool isTransformed() const
+    {
+        return type == Type::Bitmap
+                &&  (transform.scaleX != 1.0f  ||  transform.scaleY != 1.0f  ||  transform.angle != 0.0f);
+    }
+
+    /**
+     * \brief Return the global alpha of a Bitmap type sprite, or 255 for all
+     *      other types.
+     */
+    uint8_t getAlpha() const { return type == Type::Bitmap ? transform.alpha : 255; }
+
+    /**
+     * \brief Return a copy of this sprite drawn with the given global alpha.
+     *
+     * This is meant for fading Bitmap type sprites in and out (see
+     * Screen::drawBitmapBlended()). Other types are returned unchanged, and so
+     * is the alpha of scaled or rotated sprites, which are always drawn
+     * opaque.
+     *
+     * \param alpha The alpha, from 0 (invisible) to 255 (opaque).
+     */
+    Sprite withAlpha(uint8_t alpha) const;
+
+    /**
+     * \brief Return the indexed bitmap behind the sprite.
+     *
+     * \return The bitmap, or an invalid bitmap for non-IndexedBitmap type
+     *      sprites.
+     */
+    IndexedBitmap getIndexedBitmap() const
+            { return (type == Type::IndexedBitmap) ? indexedBitmap : IndexedBitmap(); }
+
     /**
      * \brief Draw the given bitmap on a screen.
      */
     void draw(Screen& screen, float x, float y, FlipDir flipDir) const;
 
+    /**
+     * \brief Return the pixels that draw() would cover for the same position.
+     */
+    Rect getDrawRect(float x, float y) const;
+
     Sprite& operator=(const Sprite& other);
 
 private:
     Sprite(Type type) : type(type) {}
 
+    /**
+     * \brief Rasterize a filled circle like Screen::drawCircle() does, into
+     *      rectangles relative to its center.
+     */
+    static void rasterizeCircle(int32_t r, std::vector<Rect>& rects);
+
 private:
     Type type;
     union {
@@ -104,8 +184,17 @@ private:
             Color color;
             bool filled;
         } circle;
+
+        struct {
+            float scaleX;
+            float scaleY;
+            float angle;
+            uint8_t alpha;
+        } transform; // For Type::Bitmap
     };
     Bitmap bitmap; // Don't put this in the enum because of it's non-trivial destructor
+    IndexedBitmap indexedBitmap;
+    std::shared_ptr<const std::vector<Rect>> circleRects; // For filled Type::Circle
 };
 
 }
@@ -1,11 +1,114 @@
 #include "Text.h"
 
 #include <algorithm>
+#include <cstring>
+
+#include "../util/Log.h"
+#include "GlyphCache.h"
 
 
 namespace MINTGGGameEngine
 {
 
+
+LOG_USE_TAG("Text")
+
+
+// Invalid bytes are taken as ISO 8859-1 characters, so text that isn't UTF-8
+// still looks the same as before with the default fonts.
+static void DecodeUTF8(const std::string& str, std::vector<uint16_t>& out)
+{
+    static const uint32_t minCP[] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+    out.clear();
+    out.reserve(str.size());
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(str.data());
+    const uint8_t* end = p + str.size();
+    while (p != end) {
+        const uint8_t c = *p;
+        uint32_t cp;
+        size_t len;
+        if (c < 0x80) {
+            out.push_back(c);
+            p++;
+            continue;
+        } else if ((c & 0xE0) == 0xC0) {
+            cp = c & 0x1F;
+            len = 2;
+        } else if ((c & 0xF0) == 0xE0) {
+            cp = c & 0x0F;
+            len = 3;
+        } else if ((c & 0xF8) == 0xF0) {
+            cp = c & 0x07;
+            len = 4;
+        } else {
+            len = 0;
+        }
+
+        bool valid = len != 0  &&  static_cast<size_t>(end-p) >= len;
+        for (size_t i = 1 ; valid  &&  i < len ; i++) {
+            valid = (p[i] & 0xC0) == 0x80;
+            cp = (cp << 6) | (p[i] & 0x3F);
+        }
+        if (!valid  ||  cp < minCP[len]) {
+            // Also rejects overlong encodings
+            out.push_back(c);
+            p++;
+            continue;
+        }
+
+        // Fonts only have 16-bit code points
+        out.push_back(cp <= 0xFFFF ? static_cast<uint16_t>(cp) : '?');
+        p += len;
+    }
+}
+
+static void CalcTextMetrics(const std::vector<uint16_t>& codePoints, Text::TextMetrics& metrics)
+{
+    if (codePoints.empty()) {
+        metrics.numLines = 0;
+        metrics.maxGlyphsPerLine = 0;
+        return;
+    }
+
+    size_t numLines = 1;
+    size_t maxGlyphsPerLine = 0;
+
+    size_t curGlyphsPerLine = 0;
+    for (uint16_t c : codePoints) {
+        if (c == '\n') {
+            numLines++;
+            maxGlyphsPerLine = std::max(maxGlyphsPerLine, curGlyphsPerLine);
+            curGlyphsPerLine = 0;
+        } else {
+            curGlyphsPerLine++;
+        }
+    }
+    maxGlyphsPerLine = std::max(maxGlyphsPerLine, curGlyphsPerLine);
+
+    metrics.numLines = numLines;
+    metrics.maxGlyphsPerLine = maxGlyphsPerLine;
+}
+
+// Set n bits of a mask row, starting at bit x
+static void SetMaskBits(uint8_t* row, uint32_t x, uint32_t n)
+{
+    const uint32_t end = x+n;
+    while (x < end  &&  (x&7) != 0) {
+        row[x>>3] |= 0x80 >> (x&7);
+        x++;
+    }
+    if (end-x >= 8) {
+        memset(row + (x>>3), 0xFF, (end-x) >> 3);
+        x += (end-x) & ~7u;
+    }
+    while (x < end) {
+        row[x>>3] |= 0x80 >> (x&7);
+        x++;
+    }
+}
+
 Text::Text (
     int32_t x, int32_t y,
     const Font& font,
@@ -22,35 +125,175 @@ Text::Text (
     d->anchor = Anchor::TopLeft;
     d->halign = HAlign::Left;
     d->text = text;
+    DecodeUTF8(d->text, d->codePoints);
+    CalcTextMetrics(d->codePoints, d->metrics);
     d->visible = true;
     d->worldSpace = false;
+    d->drawDirty = true;
+    d->renderCached = false;
+    d->bitmapDirty = true;
+    d->bitmapData = nullptr;
+    d->bitmapMask = nullptr;
+}
+
+void Text::setText(const std::string& text)
+{
+    if (text == d->text) {
+        return;
+    }
+    d->text = text;
+    DecodeUTF8(d->text, d->codePoints);
+    CalcTextMetrics(d->codePoints, d->metrics);
+    d->drawDirty = true;
+    d->bitmapDirty = true;
 }
 
-void Text::getTextMetrics(TextMetrics* metrics) const
+void Text::setNumber(int32_t value, uint8_t minDigits)
 {
-    if (d->text.empty()) {
-        metrics->numLines = 0;
-        metrics->maxGlyphsPerLine = 0;
+    // Sign and 10 digits at most
+    char buf[11];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+
+    uint32_t absValue = value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+    const uint8_t numDigits = std::min<uint8_t>(minDigits, 10);
+    do {
+        *--p = '0' + (absValue % 10);
+        absValue /= 10;
+    } while (absValue != 0  ||  end-p < numDigits);
+    if (value < 0) {
+        *--p = '-';
+    }
+
+    const size_t len = end-p;
+    if (d->text.size() == len  &&  memcmp(d->text.data(), p, len) == 0) {
         return;
     }
 
-    size_t numLines = 1;
-    size_t maxGlyphsPerLine = 0;
+    // Reuses the capacity of both the string and the code points
+    d->text.assign(p, len);
+    d->codePoints.resize(len);
+    std::copy(p, end, d->codePoints.begin());
 
-    size_t curGlyphsPerLine = 0;
-    for (char c : d->text) {
-        if (c == '\n') {
-            numLines++;
-            maxGlyphsPerLine = std::max(maxGlyphsPerLine, curGlyphsPerLine);
-            curGlyphsPerLine = 0;
-        } else {
-            curGlyphsPerLine++;
+    d->metrics.numLines = 1;
+    d->metrics.maxGlyphsPerLine = len;
+    d->drawDirty = true;
+    d->bitmapDirty = true;
+}
+
+void Text::setRenderCached(bool cached)
+{
+    d->renderCached = cached;
+    if (!cached) {
+        d->bitmap = Bitmap();
+        d->bitmapData = nullptr;
+        d->bitmapMask = nullptr;
+    }
+    d->bitmapDirty = true;
+}
+
+const Bitmap& Text::getRenderedBitmap() const
+{
+    if (d->renderCached  &&  d->bitmapDirty) {
+        renderBitmap();
+        d->bitmapDirty = false;
+    }
+    return d->bitmap;
+}
+
+void Text::renderBitmap() const
+{
+    const uint8_t glyphWidth = d->font.getGlyphWidth();
+    const uint8_t glyphHeight = d->font.getGlyphHeight();
+    const uint16_t scale = d->scaleFactor;
+
+    const size_t scaledGlyphWidth = static_cast<size_t>(glyphWidth)*scale;
+    const size_t scaledGlyphHeight = static_cast<size_t>(glyphHeight)*scale;
+    const size_t w = d->metrics.maxGlyphsPerLine * scaledGlyphWidth;
+    const size_t h = d->metrics.numLines * scaledGlyphHeight;
+
+    if (w == 0  ||  h == 0  ||  w > UINT16_MAX  ||  h > UINT16_MAX) {
+        d->bitmap = Bitmap();
+        d->bitmapData = nullptr;
+        d->bitmapMask = nullptr;
+        return;
+    }
+
+    const size_t maskStride = Bitmap::calcMaskBytesPerLine(w);
+
+    if (d->bitmap.getWidth() != w  ||  d->bitmap.getHeight() != h) {
+        d->bitmap = Bitmap();
+        d->bitmapData = static_cast<uint16_t*>(malloc(w*h*sizeof(uint16_t)));
+        d->bitmapMask = static_cast<uint8_t*>(malloc(maskStride*h));
+        if (!d->bitmapData  ||  !d->bitmapMask) {
+            LogError("Unable to allocate %ux%u text bitmap.", (unsigned int) w, (unsigned int) h);
+            free(d->bitmapData);
+            free(d->bitmapMask);
+            d->bitmapData = nullptr;
+            d->bitmapMask = nullptr;
+            return;
         }
+        d->bitmap = Bitmap::takeOwnership(w, h, d->bitmapData, d->bitmapMask);
     }
-    maxGlyphsPerLine = std::max(maxGlyphsPerLine, curGlyphsPerLine);
 
-    metrics->numLines = numLines;
-    metrics->maxGlyphsPerLine = maxGlyphsPerLine;
+    std::fill(d->bitmapData, d->bitmapData + w*h, d->color.toPixel());
+    memset(d->bitmapMask, 0, maskStride*h);
+
+    // Lay out the lines the same way Screen::drawText() does
+    const uint16_t* cptr = d->codePoints.data();
+    const uint16_t* cptrEnd = cptr + d->codePoints.size();
+    size_t py = 0;
+
+    const uint16_t* eolPtr;
+    do {
+        eolPtr = std::find(cptr, cptrEnd, '\n');
+
+        const size_t lineWidth = (eolPtr-cptr) * scaledGlyphWidth;
+        size_t px;
+        if (d->halign == HAlign::Center) {
+            px = w/2 - lineWidth/2;
+        } else if (d->halign == HAlign::Right) {
+            px = w - lineWidth;
+        } else {
+            px = 0;
+        }
+
+        for ( ; cptr != eolPtr ; cptr++, px += scaledGlyphWidth) {
+            const uint8_t* glyph = d->font.getGlyphBuffer(*cptr);
+            if (!glyph) {
+                continue;
+            }
+
+            const GlyphCache::Run* runs;
+            size_t numRuns;
+            if (GlyphCache::getInstance().get(glyph, glyphWidth, glyphHeight, runs, numRuns)) {
+                for (size_t i = 0 ; i < numRuns ; i++) {
+                    const GlyphCache::Run& r = runs[i];
+                    uint8_t* mrow = d->bitmapMask + (py + r.y*scale)*maskStride;
+                    for (size_t y = 0 ; y < static_cast<size_t>(r.h)*scale ; y++, mrow += maskStride) {
+                        SetMaskBits(mrow, px + r.x*scale, r.w*scale);
+                    }
+                }
+            } else {
+                const uint8_t byteW = (glyphWidth+7) / 8;
+                for (uint8_t gy = 0 ; gy < glyphHeight ; gy++) {
+                    for (uint8_t gx = 0 ; gx < glyphWidth ; gx++) {
+                        if (glyph[gy*byteW + (gx>>3)] & (0x80 >> (gx&7))) {
+                            uint8_t* mrow = d->bitmapMask + (py + gy*scale)*maskStride;
+                            for (uint16_t y = 0 ; y < scale ; y++, mrow += maskStride) {
+                                SetMaskBits(mrow, px + gx*scale, scale);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        cptr++;
+        py += scaledGlyphHeight;
+    } while (eolPtr != cptrEnd);
+
+    d->bitmap.buildSpans();
 }
 
 void Text::transformAnchorPosition (
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "../Globals.h"
+#include "../util/Rect.h"
+#include "Bitmap.h"
 #include "Color.h"
 #include "Font.h"
 
 #include <memory>
 #include <string>
+#include <vector>
 
 
 namespace MINTGGGameEngine
@@ -14,13 +17,21 @@ namespace MINTGGGameEngine
 /**
  * \brief Represents text visible on the screen.
  *
- * Text is defined by its content, position, size and color.
+ * Text is defined by its content, position, size and color. The content is
+ * UTF-8, and decoded into the font's code points whenever it is set. Bytes
+ * that are not valid UTF-8 are taken as ISO 8859-1 characters.
+ *
+ * The text's metrics are computed once whenever its content changes. Text that
+ * rarely changes (e.g. most UI labels) can additionally be rendered into a
+ * bitmap once (see setRenderCached()), so that drawing it costs a single blit.
  *
  * Text rendering is currently not well defined, and thus very dependent on the
  * actual rendering library used in the background.
  */
 class Text
 {
+    friend class Game;
+
 public:
     enum class Anchor
     {
@@ -61,8 +72,17 @@ private:
         Anchor anchor;
         HAlign halign;
         std::string text;
+        std::vector<uint16_t> codePoints; // text, decoded
+        TextMetrics metrics; // of codePoints
         bool visible;
         bool worldSpace;
+        Rect drawRect; // Screen area covered in the last frame, for Game's dirty regions
+        bool drawDirty; // Appearance changed since the last frame
+        bool renderCached;
+        bool bitmapDirty; // Content or appearance changed since the bitmap was rendered
+        Bitmap bitmap;
+        uint16_t* bitmapData; // Owned by bitmap
+        uint8_t* bitmapMask; // Owned by bitmap
     };
     
 public:
@@ -94,23 +114,79 @@ public:
     Anchor getAnchor() const { return d->anchor; }
     HAlign getHAlign() const { return d->halign; }
     const std::string& getText() const { return d->text; }
+
+    /**
+     * \brief Return the text decoded from UTF-8, one code point per glyph.
+     *
+     * Characters outside of the Basic Multilingual Plane are replaced by '?'.
+     */
+    const std::vector<uint16_t>& getCodePoints() const { return d->codePoints; }
     bool isVisible() const { return d->visible; }
     bool isWorldSpace() const { return d->worldSpace; }
+    bool isRenderCached() const { return d->renderCached; }
     
     void setPosition(int32_t x, int32_t y) { d->x = x; d->y = y; }
-    void setFont(const Font& font) { d->font = font; }
-    void setScaleFactor(uint16_t scaleFactor) { d->scaleFactor = scaleFactor; }
-    void setColor(const Color& color) { d->color = color; }
-    void setAnchor(Anchor anchor) { d->anchor = anchor; }
-    void setHAlign(HAlign halign) { d->halign = halign; }
-    void setText(const std::string& text) { d->text = text; }
+    void setFont(const Font& font) { d->font = font; d->drawDirty = true; d->bitmapDirty = true; }
+    void setScaleFactor(uint16_t scaleFactor) { d->scaleFactor = scaleFactor; d->drawDirty = true; d->bitmapDirty = true; }
+    void setColor(const Color& color) { d->color = color; d->drawDirty = true; d->bitmapDirty = true; }
+    void setAnchor(Anchor anchor) { d->anchor = anchor; d->drawDirty = true; }
+    void setHAlign(HAlign halign) { d->halign = halign; d->drawDirty = true; d->bitmapDirty = true; }
+
+    /**
+     * \brief Set the text content.
+     *
+     * Setting the current content again does nothing, so this can be called
+     * every frame without invalidating the cached layout and bitmap.
+     */
+    void setText(const std::string& text);
 #ifdef MINTGGGAMEENGINE_PORT_ARDUINO
     void setText(const String& text) { setText(std::string(text.c_str())); }
 #endif
-    void setVisible(bool visible) { d->visible = visible; }
-    void setWorldSpace(bool worldSpace) { d->worldSpace = worldSpace; }
 
-    void getTextMetrics(TextMetrics* metrics) const;
+    /**
+     * \brief Set the text content to a decimal number.
+     *
+     * The number is formatted into a buffer on the stack, and the text's
+     * storage is reused. Unlike setText(), this doesn't allocate once the text
+     * has held a number of the same length, so it's suitable for score
+     * counters and the like.
+     *
+     * \param value The number.
+     * \param minDigits The minimum number of digits, padded with leading
+     *      zeros, up to 10.
+     */
+    void setNumber(int32_t value, uint8_t minDigits = 0);
+
+    /**
+     * \brief Enable or disable caching the rendered text in a bitmap.
+     *
+     * When enabled, the text is rendered into a masked bitmap the first time it
+     * is drawn after its content, font, scale factor, color or alignment has
+     * changed. Otherwise, it is drawn with a single blit of that bitmap.
+     * Moving the text doesn't invalidate the bitmap.
+     *
+     * The bitmap takes 2 bytes per pixel of the text's bounding box, so this
+     * is disabled by default.
+     */
+    void setRenderCached(bool cached);
+    void setVisible(bool visible) { d->visible = visible; d->drawDirty = true; }
+    void setWorldSpace(bool worldSpace) { d->worldSpace = worldSpace; d->drawDirty = true; }
+
+    void getTextMetrics(TextMetrics* metrics) const { *metrics = d->metrics; }
+
+    /**
+     * \brief Return the text rendered into a masked bitmap, re-rendering it if
+     *      necessary.
+     *
+     * The bitmap covers the text's bounding box, i.e. its top-left corner is
+     * at the Anchor::TopLeft position of the text. It is updated in place when
+     * the text changes, as long as its size stays the same.
+     *
+     * \return The bitmap, or an invalid bitmap if render caching is disabled,
+     *      the text is empty or there is not enough memory.
+     * \see setRenderCached()
+     */
+    const Bitmap& getRenderedBitmap() const;
 
     void transformAnchorPosition (
         Anchor newAnchor,
@@ -121,6 +197,9 @@ public:
     bool operator==(const Text& other) const { return d == other.d; }
     bool operator!=(const Text& other) const { return d != other.d; }
 
+private:
+    void renderBitmap() const;
+
 private:
     std::shared_ptr<Data> d;
 };
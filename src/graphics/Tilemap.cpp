@@ -0,0 +1,178 @@
+#include "Tilemap.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../util/MathUtils.h"
+
+
+namespace MINTGGGameEngine
+{
+
+
+Tilemap::Tilemap (
+    const Bitmap& tileset,
+    uint16_t tileW, uint16_t tileH,
+    uint16_t cols, uint16_t rows,
+    bool wideIndices
+)
+    : d(std::make_shared<Data>())
+{
+    d->tileW = tileW;
+    d->tileH = tileH;
+    d->cols = cols;
+    d->rows = rows;
+    d->wideIndices = wideIndices;
+    d->x = 0.0f;
+    d->y = 0.0f;
+    d->visible = true;
+    d->drawDirty = true;
+
+    if (wideIndices) {
+        d->indices16.resize(static_cast<size_t>(cols)*rows, EmptyTile);
+    } else {
+        d->indices8.resize(static_cast<size_t>(cols)*rows, EmptyTile);
+    }
+
+    // Cutting the tiles out once means that drawing them is a plain bitmap
+    // blit, which copies whole rows at a time for unmasked tiles. The views
+    // share the tileset's pixels.
+    d->tileset = tileset;
+    if (tileset  &&  tileW != 0  &&  tileH != 0) {
+        const uint16_t tsCols = tileset.getWidth() / tileW;
+        const uint16_t tsRows = tileset.getHeight() / tileH;
+        const size_t maxTiles = wideIndices ? UINT16_MAX : UINT8_MAX;
+        d->tiles.reserve(std::min<size_t>(tsCols*tsRows, maxTiles));
+        for (uint16_t ty = 0 ; ty < tsRows ; ty++) {
+            for (uint16_t tx = 0 ; tx < tsCols  &&  d->tiles.size() < maxTiles ; tx++) {
+                d->tiles.push_back(tileset.view(tx*tileW, ty*tileH, tileW, tileH));
+            }
+        }
+    }
+}
+
+uint16_t Tilemap::getTileAt(float x, float y) const
+{
+    int32_t col = FloorDiv(static_cast<int32_t>(floorf(x - d->x)), d->tileW);
+    int32_t row = FloorDiv(static_cast<int32_t>(floorf(y - d->y)), d->tileH);
+    if (col < 0  ||  row < 0) {
+        return EmptyTile;
+    }
+    return getTile(static_cast<uint16_t>(std::min<int32_t>(col, UINT16_MAX)),
+                   static_cast<uint16_t>(std::min<int32_t>(row, UINT16_MAX)));
+}
+
+void Tilemap::setTile(uint16_t col, uint16_t row, uint16_t tile)
+{
+    if (col >= d->cols  ||  row >= d->rows) {
+        return;
+    }
+    const size_t cell = static_cast<size_t>(row)*d->cols + col;
+    if (d->wideIndices) {
+        d->indices16[cell] = tile;
+    } else if (tile <= UINT8_MAX) {
+        d->indices8[cell] = static_cast<uint8_t>(tile);
+    } else {
+        return;
+    }
+    markDirty(col, row, 1, 1);
+}
+
+void Tilemap::fill(uint16_t tile)
+{
+    if (d->wideIndices) {
+        std::fill(d->indices16.begin(), d->indices16.end(), tile);
+    } else if (tile <= UINT8_MAX) {
+        std::fill(d->indices8.begin(), d->indices8.end(), static_cast<uint8_t>(tile));
+    } else {
+        return;
+    }
+    markDirty(0, 0, d->cols, d->rows);
+}
+
+void Tilemap::setTiles(const uint8_t* tiles)
+{
+    const size_t numCells = static_cast<size_t>(d->cols)*d->rows;
+    if (d->wideIndices) {
+        std::copy(tiles, tiles + numCells, d->indices16.begin());
+    } else {
+        memcpy(d->indices8.data(), tiles, numCells);
+    }
+    markDirty(0, 0, d->cols, d->rows);
+}
+
+void Tilemap::setTiles(const uint16_t* tiles)
+{
+    const size_t numCells = static_cast<size_t>(d->cols)*d->rows;
+    if (d->wideIndices) {
+        memcpy(d->indices16.data(), tiles, numCells*sizeof(uint16_t));
+    } else {
+        for (size_t i = 0 ; i < numCells ; i++) {
+            d->indices8[i] = tiles[i] <= UINT8_MAX ? static_cast<uint8_t>(tiles[i]) : EmptyTile;
+        }
+    }
+    markDirty(0, 0, d->cols, d->rows);
+}
+
+void Tilemap::draw(Screen& screen, const Vec2& offset) const
+{
+    if (!d->visible  ||  d->tiles.empty()) {
+        return;
+    }
+
+    const int32_t sx = getDrawX(offset);
+    const int32_t sy = getDrawY(offset);
+    const int32_t tw = d->tileW;
+    const int32_t th = d->tileH;
+
+    // Only the tiles touching the clip rectangle
+    const Rect clip = screen.getClipRect();
+    if (clip.isEmpty()) {
+        return;
+    }
+    const int32_t colStart = std::max<int32_t>(0, FloorDiv(clip.x - sx, tw));
+    const int32_t colEnd = std::min<int32_t>(d->cols, FloorDiv(clip.getRight()-1 - sx, tw) + 1);
+    const int32_t rowStart = std::max<int32_t>(0, FloorDiv(clip.y - sy, th));
+    const int32_t rowEnd = std::min<int32_t>(d->rows, FloorDiv(clip.getBottom()-1 - sy, th) + 1);
+
+    const size_t numTiles = d->tiles.size();
+    for (int32_t row = rowStart ; row < rowEnd ; row++) {
+        const size_t rowCell = static_cast<size_t>(row)*d->cols;
+        const int32_t y = sy + row*th;
+        for (int32_t col = colStart ; col < colEnd ; col++) {
+            const uint16_t tile = getTileUnchecked(rowCell + col);
+            if (tile != EmptyTile  &&  tile <= numTiles) {
+                screen.drawBitmap(sx + col*tw, y, d->tiles[tile-1]);
+            }
+        }
+    }
+}
+
+size_t Tilemap::getMemoryUsage() const
+{
+    size_t memUsage = 0;
+    if (d) {
+        memUsage += sizeof(Data) + d->tileset.getMemoryUsage();
+        memUsage += d->indices8.capacity() + d->indices16.capacity()*sizeof(uint16_t);
+        for (const Bitmap& tile : d->tiles) {
+            memUsage += sizeof(Bitmap) + tile.getMemoryUsage();
+        }
+    }
+    return memUsage;
+}
+
+Bitmap Tilemap::getTileBitmap(uint16_t tile) const
+{
+    if (tile == EmptyTile  ||  tile > d->tiles.size()) {
+        return Bitmap();
+    }
+    return d->tiles[tile-1];
+}
+
+void Tilemap::markDirty(int32_t col, int32_t row, int32_t cols, int32_t rows)
+{
+    d->dirtyRect = d->dirtyRect.united(Rect(col*d->tileW, row*d->tileH, cols*d->tileW, rows*d->tileH));
+}
+
+
+}
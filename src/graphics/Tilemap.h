@@ -0,0 +1,221 @@
+#pragma once
+
+#include "../Globals.h"
+#include "../util/Rect.h"
+#include "../util/Vec2.h"
+#include "Bitmap.h"
+#include "Screen.h"
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+
+namespace MINTGGGameEngine
+{
+
+/**
+ * \brief A layer of equally-sized tiles, arranged in a grid.
+ *
+ * A tilemap stores one tile index per grid cell, referencing a tile in a
+ * tileset. The tileset is a single Bitmap containing all tiles, arranged in
+ * rows from left to right and top to bottom. Tile index 0 (EmptyTile) leaves a
+ * cell empty, index 1 is the top-left tile of the tileset, and so on.
+ *
+ * Tile indices take one byte per cell, or two if more than 255 tiles are
+ * needed. A 256x256 tile level thus takes 64 KB at most, and drawing only
+ * touches the tiles that are visible on the screen, no matter how large the
+ * map is.
+ *
+ * Tilemaps are added to a Game with Game::addTilemap(). They are positioned
+ * in world space, so they scroll with the camera, and are drawn behind all
+ * GameObject instances.
+ *
+ * This class uses shared pointers, so copying is cheap.
+ */
+class Tilemap
+{
+    friend class Game;
+    friend class BackgroundCache;
+
+public:
+    static constexpr uint16_t EmptyTile = 0;
+
+private:
+    struct Data
+    {
+        Bitmap tileset;
+        std::vector<Bitmap> tiles; // Views into tileset
+        uint16_t tileW;
+        uint16_t tileH;
+        uint16_t cols;
+        uint16_t rows;
+        std::vector<uint8_t> indices8; // Empty if wideIndices
+        std::vector<uint16_t> indices16; // Empty unless wideIndices
+        bool wideIndices;
+        float x;
+        float y;
+        bool visible;
+        Rect dirtyRect; // Changed tiles in map pixels, for Game's dirty regions
+        bool drawDirty; // Position or visibility changed since the last frame
+    };
+
+public:
+    /**
+     * \brief Create an invalid tilemap.
+     */
+    Tilemap() {}
+
+    /**
+     * \brief Create an empty tilemap.
+     *
+     * The tiles are views into the tileset (see Bitmap::view()), so no
+     * pixels are copied.
+     *
+     * \param tileset The bitmap containing all tiles. Its width and height
+     *      should be multiples of the tile size.
+     * \param tileW The width of a tile, in pixels.
+     * \param tileH The height of a tile, in pixels.
+     * \param cols The number of tiles per row of the map.
+     * \param rows The number of rows of the map.
+     * \param wideIndices true to use 16-bit tile indices, false to use 8-bit
+     *      indices (up to 255 tiles).
+     */
+    Tilemap (
+        const Bitmap& tileset,
+        uint16_t tileW, uint16_t tileH,
+        uint16_t cols, uint16_t rows,
+        bool wideIndices = false
+        );
+
+    Tilemap(const Tilemap& other) : d(other.d) {}
+
+    uint16_t getTileWidth() const { return d->tileW; }
+    uint16_t getTileHeight() const { return d->tileH; }
+    uint16_t getColumns() const { return d->cols; }
+    uint16_t getRows() const { return d->rows; }
+
+    /**
+     * \brief Return the number of tiles in the tileset.
+     */
+    uint16_t getTileCount() const { return static_cast<uint16_t>(d->tiles.size()); }
+
+    /**
+     * \brief Return the width of the entire map, in pixels.
+     */
+    int32_t getWidth() const { return static_cast<int32_t>(d->cols) * d->tileW; }
+
+    /**
+     * \brief Return the height of the entire map, in pixels.
+     */
+    int32_t getHeight() const { return static_cast<int32_t>(d->rows) * d->tileH; }
+
+    float getX() const { return d->x; }
+    float getY() const { return d->y; }
+    bool isVisible() const { return d->visible; }
+
+    /**
+     * \brief Set the world position of the map's top-left corner.
+     */
+    void setPosition(float x, float y) { d->x = x; d->y = y; d->drawDirty = true; }
+
+    void setVisible(bool visible) { d->visible = visible; d->drawDirty = true; }
+
+    /**
+     * \brief Return the tile index of a cell, or EmptyTile if it is outside
+     *      the map.
+     */
+    uint16_t getTile(uint16_t col, uint16_t row) const
+    {
+        if (col >= d->cols  ||  row >= d->rows) {
+            return EmptyTile;
+        }
+        return getTileUnchecked(static_cast<size_t>(row)*d->cols + col);
+    }
+
+    /**
+     * \brief Return the tile index at a world position, or EmptyTile if it is
+     *      outside the map.
+     */
+    uint16_t getTileAt(float x, float y) const;
+
+    /**
+     * \brief Set the tile index of a cell.
+     *
+     * Cells outside the map are ignored. Indices that don't fit into 8 bits
+     * are ignored unless the map uses wide indices.
+     */
+    void setTile(uint16_t col, uint16_t row, uint16_t tile);
+
+    /**
+     * \brief Set all cells to the given tile index.
+     */
+    void fill(uint16_t tile);
+
+    /**
+     * \brief Set all cells from an array of 8-bit tile indices.
+     *
+     * \param tiles The indices, row by row. Must contain getColumns() *
+     *      getRows() elements.
+     */
+    void setTiles(const uint8_t* tiles);
+
+    /**
+     * \brief Set all cells from an array of 16-bit tile indices.
+     *
+     * \param tiles The indices, row by row. Must contain getColumns() *
+     *      getRows() elements.
+     */
+    void setTiles(const uint16_t* tiles);
+
+    /**
+     * \brief Return the bitmap of a tile, or an invalid bitmap for EmptyTile
+     *      and indices beyond the tileset.
+     */
+    Bitmap getTileBitmap(uint16_t tile) const;
+
+    /**
+     * \brief Draw the visible part of the map.
+     *
+     * Only the tiles inside the screen's clip rectangle are drawn.
+     *
+     * \param screen The screen to draw on.
+     * \param offset The offset from world to screen coordinates.
+     */
+    void draw(Screen& screen, const Vec2& offset) const;
+
+    size_t getMemoryUsage() const;
+
+    /**
+     * \brief Check if the tilemap is valid.
+     */
+    operator bool() const { return (bool) d; }
+
+    bool operator==(const Tilemap& other) const { return d == other.d; }
+    bool operator!=(const Tilemap& other) const { return d != other.d; }
+
+private:
+    uint16_t getTileUnchecked(size_t cell) const
+    {
+        if (d->wideIndices) {
+            return d->indices16[cell];
+        }
+        return d->indices8[cell];
+    }
+
+    // The map position and the offset are rounded separately, so that moving
+    // the camera by whole pixels moves all tiles by exactly that much. This
+    // differs from how sprites are rounded only for positions exactly halfway
+    // between two pixels.
+    int32_t getDrawX(const Vec2& offset) const
+            { return static_cast<int32_t>(roundf(d->x)) + static_cast<int32_t>(roundf(offset.x())); }
+    int32_t getDrawY(const Vec2& offset) const
+            { return static_cast<int32_t>(roundf(d->y)) + static_cast<int32_t>(roundf(offset.y())); }
+
+    void markDirty(int32_t col, int32_t row, int32_t cols, int32_t rows);
+
+private:
+    std::shared_ptr<Data> d;
+};
+
+}
@@ -2,7 +2,7 @@
 
 #include "../util/Log.h"
 
-#ifdef MINTGGGAMEENGINE_PORT_ESPIDF
+#if defined(MINTGGGAMEENGINE_PORT_ESPIDF)  &&  defined(MINTGGGAMEENGINE_WITH_NETWORK)
 #include "esp_system.h"
 #include "esp_wifi.h"
 #endif
@@ -16,6 +16,8 @@ LOG_USE_TAG("NetworkEngine")
 namespace MINTGGGameEngine
 {
 
+#ifdef MINTGGGAMEENGINE_WITH_NETWORK
+
 #ifdef MINTGGGAMEENGINE_PORT_ESPIDF
 struct HTTPRequestContext
 {
@@ -50,14 +52,16 @@ esp_err_t NetworkEngineESPHTTPEventHandler(esp_http_client_event_t* evt)
 
 
 NetworkEngine::NetworkEngine()
+    : begun(false)
 #ifdef MINTGGGAMEENGINE_PORT_ESPIDF
-    : connected(false)
+    , connected(false)
 #endif
 {
 }
 
 bool NetworkEngine::begin()
 {
+    begun = true;
     return true;
 }
 
@@ -66,8 +70,22 @@ void NetworkEngine::addWifiConfig(const char* ssid, const char* password)
     wifiConfigs.emplace_back(ssid, password);
 }
 
+bool NetworkEngine::runLazyInit()
+{
+    if (lazyInitFunc) {
+        std::function<void()> func;
+        std::swap(func, lazyInitFunc);
+        func();
+    }
+    return begun  ||  begin();
+}
+
 bool NetworkEngine::start()
 {
+    if (!runLazyInit()) {
+        return false;
+    }
+
 #ifdef MINTGGGAMEENGINE_PORT_ESPIDF
     if (wifiConfigs.empty()) {
         return false;
@@ -307,4 +325,49 @@ esp_err_t NetworkEngine::espHTTPEventHandler(esp_http_client_event_t* evt)
 #endif
 
 
+#else
+
+// Stubs for builds without network support (see Kconfig).
+
+NetworkEngine::NetworkEngine()
+    : begun(false)
+{
+}
+
+bool NetworkEngine::begin()
+{
+    begun = true;
+    return true;
+}
+
+void NetworkEngine::addWifiConfig(const char* ssid, const char* password)
+{
+}
+
+bool NetworkEngine::start()
+{
+    LogError("Network support disabled at compile time");
+    return false;
+}
+
+bool NetworkEngine::isConnected() const
+{
+    return false;
+}
+
+uint8_t* NetworkEngine::sendHTTPGetRequestRaw(const std::string& url, size_t* outRespLen)
+{
+    if (outRespLen) {
+        *outRespLen = 0;
+    }
+    return nullptr;
+}
+
+std::string NetworkEngine::sendHTTPGetRequest(const std::string& url)
+{
+    return std::string();
+}
+
+#endif
+
 }
@@ -2,6 +2,7 @@
 
 #include "../Globals.h"
 
+#ifdef MINTGGGAMEENGINE_WITH_NETWORK
 #ifdef MINTGGGAMEENGINE_PORT_ESPIDF
 #include "esp_http_client.h"
 #include "esp_wifi.h"
@@ -9,7 +10,9 @@
 #include <WiFi.h>
 #include <HTTPClient.h>
 #endif
+#endif
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -18,9 +21,15 @@ namespace MINTGGGameEngine
 {
 
 
+/**
+ * \brief Handles WiFi connections and HTTP requests.
+ *
+ * If network support is disabled at compile time (see Kconfig), this class is a
+ * stub whose methods always fail.
+ */
 class NetworkEngine
 {
-#ifdef MINTGGGAMEENGINE_PORT_ESPIDF
+#if defined(MINTGGGAMEENGINE_PORT_ESPIDF)  &&  defined(MINTGGGAMEENGINE_WITH_NETWORK)
     friend void NetworkEngineESPEventHandler (
         void* arg, esp_event_base_t evtBase, int32_t evtID, void* evtData
         );
@@ -39,8 +48,26 @@ private:
 public:
     NetworkEngine();
 
+    /**
+     * \brief Initialize the network engine.
+     *
+     * This is called automatically by start(), so the network stack is only
+     * brought up when a game actually uses it. DefaultEngine does not call it
+     * during setup, but through DefaultEngine::initNetwork() (see
+     * setLazyInitFunc()).
+     */
     bool begin();
 
+    /**
+     * \brief Set a function to run on the first call to start(), before the
+     *      engine is initialized.
+     *
+     * The function is run at most once. It may call begin() and
+     * addWifiConfig(). If it doesn't call begin(), start() calls it
+     * afterwards.
+     */
+    void setLazyInitFunc(const std::function<void()>& func) { lazyInitFunc = func; }
+
     void addWifiConfig(const char* ssid, const char* password);
 
     bool start();
@@ -51,15 +78,19 @@ public:
     std::string sendHTTPGetRequest(const std::string& url);
 
 private:
-#ifdef MINTGGGAMEENGINE_PORT_ESPIDF
+    bool runLazyInit();
+
+#if defined(MINTGGGAMEENGINE_PORT_ESPIDF)  &&  defined(MINTGGGAMEENGINE_WITH_NETWORK)
     void espEventHandler(esp_event_base_t evtBase, int32_t evtID, void* evtData);
     esp_err_t espHTTPEventHandler(esp_http_client_event_t *evt);
 #endif
 
 private:
     std::vector<WifiConfig> wifiConfigs;
+    bool begun;
+    std::function<void()> lazyInitFunc;
 
-#ifdef MINTGGGAMEENGINE_PORT_ESPIDF
+#if defined(MINTGGGAMEENGINE_PORT_ESPIDF)  &&  defined(MINTGGGAMEENGINE_WITH_NETWORK)
     volatile bool connected;
     esp_http_client_handle_t httpClient;
 #elif defined(MINTGGGAMEENGINE_PORT_ARDUINO)
@@ -5,9 +5,13 @@
 
 #ifdef MINTGGGAMEENGINE_PORT_ESPIDF
 #include <esp_err.h>
+#ifdef MINTGGGAMEENGINE_WITH_SPIFFS
 #include <esp_spiffs.h>
+#endif
+#ifdef MINTGGGAMEENGINE_WITH_SDCARD
 #include <esp_vfs_fat.h>
 #endif
+#endif
 
 
 LOG_USE_TAG("StorageEngine")
@@ -67,6 +71,7 @@ bool StorageEngine::mountSDCard (
         return false;
     }
 
+#ifdef MINTGGGAMEENGINE_WITH_SDCARD
     sdmmc_host_t host = SDSPI_HOST_DEFAULT();
     host.slot = spiHost;
     host.max_freq_khz = static_cast<int>(clkFreq/1000);
@@ -97,11 +102,16 @@ bool StorageEngine::mountSDCard (
     }
 
     return true;
+#else
+    LogError("SD card support disabled at compile time");
+    return false;
+#endif
 }
 
 bool StorageEngine::mountSPIFFS (
     const char* mountPoint
 ) {
+#ifdef MINTGGGAMEENGINE_WITH_SPIFFS
     esp_vfs_spiffs_conf_t conf = {
         .base_path = mountPoint,
         .partition_label = NULL,
@@ -116,6 +126,10 @@ bool StorageEngine::mountSPIFFS (
     }
 
     return true;
+#else
+    LogError("SPIFFS support disabled at compile time");
+    return false;
+#endif
 }
 
 bool StorageEngine::hasValue(const std::string_view& key)
@@ -110,6 +110,8 @@ size_t GameObjectStreamer::getMemoryUsage() const
             Sprite sprite = sobj.gobj.getSprite();
             if (sprite.getType() == Sprite::Type::Bitmap) {
                 memUsage += sprite.getBitmap().getMemoryUsage();
+            } else if (sprite.getType() == Sprite::Type::IndexedBitmap) {
+                memUsage += sprite.getIndexedBitmap().getMemoryUsage();
             }
         }
     }
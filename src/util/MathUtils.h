@@ -9,6 +9,29 @@ namespace MINTGGGameEngine
 {
 
 
+/**
+ * \brief Integer division rounding towards negative infinity.
+ *
+ * \param a The dividend.
+ * \param b The divisor. Must be positive.
+ */
+inline int32_t FloorDiv(int32_t a, int32_t b)
+{
+    return a >= 0 ? a/b : -((-a+b-1) / b);
+}
+
+/**
+ * \brief Integer modulo whose result is always in range [0,b).
+ *
+ * \param a The dividend.
+ * \param b The divisor. Must be positive.
+ */
+inline int32_t FloorMod(int32_t a, int32_t b)
+{
+    int32_t m = a % b;
+    return m < 0 ? m+b : m;
+}
+
 /**
  * \brief Test whether a point lies within an axis-aligned rectangle.
  *
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../Globals.h"
+
+#include <algorithm>
+
+
+namespace MINTGGGameEngine
+{
+
+/**
+ * \brief An axis-aligned rectangle of pixels, e.g. a region of the screen.
+ *
+ * The rectangle covers the pixels from (x, y) up to, but not including,
+ * (x+w, y+h). A rectangle with a width or height of zero (or less) is empty.
+ */
+struct Rect
+{
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+
+    Rect() : x(0), y(0), w(0), h(0) {}
+    Rect(int32_t x, int32_t y, int32_t w, int32_t h) : x(x), y(y), w(w), h(h) {}
+
+    int32_t getRight() const { return x+w; }
+    int32_t getBottom() const { return y+h; }
+    int32_t getArea() const { return isEmpty() ? 0 : w*h; }
+
+    bool isEmpty() const { return w <= 0  ||  h <= 0; }
+
+    bool contains(int32_t px, int32_t py) const
+            { return px >= x  &&  py >= y  &&  px < x+w  &&  py < y+h; }
+
+    /**
+     * \brief Check if two rectangles share at least one pixel.
+     */
+    bool intersects(const Rect& o) const
+            { return !isEmpty()  &&  !o.isEmpty()  &&  x < o.x+o.w  &&  o.x < x+w  &&  y < o.y+o.h  &&  o.y < y+h; }
+
+    /**
+     * \brief Return the pixels covered by both rectangles (possibly empty).
+     */
+    Rect intersected(const Rect& o) const
+    {
+        int32_t x1 = std::max(x, o.x);
+        int32_t y1 = std::max(y, o.y);
+        int32_t x2 = std::min(x+w, o.x+o.w);
+        int32_t y2 = std::min(y+h, o.y+o.h);
+        return (x2 > x1  &&  y2 > y1) ? Rect(x1, y1, x2-x1, y2-y1) : Rect();
+    }
+
+    /**
+     * \brief Return the smallest rectangle containing both rectangles.
+     *
+     * Empty rectangles are ignored.
+     */
+    Rect united(const Rect& o) const
+    {
+        if (isEmpty()) {
+            return o;
+        } else if (o.isEmpty()) {
+            return *this;
+        }
+        int32_t x1 = std::min(x, o.x);
+        int32_t y1 = std::min(y, o.y);
+        int32_t x2 = std::max(x+w, o.x+o.w);
+        int32_t y2 = std::max(y+h, o.y+o.h);
+        return Rect(x1, y1, x2-x1, y2-y1);
+    }
+
+    bool operator==(const Rect& o) const { return x == o.x  &&  y == o.y  &&  w == o.w  &&  h == o.h; }
+    bool operator!=(const Rect& o) const { return !(*this == o); }
+};
+
+}
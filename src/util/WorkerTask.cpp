@@ -44,6 +44,10 @@ bool WorkerTask::start()
 
 bool WorkerTask::stop()
 {
+    if (!task) {
+        return true;
+    }
+
     stopRequested = true;
 
     // TODO: Make wait time configurable
@@ -81,6 +85,11 @@ void WorkerTask::taskMain()
         // TODO: Do something better (e.g. task notification, or proper queue)
         vTaskDelay(1);
     }
+
+    // FreeRTOS tasks must not return. Signal stop() that we're done first.
+    task = nullptr;
+    stopRequested = false;
+    vTaskDelete(nullptr);
 }
 
 void WorkerTask::doItem(WorkItem& item)
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "../Globals.h"
+
+#include <cstdint>
+
+
+/**
+ * \file Bytecode.h
+ *
+ * \brief Instruction set and file format of the bytecode VM.
+ *
+ * Every instruction is a single 32-bit little-endian word:
+ *
+ * \code
+ *      bits  0..7   opcode
+ *      bits  8..15  A (register)
+ *      bits 16..23  B (register)
+ *      bits 24..31  C (register)
+ *      bits 16..31  16-bit immediate (instead of B and C)
+ * \endcode
+ *
+ * The operand format of each opcode is given in the opcode list below:
+ *
+ * - \c ABC: A, B and C are register numbers.
+ * - \c AJ: A is a register, the immediate is a signed jump offset, relative to
+ *   the next instruction.
+ * - \c AI: A is a register, the immediate is a signed integer.
+ * - \c AK: A is a register, the immediate indexes the constant table.
+ * - \c AS: A is a register, the immediate indexes the string table.
+ *
+ * The list is also parsed by the host-side assembler (tools/mgvmasm.py), so
+ * opcodes must only ever be appended, and the X(...) entries must stay on
+ * separate lines.
+ *
+ * A bytecode file consists of a VMFileHeader, followed by the code words, the
+ * constant words and the string table. Each string is stored as a length byte
+ * followed by the characters (without terminator).
+ */
+
+
+#define MINTGGGAMEENGINE_VM_OPCODES(X) \
+    X(Nop,              ABC)  /* */ \
+    X(Halt,             ABC)  /* Stop the program for good */ \
+    X(Yield,            ABC)  /* End the current frame */ \
+    X(Jmp,              AJ)   /* pc += J */ \
+    X(Jz,               AJ)   /* if (A == 0) pc += J */ \
+    X(Jnz,              AJ)   /* if (A != 0) pc += J */ \
+    X(LoadI,            AI)   /* A = I (int) */ \
+    X(LoadK,            AK)   /* A = K (raw 32-bit word, int or float) */ \
+    X(Mov,              ABC)  /* A = B */ \
+    X(AddI,             ABC)  /* A = B + C (int) */ \
+    X(SubI,             ABC)  /* A = B - C (int) */ \
+    X(MulI,             ABC)  /* A = B * C (int) */ \
+    X(DivI,             ABC)  /* A = B / C (int) */ \
+    X(ModI,             ABC)  /* A = B % C (int) */ \
+    X(AddF,             ABC)  /* A = B + C (float) */ \
+    X(SubF,             ABC)  /* A = B - C (float) */ \
+    X(MulF,             ABC)  /* A = B * C (float) */ \
+    X(DivF,             ABC)  /* A = B / C (float) */ \
+    X(NegF,             ABC)  /* A = -B (float) */ \
+    X(IToF,             ABC)  /* A = (float) B */ \
+    X(FToI,             ABC)  /* A = (int) B */ \
+    X(EqI,              ABC)  /* A = (B == C) (int) */ \
+    X(LtI,              ABC)  /* A = (B < C) (int) */ \
+    X(LeI,              ABC)  /* A = (B <= C) (int) */ \
+    X(EqF,              ABC)  /* A = (B == C) (float) */ \
+    X(LtF,              ABC)  /* A = (B < C) (float) */ \
+    X(LeF,              ABC)  /* A = (B <= C) (float) */ \
+    X(And,              ABC)  /* A = B & C */ \
+    X(Or,               ABC)  /* A = B | C */ \
+    X(Xor,              ABC)  /* A = B ^ C */ \
+    X(Not,              ABC)  /* A = !B */ \
+    X(FrameTime,        ABC)  /* A = time since last frame in seconds (float) */ \
+    X(Rand,             ABC)  /* A = random int in [0, B] */ \
+    X(Button,           AS)   /* A = button S is pressed */ \
+    X(ButtonPressed,    AS)   /* A = button S was pressed this frame */ \
+    X(Axis,             AS)   /* A = value of axis S (float) */ \
+    X(ObjGetX,          ABC)  /* A = x of object B (float) */ \
+    X(ObjGetY,          ABC)  /* A = y of object B (float) */ \
+    X(ObjSetPos,        ABC)  /* Set position of object A to (B, C) */ \
+    X(ObjMove,          ABC)  /* Move object A by (B, C) */ \
+    X(ObjSetVisible,    ABC)  /* Set visibility of object A to B */ \
+    X(ObjHasTag,        ABC)  /* A = object B has tag bit number C */ \
+    X(ObjCollides,      ABC)  /* A = object B collides with object C */ \
+    X(Spawn,            ABC)  /* A = new object from prefab B at (C, C+1) */ \
+    X(Despawn,          ABC)  /* Despawn object A */ \
+    X(SetCamera,        ABC)  /* Set camera offset to (A, B) */ \
+    X(Log,              ABC)  /* Log A as int and float */
+
+
+namespace MINTGGGameEngine
+{
+
+
+enum VMOpcode
+{
+#define MINTGGGAMEENGINE_VM_X(name, fmt) VMOp##name,
+    MINTGGGAMEENGINE_VM_OPCODES(MINTGGGAMEENGINE_VM_X)
+#undef MINTGGGAMEENGINE_VM_X
+
+    VMOpCount
+};
+
+enum VMOperandFormat
+{
+    VMFormatABC,
+    VMFormatAJ,
+    VMFormatAI,
+    VMFormatAK,
+    VMFormatAS
+};
+
+
+/**
+ * \brief Header of a bytecode file.
+ */
+struct VMFileHeader
+{
+    char magic[4]; // "MGVM"
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t numCodeWords;
+    uint16_t numConstants;
+    uint16_t numStrings;
+} __attribute__((packed));
+
+
+enum
+{
+    VMFileVersion = 1,
+    VMNumRegisters = 256,
+    VMMaxCodeWords = 32768 // Larger programs are rejected by VMProgram::load()
+};
+
+
+inline uint8_t VMInstrOp(uint32_t instr) { return instr & 0xFF; }
+inline uint8_t VMInstrA(uint32_t instr) { return (instr >> 8) & 0xFF; }
+inline uint8_t VMInstrB(uint32_t instr) { return (instr >> 16) & 0xFF; }
+inline uint8_t VMInstrC(uint32_t instr) { return instr >> 24; }
+inline int16_t VMInstrImm(uint32_t instr) { return (int16_t) (instr >> 16); }
+
+
+}
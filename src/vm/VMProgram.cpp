@@ -0,0 +1,192 @@
+#include "VMProgram.h"
+
+#ifdef MINTGGGAMEENGINE_WITH_VM
+
+#include <cstring>
+
+#include "../storage/BufferedReader.h"
+#include "../storage/FileReader.h"
+#include "../util/Log.h"
+#include "../util/Util.h"
+
+
+LOG_USE_TAG("VMProgram")
+
+
+namespace MINTGGGameEngine
+{
+
+
+static const uint8_t VMOperandFormats[] = {
+#define MINTGGGAMEENGINE_VM_X(name, fmt) VMFormat##fmt,
+    MINTGGGAMEENGINE_VM_OPCODES(MINTGGGAMEENGINE_VM_X)
+#undef MINTGGGAMEENGINE_VM_X
+};
+
+
+static VMProgram LoadError(const char* errmsg, const char** outErrmsg)
+{
+    if (outErrmsg) {
+        *outErrmsg = errmsg;
+    }
+    return VMProgram();
+}
+
+
+static ssize_t GetBytesLeft(Reader& reader)
+{
+    const ssize_t pos = reader.tell();
+    if (pos < 0  ||  !reader.seek(0, File::SeekEnd)) {
+        return -1;
+    }
+    const ssize_t end = reader.tell();
+    if (!reader.seek(pos, File::SeekSet)) {
+        return -1;
+    }
+    return end < pos ? -1 : end - pos;
+}
+
+
+VMProgram VMProgram::load(Reader& reader, const char** outErrmsg)
+{
+    timer_mstick_t t1 = TimerGetTickcountMs();
+
+    VMFileHeader hdr;
+    if (reader.read(&hdr, sizeof(hdr)) != sizeof(hdr)) {
+        return LoadError("error reading header", outErrmsg);
+    }
+    if (memcmp(hdr.magic, "MGVM", 4) != 0) {
+        return LoadError("invalid signature", outErrmsg);
+    }
+    if (FromLittleEndian(hdr.version) != VMFileVersion) {
+        return LoadError("unsupported version", outErrmsg);
+    }
+
+    const uint32_t numCodeWords = FromLittleEndian(hdr.numCodeWords);
+    const uint16_t numConstants = FromLittleEndian(hdr.numConstants);
+    const uint16_t numStrings = FromLittleEndian(hdr.numStrings);
+
+    // Check the size before allocating anything, so that a corrupt header
+    // can't make us allocate huge amounts of memory.
+    if (numCodeWords == 0  ||  numCodeWords > VMMaxCodeWords) {
+        return LoadError("invalid code size", outErrmsg);
+    }
+    const ssize_t bytesLeft = GetBytesLeft(reader);
+    if (bytesLeft >= 0  &&  numCodeWords > static_cast<size_t>(bytesLeft) / 4) {
+        return LoadError("code size exceeds file size", outErrmsg);
+    }
+
+    auto data = std::make_shared<Data>();
+
+    // Code and constants are read in one block each. The extra code word is the
+    // implicit Halt at the end of the program.
+    data->code.resize(numCodeWords + 1);
+    if (reader.read(data->code.data(), numCodeWords*4) != numCodeWords*4u) {
+        return LoadError("error reading code", outErrmsg);
+    }
+    data->code[numCodeWords] = VMOpHalt;
+
+    data->constants.resize(numConstants);
+    if (reader.read(data->constants.data(), numConstants*4) != numConstants*4u) {
+        return LoadError("error reading constants", outErrmsg);
+    }
+
+#ifndef MINTGGGAMEENGINE_LITTLE_ENDIAN
+    for (uint32_t& word : data->code) {
+        word = FromLittleEndian(word);
+    }
+    for (uint32_t& word : data->constants) {
+        word = FromLittleEndian(word);
+    }
+#endif
+
+    data->strings.resize(numStrings);
+    for (std::string& str : data->strings) {
+        uint8_t len;
+        if (reader.read(&len, 1) != 1) {
+            return LoadError("error reading strings", outErrmsg);
+        }
+        str.resize(len);
+        if (reader.read(str.data(), len) != len) {
+            return LoadError("error reading strings", outErrmsg);
+        }
+    }
+
+    if (!validate(*data, outErrmsg)) {
+        return VMProgram();
+    }
+
+    VMProgram prog;
+    prog.d = data;
+
+    timer_mstick_t t2 = TimerGetTickcountMs();
+    LogDebug("Loaded VM program with %u instructions in %ums",
+            (unsigned int) numCodeWords, (unsigned int) (t2-t1));
+
+    return prog;
+}
+
+VMProgram VMProgram::load(const std::string_view& path, const char** outErrmsg)
+{
+    char fbuf[512];
+    FileReader freader{File(path)};
+    if (!freader.open(outErrmsg)) {
+        return VMProgram();
+    }
+    BufferedReader reader(freader, fbuf, sizeof(fbuf));
+    return load(reader, outErrmsg);
+}
+
+bool VMProgram::validate(const Data& data, const char** outErrmsg)
+{
+    const ssize_t numCodeWords = data.code.size() - 1;
+
+    for (ssize_t i = 0 ; i < numCodeWords ; i++) {
+        uint32_t instr = data.code[i];
+        uint8_t op = VMInstrOp(instr);
+
+        if (op >= VMOpCount) {
+            LoadError("invalid opcode", outErrmsg);
+            return false;
+        }
+
+        switch (VMOperandFormats[op]) {
+        case VMFormatAJ: {
+            // May jump to the implicit Halt, but not beyond.
+            ssize_t target = i+1 + VMInstrImm(instr);
+            if (target < 0  ||  target > numCodeWords) {
+                LoadError("jump target out of range", outErrmsg);
+                return false;
+            }
+            break;
+        }
+        case VMFormatAK:
+            if ((uint16_t) VMInstrImm(instr) >= data.constants.size()) {
+                LoadError("constant index out of range", outErrmsg);
+                return false;
+            }
+            break;
+        case VMFormatAS:
+            if ((uint16_t) VMInstrImm(instr) >= data.strings.size()) {
+                LoadError("string index out of range", outErrmsg);
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+
+        // Spawn reads the register pair (C, C+1).
+        if (op == VMOpSpawn  &&  VMInstrC(instr) == VMNumRegisters-1) {
+            LoadError("register out of range", outErrmsg);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+}
+
+#endif
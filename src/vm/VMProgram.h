@@ -0,0 +1,95 @@
+#pragma once
+
+#include "../Globals.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../storage/Reader.h"
+#include "Bytecode.h"
+
+
+namespace MINTGGGameEngine
+{
+
+
+/**
+ * \brief A bytecode program for the VirtualMachine.
+ *
+ * Programs are assembled on the host using tools/mgvmasm.py and loaded at
+ * runtime with load(). Loading reads the code in a single block and validates
+ * it once (opcodes, jump targets, constant and string indices), so that the
+ * VirtualMachine does not need any of these checks while running.
+ *
+ * This class uses a shared pointer to store its data. Copying is therefore
+ * cheap, and all copies still refer to the same single program.
+ *
+ * \see Bytecode.h for the instruction set and file format.
+ */
+class VMProgram
+{
+private:
+    struct Data
+    {
+        std::vector<uint32_t> code;
+        std::vector<uint32_t> constants;
+        std::vector<std::string> strings;
+    };
+
+public:
+    /**
+     * \brief Load a program from a Reader.
+     *
+     * \param reader The reader, positioned at the start of the program.
+     * \param outErrmsg Receives an error message on failure. Can be nullptr.
+     * \return The program, or a null program on failure.
+     */
+    static VMProgram load(Reader& reader, const char** outErrmsg = nullptr);
+
+    /**
+     * \brief Load a program from a file.
+     *
+     * \see load(Reader&, const char**)
+     */
+    static VMProgram load(const std::string_view& path, const char** outErrmsg = nullptr);
+
+public:
+    /**
+     * \brief Create a null program.
+     */
+    VMProgram() {}
+
+    VMProgram(const VMProgram& other) : d(other.d) {}
+
+    /**
+     * \brief Return the code words.
+     *
+     * The code always ends with an implicit Halt instruction, which is not
+     * included in getCodeSize().
+     */
+    const uint32_t* getCode() const { return d->code.data(); }
+    size_t getCodeSize() const { return d->code.size() - 1; }
+
+    const std::vector<uint32_t>& getConstants() const { return d->constants; }
+    const std::vector<std::string>& getStrings() const { return d->strings; }
+
+    /**
+     * \brief Check if this program is valid (i.e. not a null program).
+     */
+    operator bool() const { return (bool) d; }
+
+    VMProgram& operator=(const VMProgram& other) { d = other.d; return *this; }
+
+    bool operator==(const VMProgram& other) const { return d == other.d; }
+    bool operator!=(const VMProgram& other) const { return d != other.d; }
+
+private:
+    static bool validate(const Data& data, const char** outErrmsg);
+
+private:
+    std::shared_ptr<const Data> d;
+};
+
+
+}
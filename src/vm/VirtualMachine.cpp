@@ -0,0 +1,305 @@
+#include "VirtualMachine.h"
+
+#ifdef MINTGGGAMEENGINE_WITH_VM
+
+#include <cstring>
+
+#include "../core/Game.h"
+#include "../util/Log.h"
+
+
+LOG_USE_TAG("VM")
+
+
+// GCC's labels-as-values allow threaded dispatch: Every instruction handler
+// jumps directly to the next one through the table, instead of going back to a
+// single switch. On Xtensa this saves the switch's range check and the extra
+// branch, and gives the branch predictor-less core a short, fixed path per
+// instruction.
+#if defined(__GNUC__)
+#define MINTGGGAMEENGINE_VM_COMPUTED_GOTO
+#endif
+
+
+namespace MINTGGGameEngine
+{
+
+
+// Saturating float to int conversion, since the plain cast is undefined for
+// NaN and values out of range.
+static inline int32_t VMFloatToInt(float f)
+{
+    if (f != f) {
+        return 0;
+    } else if (f >= 2147483648.0f) {
+        return INT32_MAX;
+    } else if (f < -2147483648.0f) {
+        return INT32_MIN;
+    }
+    return (int32_t) f;
+}
+
+
+VirtualMachine::VirtualMachine(Game& game)
+    : game(game), state(StateStopped), errmsg(nullptr), pc(0),
+      instrBudget(10000), lastInstrCount(0), budgetExceeded(false),
+      maxObjects(DefaultMaxObjects)
+{
+    memset(regs, 0, sizeof(regs));
+}
+
+bool VirtualMachine::load(const VMProgram& program)
+{
+    if (!program) {
+        return false;
+    }
+    this->program = program;
+    reset();
+    return true;
+}
+
+void VirtualMachine::reset()
+{
+    memset(regs, 0, sizeof(regs));
+    pc = 0;
+    errmsg = nullptr;
+    lastInstrCount = 0;
+    budgetExceeded = false;
+    state = program ? StateRunning : StateStopped;
+}
+
+void VirtualMachine::bindObject(uint16_t slot, const GameObject& obj)
+{
+    if (slot >= objs.size()) {
+        objs.resize(slot+1);
+    }
+    objs[slot] = obj;
+}
+
+GameObject VirtualMachine::getObject(uint16_t slot) const
+{
+    return slot < objs.size() ? objs[slot] : GameObject();
+}
+
+void VirtualMachine::bindPrefab(uint16_t index, const Prefab& prefab)
+{
+    if (index >= prefabs.size()) {
+        prefabs.resize(index+1);
+    }
+    prefabs[index] = prefab;
+}
+
+GameObject* VirtualMachine::getObjectPtr(int32_t slot)
+{
+    if (slot < 0  ||  (size_t) slot >= objs.size()  ||  objs[slot] == nullptr) {
+        return nullptr;
+    }
+    return &objs[slot];
+}
+
+int32_t VirtualMachine::spawn(int32_t prefabIdx, float x, float y)
+{
+    if (prefabIdx < 0  ||  (size_t) prefabIdx >= prefabs.size()  ||  !prefabs[prefabIdx]) {
+        return SpawnErrorInvalidPrefab;
+    }
+
+    size_t slot = 0;
+    while (slot < objs.size()  &&  objs[slot] != nullptr) {
+        slot++;
+    }
+    if (slot == objs.size()) {
+        if (objs.size() >= maxObjects) {
+            return SpawnErrorTooManyObjects;
+        }
+        objs.emplace_back();
+    }
+
+    objs[slot] = prefabs[prefabIdx].instantiate(x, y);
+    game.spawnObject(objs[slot]);
+    return (int32_t) slot;
+}
+
+VirtualMachine::State VirtualMachine::runFrame(float dt)
+{
+    if (state != StateRunning) {
+        lastInstrCount = 0;
+        return state;
+    }
+
+    const uint32_t* code = program.getCode();
+    const uint32_t* constants = program.getConstants().data();
+    const std::string* strings = program.getStrings().data();
+
+    // Keep the hot state in locals, so that the compiler can hold it in
+    // registers for the whole loop.
+    const uint32_t* ip = code + pc;
+    Value* r = regs;
+    uint32_t budget = instrBudget;
+    uint32_t instr;
+
+    InputEngine& input = game.input();
+
+    budgetExceeded = false;
+
+    // All operand fields were validated by VMProgram on load, so no range
+    // checks are necessary here, except for object and prefab references.
+#define A (r[VMInstrA(instr)])
+#define B (r[VMInstrB(instr)])
+#define C (r[VMInstrC(instr)])
+#define IMM (VMInstrImm(instr))
+#define VM_FAIL(msg) do { errmsg = (msg); goto failed; } while (0)
+#define VM_OBJ(var, val) GameObject* var = getObjectPtr((val).i); if (!var) VM_FAIL("invalid object")
+
+#ifdef MINTGGGAMEENGINE_VM_COMPUTED_GOTO
+    static const void* const dispatchTable[] = {
+#define MINTGGGAMEENGINE_VM_X(name, fmt) &&Op##name,
+        MINTGGGAMEENGINE_VM_OPCODES(MINTGGGAMEENGINE_VM_X)
+#undef MINTGGGAMEENGINE_VM_X
+    };
+
+#define VM_NEXT() \
+    do { \
+        if (budget-- == 0) goto outOfBudget; \
+        instr = *ip++; \
+        goto *dispatchTable[VMInstrOp(instr)]; \
+    } while (0)
+#define VM_OP(name) Op##name:
+
+    VM_NEXT();
+#else
+#define VM_NEXT() continue
+#define VM_OP(name) case VMOp##name:
+
+    for (;;) {
+        if (budget-- == 0) goto outOfBudget;
+        instr = *ip++;
+        switch (VMInstrOp(instr)) {
+#endif
+
+    VM_OP(Nop) VM_NEXT();
+    VM_OP(Halt) {
+        ip--;
+        state = StateHalted;
+        goto done;
+    }
+    VM_OP(Yield) goto done;
+
+    VM_OP(Jmp) ip += IMM; VM_NEXT();
+    VM_OP(Jz) if (A.i == 0) ip += IMM; VM_NEXT();
+    VM_OP(Jnz) if (A.i != 0) ip += IMM; VM_NEXT();
+
+    VM_OP(LoadI) A.i = IMM; VM_NEXT();
+    VM_OP(LoadK) A.u = constants[(uint16_t) IMM]; VM_NEXT();
+    VM_OP(Mov) A = B; VM_NEXT();
+
+    // Integer arithmetic wraps around. It's done unsigned, because signed
+    // overflow (including INT32_MIN / -1) is undefined.
+    VM_OP(AddI) A.u = B.u + C.u; VM_NEXT();
+    VM_OP(SubI) A.u = B.u - C.u; VM_NEXT();
+    VM_OP(MulI) A.u = B.u * C.u; VM_NEXT();
+    VM_OP(DivI) {
+        if (C.i == 0) VM_FAIL("division by zero");
+        if (C.i == -1) A.u = 0u - B.u; else A.i = B.i / C.i;
+        VM_NEXT();
+    }
+    VM_OP(ModI) {
+        if (C.i == 0) VM_FAIL("division by zero");
+        if (C.i == -1) A.i = 0; else A.i = B.i % C.i;
+        VM_NEXT();
+    }
+
+    VM_OP(AddF) A.f = B.f + C.f; VM_NEXT();
+    VM_OP(SubF) A.f = B.f - C.f; VM_NEXT();
+    VM_OP(MulF) A.f = B.f * C.f; VM_NEXT();
+    VM_OP(DivF) A.f = B.f / C.f; VM_NEXT();
+    VM_OP(NegF) A.f = -B.f; VM_NEXT();
+    VM_OP(IToF) A.f = (float) B.i; VM_NEXT();
+    VM_OP(FToI) A.i = VMFloatToInt(B.f); VM_NEXT();
+
+    VM_OP(EqI) A.i = (B.i == C.i); VM_NEXT();
+    VM_OP(LtI) A.i = (B.i < C.i); VM_NEXT();
+    VM_OP(LeI) A.i = (B.i <= C.i); VM_NEXT();
+    VM_OP(EqF) A.i = (B.f == C.f); VM_NEXT();
+    VM_OP(LtF) A.i = (B.f < C.f); VM_NEXT();
+    VM_OP(LeF) A.i = (B.f <= C.f); VM_NEXT();
+
+    VM_OP(And) A.u = B.u & C.u; VM_NEXT();
+    VM_OP(Or) A.u = B.u | C.u; VM_NEXT();
+    VM_OP(Xor) A.u = B.u ^ C.u; VM_NEXT();
+    VM_OP(Not) A.i = !B.i; VM_NEXT();
+
+    VM_OP(FrameTime) A.f = dt; VM_NEXT();
+    VM_OP(Rand) A.i = B.i > 0 ? game.randInt<int32_t>(B.i) : 0; VM_NEXT();
+
+    VM_OP(Button) A.i = input.isButtonPressed(strings[(uint16_t) IMM]); VM_NEXT();
+    VM_OP(ButtonPressed) A.i = input.isButtonPressedThisFrame(strings[(uint16_t) IMM]); VM_NEXT();
+    VM_OP(Axis) A.f = input.getAxis(strings[(uint16_t) IMM]); VM_NEXT();
+
+    VM_OP(ObjGetX) { VM_OBJ(obj, B); A.f = obj->getX(); VM_NEXT(); }
+    VM_OP(ObjGetY) { VM_OBJ(obj, B); A.f = obj->getY(); VM_NEXT(); }
+    VM_OP(ObjSetPos) { VM_OBJ(obj, A); obj->setPosition(B.f, C.f); VM_NEXT(); }
+    VM_OP(ObjMove) { VM_OBJ(obj, A); obj->move(B.f, C.f); VM_NEXT(); }
+    VM_OP(ObjSetVisible) { VM_OBJ(obj, A); obj->setVisible(B.i != 0); VM_NEXT(); }
+    VM_OP(ObjHasTag) {
+        VM_OBJ(obj, B);
+        A.i = (C.u < 64)  &&  obj->hasTag(uint64_t(1) << C.u);
+        VM_NEXT();
+    }
+    VM_OP(ObjCollides) {
+        VM_OBJ(obj1, B);
+        VM_OBJ(obj2, C);
+        A.i = obj1->collides(*obj2);
+        VM_NEXT();
+    }
+
+    VM_OP(Spawn) {
+        int32_t slot = spawn(B.i, C.f, r[VMInstrC(instr)+1].f);
+        if (slot == SpawnErrorTooManyObjects) VM_FAIL("too many objects");
+        if (slot < 0) VM_FAIL("invalid prefab");
+        A.i = slot;
+        VM_NEXT();
+    }
+    VM_OP(Despawn) {
+        VM_OBJ(obj, A);
+        game.despawnObject(*obj);
+        *obj = GameObject();
+        VM_NEXT();
+    }
+
+    VM_OP(SetCamera) game.setCameraOffset(A.f, B.f); VM_NEXT();
+    VM_OP(Log) LogInfo("r%u = %d / %f", (unsigned int) VMInstrA(instr), (int) A.i, (double) A.f); VM_NEXT();
+
+#ifndef MINTGGGAMEENGINE_VM_COMPUTED_GOTO
+        }
+    }
+#endif
+
+#undef A
+#undef B
+#undef C
+#undef IMM
+#undef VM_FAIL
+#undef VM_OBJ
+#undef VM_NEXT
+#undef VM_OP
+
+outOfBudget:
+    budgetExceeded = true;
+    budget = 0;
+    goto done;
+
+failed:
+    ip--;
+    state = StateError;
+    LogError("Program failed at pc=%u: %s", (unsigned int) (ip-code), errmsg);
+
+done:
+    pc = ip - code;
+    lastInstrCount = instrBudget - budget;
+    return state;
+}
+
+
+}
+
+#endif
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "../Globals.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "../core/GameObject.h"
+#include "../core/Prefab.h"
+#include "Bytecode.h"
+#include "VMProgram.h"
+
+
+namespace MINTGGGameEngine
+{
+
+class Game;
+
+
+/**
+ * \brief A register-based virtual machine running bytecode game logic.
+ *
+ * This allows game logic to be loaded from storage instead of being compiled
+ * into the firmware. Programs can only access the Game through the VM's
+ * instructions, and only the objects and prefabs that the host explicitly
+ * binds to the VM, so they are sandboxed from the rest of the firmware. No
+ * instruction has undefined behavior: Integer arithmetic wraps around, FToI
+ * saturates (with NaN becoming 0), and the number of objects a program can
+ * spawn is limited (see setMaxObjects()).
+ *
+ * The VM has 256 registers of 32 bits each, holding either an int or a float,
+ * depending on the instruction that uses them. Registers keep their values
+ * across frames. Objects are referred to by their slot number in the VM's
+ * object table, which is filled by bindObject() and the Spawn instruction.
+ *
+ * A program runs until it executes Yield, which ends the frame. The next call
+ * to runFrame() continues after the Yield. To keep the cost per frame
+ * predictable, at most getInstructionBudget() instructions are executed per
+ * frame. When the budget is exhausted, the program is preempted and continues
+ * at the same point in the next frame.
+ *
+ * A typical usage looks like this:
+ *
+ * \code{.cpp}
+ *      VirtualMachine vm(game);
+ *      vm.load(VMProgram::load("/sdcard/level1.mgvm"));
+ *      vm.bindObject(0, player);
+ *      vm.bindPrefab(0, enemyPrefab);
+ *
+ *      // In the game loop:
+ *      vm.runFrame(dt);
+ * \endcode
+ *
+ * \see Bytecode.h for the instruction set.
+ */
+class VirtualMachine
+{
+public:
+    enum State
+    {
+        StateStopped,   ///< No program was loaded.
+        StateRunning,   ///< The program will continue in the next frame.
+        StateHalted,    ///< The program executed Halt or reached its end.
+        StateError      ///< The program failed, see getErrorMessage().
+    };
+
+    enum
+    {
+        DefaultMaxObjects = 64
+    };
+
+private:
+    enum SpawnError
+    {
+        SpawnErrorInvalidPrefab = -1,
+        SpawnErrorTooManyObjects = -2
+    };
+
+    union Value
+    {
+        int32_t i;
+        float f;
+        uint32_t u;
+    };
+
+public:
+    /**
+     * \brief Create a new VM with no program.
+     *
+     * \param game The game that the program controls.
+     */
+    VirtualMachine(Game& game);
+
+    VirtualMachine(const VirtualMachine& other) = delete;
+
+    /**
+     * \brief Load a program and start it from the beginning.
+     *
+     * All registers are cleared. Bound objects and prefabs are kept.
+     *
+     * \param program The program.
+     * \return true if successful, false if the program is null.
+     */
+    bool load(const VMProgram& program);
+
+    /**
+     * \brief Restart the current program from the beginning.
+     */
+    void reset();
+
+    /**
+     * \brief Run the program until it yields, halts or exhausts the
+     *      instruction budget.
+     *
+     * \param dt The time since the last frame, in seconds.
+     * \return The state after running.
+     */
+    State runFrame(float dt);
+
+    State getState() const { return state; }
+    const char* getErrorMessage() const { return errmsg; }
+
+    /**
+     * \brief Set the maximum number of instructions per call to runFrame().
+     */
+    void setInstructionBudget(uint32_t budget) { instrBudget = budget; }
+    uint32_t getInstructionBudget() const { return instrBudget; }
+
+    /**
+     * \brief Return the number of instructions executed by the last call to
+     *      runFrame().
+     */
+    uint32_t getLastInstructionCount() const { return lastInstrCount; }
+
+    /**
+     * \brief Check if the last call to runFrame() exhausted the instruction
+     *      budget.
+     */
+    bool wasBudgetExceeded() const { return budgetExceeded; }
+
+    /**
+     * \brief Set the maximum size of the object table.
+     *
+     * Spawn fails with an error once the table is full, i.e. when all slots
+     * below the maximum hold an object (despawned objects free their slot).
+     * This keeps a program from allocating unbounded memory. Objects bound by
+     * the host with bindObject() are not limited.
+     */
+    void setMaxObjects(uint16_t maxObjects) { this->maxObjects = maxObjects; }
+    uint16_t getMaxObjects() const { return maxObjects; }
+
+
+    /// \name Host Bindings
+    ///@{
+
+    /**
+     * \brief Make an object accessible to the program.
+     *
+     * \param slot The slot number by which the program refers to the object.
+     * \param obj The object, or a null object to unbind the slot.
+     */
+    void bindObject(uint16_t slot, const GameObject& obj);
+
+    /**
+     * \brief Return the object in the given slot, or a null object.
+     */
+    GameObject getObject(uint16_t slot) const;
+
+    /**
+     * \brief Make a prefab available to the Spawn instruction.
+     *
+     * \param index The index by which the program refers to the prefab.
+     * \param prefab The prefab.
+     */
+    void bindPrefab(uint16_t index, const Prefab& prefab);
+
+    int32_t getRegisterInt(uint8_t reg) const { return regs[reg].i; }
+    float getRegisterFloat(uint8_t reg) const { return regs[reg].f; }
+    void setRegisterInt(uint8_t reg, int32_t v) { regs[reg].i = v; }
+    void setRegisterFloat(uint8_t reg, float v) { regs[reg].f = v; }
+
+    ///@}
+
+private:
+    GameObject* getObjectPtr(int32_t slot);
+    int32_t spawn(int32_t prefabIdx, float x, float y);
+
+private:
+    Game& game;
+    VMProgram program;
+
+    State state;
+    const char* errmsg;
+    uint32_t pc;
+
+    uint32_t instrBudget;
+    uint32_t lastInstrCount;
+    bool budgetExceeded;
+    uint16_t maxObjects;
+
+    std::vector<GameObject> objs;
+    std::vector<Prefab> prefabs;
+
+    Value regs[VMNumRegisters];
+};
+
+
+}
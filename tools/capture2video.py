@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+"""Convert a gameplay capture written by ScreenRecorder to a video.
+
+The capture's frames are resampled to a constant frame rate using their time
+stamps, or with --every-frame, each frame is shown exactly once. Output files
+ending in .avi are written directly, as uncompressed 24-bit AVI. For any other
+extension (e.g. .mp4 or .gif), the frames are piped to ffmpeg, which must be in
+the PATH.
+
+Usage: capture2video.py [--fps N] [--every-frame] [--scale N] capture.mgc output.avi
+"""
+
+import argparse
+import struct
+import subprocess
+import sys
+
+
+FLAG_FRAME_END = 0x01
+
+
+def decode_row(data, width):
+    """Decode one run-length encoded row into a list of RGB565 values."""
+    pixels = []
+    i = 0
+    while i < len(data):
+        c = data[i]
+        i += 1
+        if c < 128:
+            n = c + 1
+            pixels.extend(struct.unpack_from("<%dH" % n, data, i))
+            i += 2*n
+        else:
+            (p,) = struct.unpack_from("<H", data, i)
+            pixels.extend([p] * (c - 127))
+            i += 2
+    if len(pixels) != width:
+        raise ValueError("row has %d pixels instead of %d" % (len(pixels), width))
+    return pixels
+
+
+def rgb565_to_rgb24(p):
+    r = (p >> 11) & 0x1F
+    g = (p >> 5) & 0x3F
+    b = p & 0x1F
+    return ((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2))
+
+
+def read_frames(f):
+    """Yield (width, height) once, then (time_ms, rows) for every frame.
+
+    rows is a list of rows, each a bytes object of RGB24 pixels.
+    """
+    header = f.read(12)
+    if len(header) != 12 or header[:4] != b"MGCP":
+        raise ValueError("not a capture file")
+    version, width, height, _ = struct.unpack_from("<4H", header, 4)
+    if version != 1:
+        raise ValueError("unsupported capture version %d" % version)
+    yield width, height
+
+    rows = [bytes(width*3)] * height
+    lut = [bytes(rgb565_to_rgb24(p)) for p in range(65536)]
+    cur_frame = None
+    cur_time = 0
+
+    while True:
+        rec = f.read(11)
+        if len(rec) < 11:
+            break
+        frame, time_ms, flags, num_rows = struct.unpack("<IIBH", rec)
+
+        # Records of a frame whose end marker was dropped
+        if cur_frame is not None and frame != cur_frame:
+            yield cur_time, list(rows)
+
+        for _ in range(num_rows):
+            y, size = struct.unpack("<HH", f.read(4))
+            pixels = decode_row(f.read(size), width)
+            rows[y] = b"".join(lut[p] for p in pixels)
+
+        cur_frame = frame
+        cur_time = time_ms
+        if flags & FLAG_FRAME_END:
+            yield cur_time, list(rows)
+            cur_frame = None
+
+    if cur_frame is not None:
+        yield cur_time, list(rows)
+
+
+def resample(frames, fps):
+    """Yield the frame to show at every tick of a constant frame rate."""
+    start = None
+    prev = None
+    tick = 0
+    for time_ms, rows in frames:
+        if start is None:
+            start = time_ms
+        # Show the previous frame until this one's time
+        while prev is not None and tick * 1000.0 / fps < time_ms - start:
+            yield prev
+            tick += 1
+        prev = rows
+    if prev is not None:
+        yield prev
+
+
+def scale_rows(rows, scale):
+    if scale == 1:
+        return rows
+    out = []
+    for row in rows:
+        srow = b"".join(row[i:i+3] * scale for i in range(0, len(row), 3))
+        out.extend([srow] * scale)
+    return out
+
+
+class AVIWriter:
+    """Writes uncompressed, bottom-up 24-bit BGR frames to an AVI file."""
+
+    def __init__(self, f, width, height, fps):
+        self.f = f
+        self.width = width
+        self.height = height
+        self.fps = fps
+        self.row_size = (width*3 + 3) & ~3
+        self.frame_size = self.row_size * height
+        self.offsets = []
+
+        strf = struct.pack("<IiiHHIIiiII", 40, width, height, 1, 24, 0, self.frame_size, 0, 0, 0, 0)
+        strh = struct.pack("<4s4sIHHIIIIIIIIhhhh", b"vids", b"DIB ", 0, 0, 0, 0,
+                           1, fps, 0, 0, self.frame_size, 0xFFFFFFFF, 0, 0, 0, width, height)
+        avih = struct.pack("<IIIIIIIIII4I", 1000000 // fps, self.frame_size * fps, 0, 0x10,
+                           0, 0, 1, self.frame_size, width, height, 0, 0, 0, 0)
+        strl = self.list(b"strl", self.chunk(b"strh", strh) + self.chunk(b"strf", strf))
+        hdrl = self.list(b"hdrl", self.chunk(b"avih", avih) + strl)
+
+        f.write(b"RIFF" + struct.pack("<I", 0) + b"AVI ")
+        f.write(hdrl)
+        self.movi_pos = f.tell()
+        f.write(b"LIST" + struct.pack("<I", 0) + b"movi")
+
+    @staticmethod
+    def chunk(fourcc, data):
+        return fourcc + struct.pack("<I", len(data)) + data
+
+    @staticmethod
+    def list(fourcc, data):
+        return b"LIST" + struct.pack("<I", len(data) + 4) + fourcc + data
+
+    def write_frame(self, rows):
+        pad = bytes(self.row_size - self.width*3)
+        data = b"".join(self.to_bgr(row) + pad for row in reversed(rows))
+        self.offsets.append(self.f.tell() - self.movi_pos - 8)
+        self.f.write(self.chunk(b"00db", data))
+
+    @staticmethod
+    def to_bgr(row):
+        bgr = bytearray(row)
+        bgr[0::3] = row[2::3]
+        bgr[2::3] = row[0::3]
+        return bytes(bgr)
+
+    def close(self):
+        movi_end = self.f.tell()
+        idx = b"".join(struct.pack("<4sIII", b"00db", 0x10, off, self.frame_size) for off in self.offsets)
+        self.f.write(self.chunk(b"idx1", idx))
+        end = self.f.tell()
+
+        self.f.seek(4)
+        self.f.write(struct.pack("<I", end - 8))
+        self.f.seek(self.movi_pos + 4)
+        self.f.write(struct.pack("<I", movi_end - self.movi_pos - 8))
+        # Number of frames, in avih and strh
+        self.f.seek(12 + 8 + 4 + 8 + 16)
+        self.f.write(struct.pack("<I", len(self.offsets)))
+        self.f.seek(12 + 8 + 4 + 8 + 56 + 12 + 8 + 32)
+        self.f.write(struct.pack("<I", len(self.offsets)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a ScreenRecorder capture to a video.")
+    parser.add_argument("--fps", type=int, default=30, help="output frame rate (default: 30)")
+    parser.add_argument("--every-frame", action="store_true",
+                        help="output every captured frame once, ignoring the time stamps")
+    parser.add_argument("--scale", type=int, default=1, help="integer upscaling factor (default: 1)")
+    parser.add_argument("capture")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    with open(args.capture, "rb") as f:
+        frames = read_frames(f)
+        width, height = next(frames)
+        out_w = width * args.scale
+        out_h = height * args.scale
+
+        if args.every_frame:
+            frames = (rows for _, rows in frames)
+        else:
+            frames = resample(frames, args.fps)
+
+        num_frames = 0
+        if args.output.lower().endswith(".avi"):
+            with open(args.output, "wb") as out:
+                writer = AVIWriter(out, out_w, out_h, args.fps)
+                for rows in frames:
+                    writer.write_frame(scale_rows(rows, args.scale))
+                    num_frames += 1
+                writer.close()
+        else:
+            ffmpeg = subprocess.Popen([
+                "ffmpeg", "-y", "-loglevel", "error",
+                "-f", "rawvideo", "-pix_fmt", "rgb24",
+                "-s", "%dx%d" % (out_w, out_h), "-r", str(args.fps),
+                "-i", "-", args.output,
+            ], stdin=subprocess.PIPE)
+            for rows in frames:
+                ffmpeg.stdin.write(b"".join(scale_rows(rows, args.scale)))
+                num_frames += 1
+            ffmpeg.stdin.close()
+            if ffmpeg.wait() != 0:
+                print("ffmpeg failed", file=sys.stderr)
+                return 1
+
+    print("Wrote %d frames (%dx%d at %d fps)" % (num_frames, out_w, out_h, args.fps), file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
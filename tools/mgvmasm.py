@@ -0,0 +1,254 @@
+#!/usr/bin/env python3
+"""Assembler for MINTGGGameEngine VM bytecode.
+
+Translates a text assembly file into the binary format loaded by
+VMProgram::load(). The instruction set is read from src/vm/Bytecode.h, so the
+assembler always matches the engine it is shipped with.
+
+Syntax, one instruction per line:
+
+    ; Comments start with a semicolon.
+    .const speed 1.5        ; Named constant, usable as operand of loadk
+    loop:                   ; Label, usable as operand of jmp/jz/jnz
+        buttonpressed r0, "A"
+        jz r0, skip
+        loadk r1, speed
+        loadk r2, 0.0
+        objmove r10, r1, r2
+    skip:
+        yield
+        jmp loop
+
+Mnemonics are the opcode names from Bytecode.h, case-insensitive. Registers are
+written as r0 to r255. Constants given to loadk can be names defined by .const,
+or literal ints or floats (with a decimal point). Strings are given in double
+quotes.
+
+Usage: mgvmasm.py input.s output.mgvm
+"""
+
+import os
+import re
+import struct
+import sys
+
+
+BYTECODE_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "vm", "Bytecode.h")
+
+FILE_VERSION = 1
+MAX_CODE_WORDS = 32768  # VMMaxCodeWords in Bytecode.h
+
+
+class AsmError(Exception):
+    pass
+
+
+def load_opcodes(path):
+    opcodes = {}
+    with open(path, "r") as f:
+        for line in f:
+            m = re.match(r"\s*X\((\w+),\s*(\w+)\)", line)
+            if m:
+                opcodes[m.group(1).lower()] = (len(opcodes), m.group(2))
+    if not opcodes:
+        raise AsmError("no opcodes found in %s" % path)
+    return opcodes
+
+
+def split_operands(s):
+    ops = []
+    cur = ""
+    in_str = False
+    for c in s:
+        if c == '"':
+            in_str = not in_str
+            cur += c
+        elif c == "," and not in_str:
+            ops.append(cur.strip())
+            cur = ""
+        else:
+            cur += c
+    if cur.strip():
+        ops.append(cur.strip())
+    return ops
+
+
+def strip_comment(line):
+    in_str = False
+    for i, c in enumerate(line):
+        if c == '"':
+            in_str = not in_str
+        elif c == ";" and not in_str:
+            return line[:i]
+    return line
+
+
+def parse_reg(s):
+    m = re.fullmatch(r"[rR](\d+)", s)
+    if not m or int(m.group(1)) > 255:
+        raise AsmError("invalid register: %s" % s)
+    return int(m.group(1))
+
+
+def parse_int(s):
+    try:
+        return int(s, 0)
+    except ValueError:
+        raise AsmError("invalid integer: %s" % s)
+
+
+def parse_number_word(s):
+    if re.fullmatch(r"[-+]?\d+", s) or re.fullmatch(r"[-+]?0[xX][0-9a-fA-F]+", s):
+        value = parse_int(s)
+        if value < -0x80000000 or value > 0xFFFFFFFF:
+            raise AsmError("integer out of range: %s" % s)
+        return value & 0xFFFFFFFF
+    try:
+        return struct.unpack("<I", struct.pack("<f", float(s)))[0]
+    except (ValueError, OverflowError):
+        raise AsmError("invalid number: %s" % s)
+
+
+class Assembler:
+    def __init__(self, opcodes):
+        self.opcodes = opcodes
+        self.code = []
+        self.labels = {}
+        self.fixups = []
+        self.consts = []
+        self.const_index = {}
+        self.named_consts = {}
+        self.strings = []
+        self.string_index = {}
+
+    def const(self, word):
+        if word not in self.const_index:
+            self.const_index[word] = len(self.consts)
+            self.consts.append(word)
+        return self.const_index[word]
+
+    def string(self, s):
+        if len(s.encode("utf-8")) > 255:
+            raise AsmError("string too long: %s" % s)
+        if s not in self.string_index:
+            self.string_index[s] = len(self.strings)
+            self.strings.append(s)
+        return self.string_index[s]
+
+    def assemble_line(self, line):
+        line = strip_comment(line).strip()
+        if not line:
+            return
+
+        m = re.match(r"(\w+):\s*(.*)", line)
+        if m:
+            if m.group(1) in self.labels:
+                raise AsmError("duplicate label: %s" % m.group(1))
+            self.labels[m.group(1)] = len(self.code)
+            line = m.group(2).strip()
+            if not line:
+                return
+
+        if line.startswith(".const"):
+            parts = line.split()
+            if len(parts) != 3:
+                raise AsmError("expected: .const name value")
+            self.named_consts[parts[1]] = parse_number_word(parts[2])
+            return
+
+        parts = line.split(None, 1)
+        mnemonic = parts[0].lower()
+        if mnemonic not in self.opcodes:
+            raise AsmError("unknown instruction: %s" % parts[0])
+        op, fmt = self.opcodes[mnemonic]
+        operands = split_operands(parts[1]) if len(parts) > 1 else []
+
+        if fmt == "ABC":
+            if len(operands) > 3:
+                raise AsmError("too many operands")
+            regs = [parse_reg(o) for o in operands] + [0] * (3 - len(operands))
+            word = op | (regs[0] << 8) | (regs[1] << 16) | (regs[2] << 24)
+        else:
+            if fmt == "AJ" and len(operands) == 1:
+                # jmp does not use A
+                operands = ["r0"] + operands
+            if len(operands) != 2:
+                raise AsmError("expected 2 operands")
+            a = parse_reg(operands[0])
+            arg = operands[1]
+            if fmt == "AJ":
+                self.fixups.append((len(self.code), arg))
+                imm = 0
+            elif fmt == "AI":
+                imm = parse_int(arg)
+                if imm < -32768 or imm > 32767:
+                    raise AsmError("immediate out of range: %s" % arg)
+            elif fmt == "AK":
+                if arg in self.named_consts:
+                    imm = self.const(self.named_consts[arg])
+                else:
+                    imm = self.const(parse_number_word(arg))
+            elif fmt == "AS":
+                if len(arg) < 2 or arg[0] != '"' or arg[-1] != '"':
+                    raise AsmError("expected string: %s" % arg)
+                imm = self.string(arg[1:-1])
+            else:
+                raise AsmError("unknown operand format: %s" % fmt)
+            word = op | (a << 8) | ((imm & 0xFFFF) << 16)
+
+        self.code.append(word)
+
+    def link(self):
+        if not self.code:
+            raise AsmError("empty program")
+        if len(self.code) > MAX_CODE_WORDS:
+            raise AsmError("program too large: %d instructions (maximum %d)" % (len(self.code), MAX_CODE_WORDS))
+        for pos, label in self.fixups:
+            if label not in self.labels:
+                raise AsmError("unknown label: %s" % label)
+            offset = self.labels[label] - (pos + 1)
+            if offset < -32768 or offset > 32767:
+                raise AsmError("jump too far: %s" % label)
+            self.code[pos] = (self.code[pos] & 0xFFFF) | ((offset & 0xFFFF) << 16)
+        if len(self.consts) > 0xFFFF or len(self.strings) > 0xFFFF:
+            raise AsmError("too many constants or strings")
+
+    def output(self):
+        data = b"MGVM"
+        data += struct.pack("<HHIHH", FILE_VERSION, 0, len(self.code), len(self.consts), len(self.strings))
+        data += struct.pack("<%dI" % len(self.code), *self.code)
+        data += struct.pack("<%dI" % len(self.consts), *self.consts)
+        for s in self.strings:
+            b = s.encode("utf-8")
+            data += struct.pack("<B", len(b)) + b
+        return data
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage: %s input.s output.mgvm" % sys.argv[0], file=sys.stderr)
+        return 1
+
+    asm = Assembler(load_opcodes(BYTECODE_H))
+    with open(sys.argv[1], "r") as f:
+        for lineno, line in enumerate(f, 1):
+            try:
+                asm.assemble_line(line)
+            except AsmError as e:
+                print("%s:%d: error: %s" % (sys.argv[1], lineno, e), file=sys.stderr)
+                return 1
+    try:
+        asm.link()
+    except AsmError as e:
+        print("%s: error: %s" % (sys.argv[1], e), file=sys.stderr)
+        return 1
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(asm.output())
+
+    print("%d instructions, %d constants, %d strings" % (len(asm.code), len(asm.consts), len(asm.strings)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Report the flash and RAM savings of each optional engine subsystem.
+
+Builds the given ESP-IDF project once with the default configuration, and then
+once for every subsystem option in the engine's Kconfig with only that option
+disabled. The sizes reported by "idf.py size" are printed as a table.
+
+Usage: size_report.py path/to/project
+"""
+
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+KCONFIG = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Kconfig")
+
+
+def load_options(path):
+    with open(path, "r") as f:
+        return re.findall(r"^\s*config\s+(MINTGGGAMEENGINE_WITH_\w+)", f.read(), re.MULTILINE)
+
+
+def build_size(project, build_dir, disabled):
+    defaults = [os.path.join(project, "sdkconfig.defaults")]
+    defaults = [d for d in defaults if os.path.exists(d)]
+
+    with tempfile.NamedTemporaryFile("w", suffix=".defaults", delete=False) as f:
+        if disabled:
+            f.write("# CONFIG_%s is not set\n" % disabled)
+        overlay = f.name
+    defaults.append(overlay)
+
+    try:
+        args = [
+            "idf.py", "-C", project, "-B", build_dir,
+            "-D", "SDKCONFIG=%s" % os.path.join(build_dir, "sdkconfig"),
+            "-D", "SDKCONFIG_DEFAULTS=%s" % ";".join(defaults),
+        ]
+        subprocess.run(args + ["build"], check=True, stdout=subprocess.DEVNULL)
+        out = subprocess.run(args + ["size", "--format", "json"], check=True,
+                             stdout=subprocess.PIPE, universal_newlines=True).stdout
+    finally:
+        os.unlink(overlay)
+
+    # idf.py may print status lines before the JSON object.
+    size = json.loads(out[out.index("{"):])
+    flash = size.get("total_size", size.get("flash_total", 0))
+    ram = size.get("used_dram", 0) + size.get("used_iram", 0)
+    return flash, ram
+
+
+def main():
+    if len(sys.argv) != 2:
+        print("Usage: %s path/to/project" % sys.argv[0], file=sys.stderr)
+        return 1
+
+    project = os.path.abspath(sys.argv[1])
+    options = load_options(KCONFIG)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        results = []
+        for opt in [None] + options:
+            name = opt or "(all enabled)"
+            print("Building %s..." % name, file=sys.stderr)
+            try:
+                results.append((name, build_size(project, os.path.join(tmp, name.strip("()")), opt)))
+            except subprocess.CalledProcessError:
+                print("Build failed for %s" % name, file=sys.stderr)
+                return 1
+
+    base_flash, base_ram = results[0][1]
+    print("%-40s %10s %10s %10s %10s" % ("Configuration", "Flash", "Saved", "RAM", "Saved"))
+    for name, (flash, ram) in results:
+        if name.startswith("MINTGGGAMEENGINE_WITH_"):
+            name = "without " + name[len("MINTGGGAMEENGINE_WITH_"):].lower()
+        print("%-40s %10d %10d %10d %10d" % (name, flash, base_flash-flash, ram, base_ram-ram))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())